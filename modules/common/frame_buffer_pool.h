@@ -0,0 +1,113 @@
+// Copyright (C) 2021 FengD
+// License: Modified BSD Software License Agreement
+// Author: Feng DING
+// Description: growable pool of frame buffers
+
+#pragma once
+
+#include <stdlib.h>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace crdc {
+namespace airi {
+namespace common {
+/**
+ * @brief Byte buffers for decoded frames. Unlike CCObjectPool the buffers differ in
+ *        size and the pool grows on demand, a released buffer goes back to the pool
+ *        when the last reference to it is gone, so frames are decoded into memory that
+ *        was already used by an earlier frame of the same size.
+ *        Create it with std::make_shared, buffers may outlive the pool.
+ */
+class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+ public:
+  // buffers aligned for simd conversions, e.g. swscale
+  static const size_t kAlignment = 64;
+
+  struct Stats {
+    uint64_t allocations{0};
+    uint64_t reuses{0};
+    size_t bytes_allocated{0};
+    size_t free_buffers{0};
+  };
+
+ public:
+  explicit FrameBufferPool(size_t max_free = 8) : max_free_(max_free) {}
+
+  FrameBufferPool(const FrameBufferPool &other) = delete;
+  FrameBufferPool &operator=(const FrameBufferPool &other) = delete;
+
+  ~FrameBufferPool() {
+    for (auto &buffer : free_) {
+      free(buffer.second);
+    }
+  }
+
+  // a buffer of at least size bytes, nullptr if out of memory
+  std::shared_ptr<uint8_t> acquire(size_t size) {
+    uint8_t *data = nullptr;
+    size_t capacity = size;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // the smallest free buffer that fits without wasting more than half of it
+      auto it = free_.lower_bound(size);
+      if (it != free_.end() && it->first <= size * 2) {
+        capacity = it->first;
+        data = it->second;
+        free_.erase(it);
+        ++stats_.reuses;
+      }
+    }
+    if (!data) {
+      void *memory = nullptr;
+      if (posix_memalign(&memory, kAlignment, std::max<size_t>(size, 1)) != 0) {
+        return nullptr;
+      }
+      data = static_cast<uint8_t *>(memory);
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.allocations;
+      stats_.bytes_allocated += capacity;
+    }
+
+    std::weak_ptr<FrameBufferPool> pool = shared_from_this();
+    return std::shared_ptr<uint8_t>(data, [pool, capacity](uint8_t *data) {
+      auto self = pool.lock();
+      if (self) {
+        self->release(data, capacity);
+      } else {
+        free(data);
+      }
+    });
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = stats_;
+    stats.free_buffers = free_.size();
+    return stats;
+  }
+
+ private:
+  void release(uint8_t *data, size_t capacity) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (free_.size() < max_free_) {
+        free_.emplace(capacity, data);
+        return;
+      }
+      stats_.bytes_allocated -= capacity;
+    }
+    free(data);
+  }
+
+  const size_t max_free_;
+  mutable std::mutex mutex_;
+  std::multimap<size_t, uint8_t *> free_;
+  Stats stats_;
+};
+}  // namespace common
+}  // namespace airi
+}  // namespace crdc
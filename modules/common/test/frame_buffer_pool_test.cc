@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "common/frame_buffer_pool.h"
+
+namespace crdc {
+namespace airi {
+namespace common {
+
+TEST(FrameBufferPoolTest, ReusesReleasedBuffers) {
+    auto pool = std::make_shared<FrameBufferPool>();
+    uint8_t* first = nullptr;
+    {
+        auto buffer = pool->acquire(640 * 480 * 3);
+        ASSERT_NE(buffer, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.get()) % FrameBufferPool::kAlignment, 0u);
+        memset(buffer.get(), 0, 640 * 480 * 3);
+        first = buffer.get();
+    }
+    EXPECT_EQ(pool->stats().free_buffers, 1u);
+
+    // the same size comes back without allocating
+    auto buffer = pool->acquire(640 * 480 * 3);
+    EXPECT_EQ(buffer.get(), first);
+    EXPECT_EQ(pool->stats().allocations, 1u);
+    EXPECT_EQ(pool->stats().reuses, 1u);
+    EXPECT_EQ(pool->stats().free_buffers, 0u);
+}
+
+TEST(FrameBufferPoolTest, SkipsBuffersTooLargeOrSmall) {
+    auto pool = std::make_shared<FrameBufferPool>();
+    pool->acquire(1000);
+    // too small
+    pool->acquire(2000);
+    // more than twice the size
+    pool->acquire(400);
+    EXPECT_EQ(pool->stats().allocations, 3u);
+    EXPECT_EQ(pool->stats().reuses, 0u);
+
+    // the 1000 byte buffer fits
+    pool->acquire(600);
+    EXPECT_EQ(pool->stats().reuses, 1u);
+}
+
+TEST(FrameBufferPoolTest, KeepsAtMostMaxFree) {
+    auto pool = std::make_shared<FrameBufferPool>(2);
+    {
+        std::vector<std::shared_ptr<uint8_t>> buffers;
+        for (int i = 0; i < 4; ++i) {
+            buffers.push_back(pool->acquire(100));
+        }
+        EXPECT_EQ(pool->stats().bytes_allocated, 400u);
+    }
+    EXPECT_EQ(pool->stats().free_buffers, 2u);
+    EXPECT_EQ(pool->stats().bytes_allocated, 200u);
+}
+
+TEST(FrameBufferPoolTest, BuffersOutliveThePool) {
+    auto pool = std::make_shared<FrameBufferPool>();
+    auto buffer = pool->acquire(100);
+    pool.reset();
+    memset(buffer.get(), 1, 100);
+    EXPECT_EQ(buffer.get()[99], 1);
+}
+
+TEST(FrameBufferPoolTest, ConcurrentAcquireAndRelease) {
+    auto pool = std::make_shared<FrameBufferPool>(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([pool]() {
+            for (int i = 0; i < 1000; ++i) {
+                auto buffer = pool->acquire(4096);
+                ASSERT_NE(buffer, nullptr);
+                buffer.get()[0] = i;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const auto stats = pool->stats();
+    EXPECT_EQ(stats.allocations + stats.reuses, 4000u);
+    EXPECT_LE(stats.allocations, 4u);
+}
+}  // namespace common
+}  // namespace airi
+}  // namespace crdc
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,98 @@
+// Copyright (C) 2021 FengD
+// License: Modified BSD Software License Agreement
+// Author: Feng DING
+// Description: fixed size thread pool
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "common/thread_safe_queue.h"
+
+namespace crdc {
+namespace airi {
+namespace common {
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency()) {
+    num_threads = std::max<size_t>(1, num_threads);
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers_.emplace_back([this]() {
+        std::function<void()> task;
+        while (running_) {
+          if (tasks_.wait_for_dequeue(&task)) {
+            task();
+          }
+        }
+      });
+    }
+  }
+
+  ThreadPool(const ThreadPool &other) = delete;
+  ThreadPool &operator=(const ThreadPool &other) = delete;
+
+  ~ThreadPool() { stop(); }
+
+  // @brief Join the workers, tasks still queued are not run, parallel_for
+  //        runs on the caller only afterwards
+  void stop() {
+    running_ = false;
+    tasks_.break_all_wait();
+    for (auto &worker : workers_) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+  }
+
+  size_t size() const { return running_ ? workers_.size() : 0; }
+
+  // @brief Run a task on one of the workers
+  // @return future of the task result
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> enqueue(F &&func) {
+    using R = typename std::result_of<F()>::type;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+    auto future = task->get_future();
+    tasks_.enqueue([task]() { (*task)(); });
+    return future;
+  }
+
+  // @brief Call func(i) for i in [0, count), the caller takes part and
+  //        returns when all calls are done
+  // @note Do not call from inside a task of the same pool
+  template <typename F>
+  void parallel_for(const size_t count, const F &func) {
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+      for (size_t i = next++; i < count; i = next++) {
+        func(i);
+      }
+    };
+
+    std::vector<std::future<void>> futures;
+    const size_t num_helpers = count > 1 ? std::min(count - 1, size()) : 0;
+    for (size_t i = 0; i < num_helpers; ++i) {
+      futures.emplace_back(enqueue(worker));
+    }
+    worker();
+    for (auto &future : futures) {
+      future.get();
+    }
+  }
+
+ private:
+  std::atomic<bool> running_{true};
+  ThreadSafeQueue<std::function<void()>> tasks_;
+  std::vector<std::thread> workers_;
+};
+}  // namespace common
+}  // namespace airi
+}  // namespace crdc
@@ -1,4 +1,6 @@
 #include "h264_rgb_encoder_decoder/decoder.h"
+#include <stdlib.h>
+#include <string.h>
 
 namespace crdc {
 namespace airi {
@@ -9,85 +11,399 @@ handler_on_frame_ready decoder_set_frame_ready_handler(H264DecoderData* decoder_
   return old_hnd;
 }
 
-void decoder_dispose(H264DecoderData* decoder_data){
-  if(decoder_data->img_convert_ctx){
-    sws_freeContext(decoder_data->img_convert_ctx);
+// 1 if the conversion has to be set up for the frame, first frame, new output size or a
+// new size or pixel format of the stream
+static int decoder_output_changed(H264DecoderData* decoder_data, struct AVFrame* frame){
+  return decoder_data->first_time || frame->width != decoder_data->src_width ||
+    frame->height != decoder_data->src_height || frame->format != decoder_data->src_format;
+}
+
+// set up the conversion for the size and format of the frame, the context is rebuilt
+// only if one of them changed
+static void decoder_prepare_output(H264DecoderData* decoder_data, struct AVFrame* frame){
+  const int width = decoder_data->out_width > 0 ? decoder_data->out_width : frame->width;
+  const int height = decoder_data->out_height > 0 ? decoder_data->out_height : frame->height;
+
+  decoder_data->img_convert_ctx = sws_getCachedContext(decoder_data->img_convert_ctx,
+    frame->width, frame->height, (enum AVPixelFormat)frame->format, width, height,
+    AV_PIX_FMT_RGB24, SWS_BICUBIC, NULL, NULL, NULL);
+
+  decoder_data->width = width;
+  decoder_data->height = height;
+  decoder_data->output_size = decoder_data->width * decoder_data->height * 3;
+  decoder_data->src_width = frame->width;
+  decoder_data->src_height = frame->height;
+  decoder_data->src_format = frame->format;
+
+  decoder_data->first_time = 0;
+}
+
+// out_buffer is only allocated for callers converting into it, and again when the size changed
+static void decoder_prepare_buffer(H264DecoderData* decoder_data){
+  if(decoder_data->out_buffer && decoder_data->out_buffer_size == decoder_data->output_size){
+    return;
+  }
+  if(decoder_data->out_buffer){
+    av_free(decoder_data->out_buffer);
+  }
+  if(!decoder_data->pFrameOutput){
+    decoder_data->pFrameOutput=av_frame_alloc();
+  }
+  decoder_data->out_buffer_size = av_image_get_buffer_size(AV_PIX_FMT_RGB24,
+    decoder_data->width, decoder_data->height, 1);
+  decoder_data->out_buffer=(uint8_t *)av_malloc(decoder_data->out_buffer_size);
+  av_image_fill_arrays(decoder_data->pFrameOutput->data, decoder_data->pFrameOutput->linesize,
+    decoder_data->out_buffer, AV_PIX_FMT_RGB24, decoder_data->width, decoder_data->height, 1);
+}
+
+void decoder_set_output_size(H264DecoderData* decoder_data, int width, int height){
+  if(width == decoder_data->out_width && height == decoder_data->out_height){
+    return;
+  }
+  decoder_data->out_width = width > 0 ? width : 0;
+  decoder_data->out_height = height > 0 ? height : 0;
+  // applied with the next converted frame
+  decoder_data->first_time = 1;
+}
+
+// the frame scaled and converted into dst, out_buffer or a buffer of the caller
+static void decoder_scale(H264DecoderData* decoder_data, struct AVFrame* frame,
+                          uint8_t* const dst[], const int dst_linesize[]){
+  sws_scale(decoder_data->img_convert_ctx, (const uint8_t* const*)frame->data,
+    frame->linesize, 0, frame->height, dst, dst_linesize);
+  ++decoder_data->converted_frames;
+}
+
+static void decoder_convert(H264DecoderData* decoder_data, struct AVFrame* frame){
+  if(decoder_output_changed(decoder_data, frame)){
+    decoder_prepare_output(decoder_data, frame);
+  }
+  decoder_prepare_buffer(decoder_data);
+  decoder_scale(decoder_data, frame, decoder_data->pFrameOutput->data,
+    decoder_data->pFrameOutput->linesize);
+
+  if(decoder_data->frame_handler){
+    decoder_data->frame_handler(decoder_data, decoder_data->pFrameOutput->data[0], decoder_data->output_size);
+  }
+}
+
+// every decoded frame passes here, converted right away or kept for decoder_convert_frame
+static void decoder_on_frame(H264DecoderData* decoder_data){
+  ++decoder_data->decoded_frames;
+  if(decoder_data->auto_convert){
+    decoder_convert(decoder_data, decoder_data->pFrame);
+    return;
   }
+  // only a reference, pFrame is reused by the next receive call
+  av_frame_unref(decoder_data->pFrameLatest);
+  av_frame_ref(decoder_data->pFrameLatest, decoder_data->pFrame);
+  decoder_data->frame_pending = 1;
+}
+
+void decoder_set_low_latency(H264DecoderData* decoder_data, int nonref_backlog, int nonkey_backlog){
+  decoder_data->skip_nonref_backlog = nonref_backlog > 0 ? nonref_backlog : 0;
+  decoder_data->skip_nonkey_backlog = nonkey_backlog > 0 ? nonkey_backlog : 0;
+}
+
+void decoder_set_backlog(H264DecoderData* decoder_data, int backlog){
+  decoder_data->backlog = backlog > 0 ? backlog : 0;
+}
+
+// frames to discard for the next packet, the level reached is kept until caught up
+static void decoder_update_skip(H264DecoderData* decoder_data, int key_frame){
+  const enum AVDiscard current = decoder_data->pCodecCtx->skip_frame;
+  enum AVDiscard skip = AVDISCARD_DEFAULT;
+  if(decoder_data->skip_nonkey_backlog > 0 && decoder_data->backlog >= decoder_data->skip_nonkey_backlog){
+    skip = AVDISCARD_NONKEY;
+  } else if(decoder_data->skip_nonref_backlog > 0 && decoder_data->backlog >= decoder_data->skip_nonref_backlog){
+    skip = AVDISCARD_NONREF;
+  }
+  if(decoder_data->backlog > 0 && current > skip){
+    skip = current;
+  }
+  // the frames after skipped reference frames refer to them, full decoding resumes
+  // with the next key frame
+  if(current == AVDISCARD_NONKEY && !key_frame){
+    skip = AVDISCARD_NONKEY;
+  }
+  decoder_data->pCodecCtx->skip_frame = skip;
+}
+
+// hands every frame the codec has ready to decoder_on_frame, returns their number
+static int decoder_receive(H264DecoderData* decoder_data){
+  int frame_formed = 0;
+  while(1){
+    int ret = avcodec_receive_frame(decoder_data->pCodecCtx, decoder_data->pFrame);
+    if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF){
+      break;
+    }
+    if(ret < 0){
+      fprintf(stderr,"Decode Error.\n");
+      return ret;
+    }
+    ++frame_formed;
+    decoder_on_frame(decoder_data);
+    av_frame_unref(decoder_data->pFrame);
+  }
+  return frame_formed;
+}
+
+int decoder_convert_frame(H264DecoderData* decoder_data){
+  if(!decoder_data->frame_pending){
+    return -1;
+  }
+  decoder_convert(decoder_data, decoder_data->pFrameLatest);
+  av_frame_unref(decoder_data->pFrameLatest);
+  decoder_data->frame_pending = 0;
+  return 0;
+}
+
+int decoder_output_size(H264DecoderData* decoder_data, int* width, int* height){
+  if(!decoder_data->frame_pending){
+    return -1;
+  }
+  *width = decoder_data->out_width > 0 ? decoder_data->out_width : decoder_data->pFrameLatest->width;
+  *height = decoder_data->out_height > 0 ? decoder_data->out_height : decoder_data->pFrameLatest->height;
+  return 0;
+}
+
+int decoder_convert_frame_into(H264DecoderData* decoder_data, uint8_t* buffer, int linesize,
+                               int buffer_size){
+  int width, height;
+  if(decoder_output_size(decoder_data, &width, &height) < 0){
+    return -1;
+  }
+  if(linesize < width * 3 || (int64_t)linesize * height > buffer_size){
+    fprintf(stderr,"Output buffer too small.\n");
+    return -1;
+  }
+  if(decoder_output_changed(decoder_data, decoder_data->pFrameLatest)){
+    decoder_prepare_output(decoder_data, decoder_data->pFrameLatest);
+  }
+  uint8_t* dst[4] = {buffer, NULL, NULL, NULL};
+  int dst_linesize[4] = {linesize, 0, 0, 0};
+  decoder_scale(decoder_data, decoder_data->pFrameLatest, dst, dst_linesize);
+  av_frame_unref(decoder_data->pFrameLatest);
+  decoder_data->frame_pending = 0;
+  return 0;
+}
+
+struct AVFrame* decoder_receive_frame(H264DecoderData* decoder_data){
+  if(!decoder_data->frame_pending){
+    return NULL;
+  }
+  struct AVFrame* frame = av_frame_alloc();
+  av_frame_move_ref(frame, decoder_data->pFrameLatest);
+  decoder_data->frame_pending = 0;
+  return frame;
+}
+
+// parser and codec context, e.g. after they failed to open
+static void decoder_close(H264DecoderData* decoder_data){
   if(decoder_data->pCodecParserCtx){
     av_parser_close(decoder_data->pCodecParserCtx);
+    decoder_data->pCodecParserCtx = NULL;
+  }
+  if(decoder_data->pCodecCtx){
+    avcodec_free_context(&decoder_data->pCodecCtx);
+  }
+}
+
+void decoder_dispose(H264DecoderData* decoder_data){
+  if(decoder_data->img_convert_ctx){
+    sws_freeContext(decoder_data->img_convert_ctx);
   }
+  decoder_close(decoder_data);
   if(decoder_data->pFrameOutput){
     av_frame_free(&decoder_data->pFrameOutput);
   }
   if(decoder_data->pFrame){
     av_frame_free(&decoder_data->pFrame);
   }
-  if(decoder_data->pCodecCtx){
-    avcodec_close(decoder_data->pCodecCtx);
-    av_free(decoder_data->pCodecCtx);
+  if(decoder_data->pFrameLatest){
+    av_frame_free(&decoder_data->pFrameLatest);
+  }
+  if(decoder_data->out_buffer){
+    av_free(decoder_data->out_buffer);
   }
   free(decoder_data);
 }
 
 int decoder_init(H264DecoderData** p_decoder_data){
-  
-  H264DecoderData* decoder_data = (H264DecoderData*)malloc(sizeof(H264DecoderData));
+  return decoder_init_threaded(p_decoder_data, 1, 0);
+}
 
-  decoder_data->pCodecCtx = NULL;
-  decoder_data->pCodecParserCtx=NULL;
-  decoder_data->codec_id=AV_CODEC_ID_H264;
-  decoder_data->pFrame = NULL;
-  decoder_data->pFrameOutput = NULL;
-  decoder_data->img_convert_ctx = NULL;
-  decoder_data->frame_handler = NULL;
-  decoder_data->first_time = 1;
+int decoder_init_threaded(H264DecoderData** p_decoder_data, int thread_count, int frame_threading){
+  return decoder_init_codec(p_decoder_data, AV_CODEC_ID_H264, thread_count, frame_threading);
+}
 
-  avcodec_register_all();
+enum AVCodecID decoder_detect_codec(const uint8_t* in_buffer, int size){
+  // nal units start after 00 00 01, the first hevc parameter set or h264 sps decides
+  for(int i = 0; i + 4 < size; ++i){
+    if(in_buffer[i] != 0 || in_buffer[i + 1] != 0 || in_buffer[i + 2] != 1){
+      continue;
+    }
+    const uint8_t first = in_buffer[i + 3];
+    const uint8_t second = in_buffer[i + 4];
+    // hevc: 2 byte header, vps 32, sps 33, pps 34 in bits 1-6, layer 0 and temporal id 1
+    const int hevc_type = (first >> 1) & 0x3f;
+    if((first & 0x81) == 0 && second == 0x01 && hevc_type >= 32 && hevc_type <= 34){
+      return AV_CODEC_ID_HEVC;
+    }
+    // h264: 1 byte header, sps 7 with a non-zero nal_ref_idc, its odd header byte has the
+    // layer id bit set as an hevc header, pps 8 and IDR 5 are not used as hevc IDR_N_LP
+    // slices (0x28) and end of sequence units (0x48) read like h264 pps
+    const int h264_type = first & 0x1f;
+    if((first & 0x80) == 0 && (first & 0x60) != 0 && h264_type == 7){
+      return AV_CODEC_ID_H264;
+    }
+    i += 2;
+  }
+  return AV_CODEC_ID_NONE;
+}
 
+// whether skip_frame drops the picture of a packet, from the header of its first slice,
+// the frames missing from the receive calls may just be held back by frame threads
+static int decoder_packet_discarded(const H264DecoderData* decoder_data,
+                                    const uint8_t* in_buffer, int size, int key_frame){
+  const enum AVDiscard skip = decoder_data->pCodecCtx->skip_frame;
+  if(skip >= AVDISCARD_NONKEY){
+    return !key_frame;
+  }
+  if(skip < AVDISCARD_NONREF){
+    return 0;
+  }
+  for(int i = 0; i + 3 < size; ++i){
+    if(in_buffer[i] != 0 || in_buffer[i + 1] != 0 || in_buffer[i + 2] != 1){
+      continue;
+    }
+    const uint8_t header = in_buffer[i + 3];
+    if(decoder_data->codec_id == AV_CODEC_ID_HEVC){
+      // slices 0-31, the even types below 16 are sub-layer non-reference pictures
+      const int type = (header >> 1) & 0x3f;
+      if(type < 32){
+        return type < 16 && type % 2 == 0;
+      }
+    } else {
+      // slices 1-5, not referenced with a zero nal_ref_idc
+      const int type = header & 0x1f;
+      if(type >= 1 && type <= 5){
+        return (header & 0x60) == 0;
+      }
+    }
+    i += 2;
+  }
+  return 0;
+}
+
+// codec, parser and context of codec_id, once it is known
+static int decoder_open(H264DecoderData* decoder_data){
   decoder_data->pCodec = avcodec_find_decoder(decoder_data->codec_id);
   if (!decoder_data->pCodec) {
     fprintf(stderr,"Codec not found\n");
-    decoder_dispose(decoder_data);
     return -1;
   }
   decoder_data->pCodecCtx = avcodec_alloc_context3(decoder_data->pCodec);
   if (!decoder_data->pCodecCtx){
     fprintf(stderr,"Could not allocate video codec context\n");
-    decoder_dispose(decoder_data);
     return -1;
   }
 
   decoder_data->pCodecParserCtx=av_parser_init(decoder_data->codec_id);
   if (!decoder_data->pCodecParserCtx){
     fprintf(stderr,"Could not allocate video parser context\n");
-    decoder_dispose(decoder_data);
     return -1;
   }
 
-  if(decoder_data->pCodec->capabilities & AV_CODEC_CAP_TRUNCATED)
-    decoder_data->pCodecCtx->flags|= AV_CODEC_FLAG_TRUNCATED; /* we do not send complete frames */
+  // whole frames come from the parser, frames out of receive are always reference counted,
+  // so keeping one is not a copy
+  decoder_data->pCodecCtx->thread_count = decoder_data->thread_count;
+  decoder_data->pCodecCtx->thread_type = FF_THREAD_SLICE;
+  if(decoder_data->frame_threading){
+    decoder_data->pCodecCtx->thread_type |= FF_THREAD_FRAME;
+  }
 
   if (avcodec_open2(decoder_data->pCodecCtx, decoder_data->pCodec, NULL) < 0) {
     fprintf(stderr,"Could not open codec\n");
+    return -1;
+  }
+  return 0;
+}
+
+int decoder_init_codec(H264DecoderData** p_decoder_data, enum AVCodecID codec_id,
+                       int thread_count, int frame_threading){
+  H264DecoderData* decoder_data = (H264DecoderData*)malloc(sizeof(H264DecoderData));
+
+  decoder_data->pCodec = NULL;
+  decoder_data->pCodecCtx = NULL;
+  decoder_data->pCodecParserCtx=NULL;
+  decoder_data->codec_id=codec_id;
+  decoder_data->pFrame = NULL;
+  decoder_data->pFrameOutput = NULL;
+  decoder_data->img_convert_ctx = NULL;
+  decoder_data->frame_handler = NULL;
+  decoder_data->first_time = 1;
+  decoder_data->out_buffer = NULL;
+  decoder_data->width = 0;
+  decoder_data->height = 0;
+  decoder_data->output_size = 0;
+  decoder_data->auto_convert = 1;
+  decoder_data->pFrameLatest = NULL;
+  decoder_data->frame_pending = 0;
+  decoder_data->decoded_frames = 0;
+  decoder_data->converted_frames = 0;
+  decoder_data->out_width = 0;
+  decoder_data->out_height = 0;
+  decoder_data->src_width = 0;
+  decoder_data->src_height = 0;
+  decoder_data->src_format = AV_PIX_FMT_NONE;
+  decoder_data->out_buffer_size = 0;
+  decoder_data->skip_nonref_backlog = 0;
+  decoder_data->skip_nonkey_backlog = 0;
+  decoder_data->backlog = 0;
+  decoder_data->skipped_frames = 0;
+  decoder_data->thread_count = thread_count;
+  decoder_data->frame_threading = frame_threading;
+  memset(&decoder_data->packet, 0, sizeof(decoder_data->packet));
+
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+  avcodec_register_all();
+#endif
+
+  if (codec_id != AV_CODEC_ID_NONE && decoder_open(decoder_data) < 0) {
     decoder_dispose(decoder_data);
     return -1;
   }
 
   decoder_data->pFrame = av_frame_alloc();
-  av_init_packet(&decoder_data->packet);
+  decoder_data->pFrameLatest = av_frame_alloc();
 
   *p_decoder_data = decoder_data;
 
   return 0;
 }
 
-// return: number of packets generated during current call to parse
+// return: number of frames generated during current call to parse
 int decoder_parse(H264DecoderData* decoder_data, uint8_t* in_buffer, int cur_size){
   uint8_t* cur_ptr = in_buffer;
   int frame_formed = 0;
-  int ret, got_picture;
+  int ret;
   int first_pass = 1;
 
+  if(!decoder_data->pCodecCtx){
+    // nothing to decode before the parameter sets
+    decoder_data->codec_id = in_buffer ? decoder_detect_codec(in_buffer, cur_size) : AV_CODEC_ID_NONE;
+    if(decoder_data->codec_id == AV_CODEC_ID_NONE){
+      return 0;
+    }
+    if(decoder_open(decoder_data) < 0){
+      // detected again with the next packet
+      decoder_close(decoder_data);
+      decoder_data->codec_id = AV_CODEC_ID_NONE;
+      return -1;
+    }
+  }
+
   while(cur_size > 0 || first_pass){
     int len = av_parser_parse2(
       decoder_data->pCodecParserCtx, decoder_data->pCodecCtx,
@@ -101,72 +417,47 @@ int decoder_parse(H264DecoderData* decoder_data, uint8_t* in_buffer, int cur_siz
 
     if(decoder_data->packet.size >0){
       // a packet is ready!
-      ret = avcodec_decode_video2(decoder_data->pCodecCtx, decoder_data->pFrame, &got_picture, &decoder_data->packet);
+      decoder_update_skip(decoder_data, decoder_data->pCodecParserCtx->key_frame == 1);
+      const int discarded = decoder_packet_discarded(decoder_data, decoder_data->packet.data,
+        decoder_data->packet.size, decoder_data->pCodecParserCtx->key_frame == 1);
+      ret = avcodec_send_packet(decoder_data->pCodecCtx, &decoder_data->packet);
+      if (ret == AVERROR(EAGAIN)) {
+        // with frame threading the codec may want its output taken first
+        ret = decoder_receive(decoder_data);
+        if (ret < 0) {
+          return ret;
+        }
+        frame_formed += ret;
+        ret = avcodec_send_packet(decoder_data->pCodecCtx, &decoder_data->packet);
+      }
       if (ret < 0) {
         fprintf(stderr,"Decode Error.\n");
         return ret;
       }
-      if (got_picture) {
-        ++frame_formed;
-        if(decoder_data->first_time){
-          //SwsContext
-          decoder_data->img_convert_ctx = sws_getContext(decoder_data->pCodecCtx->width,
-            decoder_data->pCodecCtx->height, decoder_data->pCodecCtx->pix_fmt,decoder_data->pCodecCtx->width,
-            decoder_data->pCodecCtx->height, AV_PIX_FMT_RGB24, SWS_BICUBIC, NULL, NULL, NULL); 
-
-          decoder_data->pFrameOutput=av_frame_alloc();
-          decoder_data->out_buffer=(uint8_t *)av_malloc(avpicture_get_size(AV_PIX_FMT_RGB24,
-              decoder_data->pCodecCtx->width, decoder_data->pCodecCtx->height));
-          avpicture_fill((AVPicture *)decoder_data->pFrameOutput, decoder_data->out_buffer,
-            AV_PIX_FMT_RGB24, decoder_data->pCodecCtx->width, decoder_data->pCodecCtx->height);
-
-          decoder_data->width = decoder_data->pCodecCtx->width;
-          decoder_data->height = decoder_data->pCodecCtx->height;
-          decoder_data->output_size = decoder_data->width * decoder_data->height * 3;
-
-          decoder_data->first_time = 0;
-        }
-
-        sws_scale(decoder_data->img_convert_ctx, (const uint8_t* const*)decoder_data->pFrame->data,
-          decoder_data->pFrame->linesize, 0, decoder_data->pCodecCtx->height, 
-          decoder_data->pFrameOutput->data, decoder_data->pFrameOutput->linesize);
-
-        if(decoder_data->frame_handler){
-          decoder_data->frame_handler(decoder_data, decoder_data->pFrameOutput->data[0], decoder_data->output_size);
-        }
+      if (discarded) {
+        ++decoder_data->skipped_frames;
       }
+      ret = decoder_receive(decoder_data);
+      if (ret < 0) {
+        return ret;
+      }
+      frame_formed += ret;
     }
   }
   return frame_formed;
 }
 
 int decoder_flush(H264DecoderData* decoder_data){
-  int ret, got_picture;
-  int frame_formed = 0;
-  //Flush Decoder
-  decoder_data->packet.size = 0;
-  decoder_data->packet.data = NULL;
-  while(1){
-    ret = avcodec_decode_video2(decoder_data->pCodecCtx, decoder_data->pFrame, &got_picture, &decoder_data->packet);
-    if (ret < 0) {
-      fprintf(stderr,"Decode Error.\n");
-      return ret;
-    }
-    if (!got_picture){
-      break;
-    }
-    if (got_picture) {
-      ++frame_formed;
-      sws_scale(decoder_data->img_convert_ctx, (const uint8_t* const*)decoder_data->pFrame->data,
-        decoder_data->pFrame->linesize, 0, decoder_data->pCodecCtx->height, 
-        decoder_data->pFrameOutput->data, decoder_data->pFrameOutput->linesize);
-
-      if(decoder_data->frame_handler){
-        decoder_data->frame_handler(decoder_data, decoder_data->pFrameOutput->data[0], decoder_data->output_size);
-      }
-    }
+  if(!decoder_data->pCodecCtx){
+    return 0;
   }
-  return frame_formed;
+  //Flush Decoder, frames held back by frame threads come out here
+  int ret = avcodec_send_packet(decoder_data->pCodecCtx, NULL);
+  if (ret < 0 && ret != AVERROR_EOF) {
+    fprintf(stderr,"Decode Error.\n");
+    return ret;
+  }
+  return decoder_receive(decoder_data);
 }
 
 int decoder_input_buffer_padding_size(){
@@ -1,13 +1,14 @@
 // Copyright (C) 2023 FengD
 // License: Modified BSD Software License Agreement
 // Author: 3rdparty
-// Description: h264 decoder
+// Description: h264 and hevc decoder
 
 #pragma once
 
 #include <stdio.h>
 extern "C" {
 #include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 }
 
@@ -23,23 +24,54 @@ typedef void (*handler_on_frame_ready)(struct _H264DecoderData* decoder_data, ui
 
 /**
  * @class H264DecoderData
- * @brief This struct is the data structure of decoder data of h264
+ * @brief This struct is the data structure of decoder data of h264, and of hevc
+ *        despite the name
  */
 struct _H264DecoderData {
-  struct AVCodec *pCodec;
+  const struct AVCodec *pCodec;
   struct AVCodecContext *pCodecCtx;
   struct AVCodecParserContext *pCodecParserCtx;
   struct AVFrame *pFrame,*pFrameOutput;
   uint8_t *out_buffer;
   struct AVPacket packet;
+  // AV_CODEC_ID_NONE until detected from the stream for decoders created without a codec
   enum AVCodecID codec_id;
   struct SwsContext *img_convert_ctx;
   int first_time;
+  // size of the rgb output, the stream's unless decoder_set_output_size asked for another
   int width;
   int height;
   int output_size;
   void* user_data;
   handler_on_frame_ready frame_handler;
+  // 1 converts every decoded frame to rgb in decoder_parse, 0 leaves it to decoder_convert_frame
+  int auto_convert;
+  // reference to the newest decoded frame that was not converted yet
+  struct AVFrame *pFrameLatest;
+  int frame_pending;
+  // counters of frames coming out of the codec and of frames converted to rgb
+  uint64_t decoded_frames;
+  uint64_t converted_frames;
+  // requested rgb output size, 0 is the size of the stream
+  int out_width;
+  int out_height;
+  // stream size and pixel format the conversion was set up for
+  int src_width;
+  int src_height;
+  int src_format;
+  // allocated size of out_buffer
+  int out_buffer_size;
+  // low latency mode, from a backlog of this many packets on non-reference frames resp.
+  // all but key frames are skipped until the decoder caught up, 0 is off
+  int skip_nonref_backlog;
+  int skip_nonkey_backlog;
+  // packets the caller has queued behind the ones being parsed
+  int backlog;
+  // frames dropped by the low latency mode, counted from the packets sent while skipping
+  uint64_t skipped_frames;
+  // applied when the codec is opened, which waits for the stream with auto detection
+  int thread_count;
+  int frame_threading;
 };
 
 typedef struct _H264DecoderData H264DecoderData;
@@ -51,6 +83,38 @@ typedef struct _H264DecoderData H264DecoderData;
  */
 int decoder_init(H264DecoderData** p_decoder_data);
 
+/**
+ * @brief init a decoder decoding on threads of its own
+ * @param [out] the decoder data
+ * @param [in] number of threads, 0 picks one per core, 1 decodes on the calling thread
+ * @param [in] 1 also decodes several frames at once, more throughput for recordings but
+ *        every thread holds a frame back, 0 only splits a frame into its slices
+ * @return is the action success = 0 means success
+ */
+int decoder_init_threaded(H264DecoderData** p_decoder_data, int thread_count, int frame_threading);
+
+/**
+ * @brief init a decoder of the given codec
+ * @param [out] the decoder data
+ * @param [in] AV_CODEC_ID_H264, AV_CODEC_ID_HEVC or AV_CODEC_ID_NONE to detect the codec
+ *        from the first packet with parameter sets, packets before are dropped
+ * @param [in] number of threads, see decoder_init_threaded
+ * @param [in] 1 for frame threading, see decoder_init_threaded
+ * @return is the action success = 0 means success
+ */
+int decoder_init_codec(H264DecoderData** p_decoder_data, enum AVCodecID codec_id,
+                       int thread_count, int frame_threading);
+
+/**
+ * @brief detect the codec of an annex b stream from the nal headers of its parameter sets,
+ *        h264 only from its sps, the headers of its pps and IDR slices also occur in hevc
+ * @param [in] the stream data
+ * @param [in] the data size
+ * @return AV_CODEC_ID_H264, AV_CODEC_ID_HEVC or AV_CODEC_ID_NONE if the data has neither
+ *         an h264 sps nor an hevc vps, sps or pps
+ */
+enum AVCodecID decoder_detect_codec(const uint8_t* in_buffer, int size);
+
 /**
  * @brief dispose the decoder data, used in deinit action
  * @param [in] the input h264 decode data
@@ -74,9 +138,76 @@ handler_on_frame_ready decoder_set_frame_ready_handler(H264DecoderData* decoder_
 int decoder_parse(H264DecoderData* decoder_data,uint8_t* in_buffer, int cur_size);
 
 /**
- * @brief flush the h264 decode data used in deinit step
+ * @brief convert the newest decoded frame to rgb into out_buffer, for decoders
+ *        with auto_convert = 0 which keep decoding every frame but only convert
+ *        the ones that are displayed or exported
  * @param [in] input h264 decode data
- * @return is the action success = 0 means success
+ * @return is the action success = 0 means success, -1 if no frame waits for conversion
+ */
+int decoder_convert_frame(H264DecoderData* decoder_data);
+
+/**
+ * @brief convert the newest decoded frame to packed rgb into a buffer of the caller,
+ *        e.g. one of a pool the image is handed on in, instead of into out_buffer
+ * @param [in] input h264 decode data
+ * @param [out] the rgb buffer, rows of linesize bytes
+ * @param [in] the bytes per row, at least 3 * the output width
+ * @param [in] the size of the buffer, at least linesize * the output height
+ * @return is the action success = 0 means success, -1 if no frame waits for conversion
+ *         or the buffer is too small, width and height are the size converted to
+ */
+int decoder_convert_frame_into(H264DecoderData* decoder_data, uint8_t* buffer, int linesize,
+                               int buffer_size);
+
+/**
+ * @brief size of the rgb output of the pending frame, i.e. the size requested with
+ *        decoder_set_output_size or else of the frame
+ * @param [in] input h264 decode data
+ * @param [out] output width
+ * @param [out] output height
+ * @return is the action success = 0 means success, -1 if no frame waits for conversion
+ */
+int decoder_output_size(H264DecoderData* decoder_data, int* width, int* height);
+
+/**
+ * @brief bound the latency of a decoder falling behind, e.g. on replays faster than
+ *        real time or with the CPU busy, by skipping frames while the backlog reported
+ *        with decoder_set_backlog is too long
+ * @param [in] input h264 decode data
+ * @param [in] backlog from which non-reference frames are skipped, 0 never
+ * @param [in] backlog from which all but key frames are skipped, 0 never
+ */
+void decoder_set_low_latency(H264DecoderData* decoder_data, int nonref_backlog, int nonkey_backlog);
+
+/**
+ * @brief report the packets still queued for the decoder, before decoder_parse
+ * @param [in] input h264 decode data
+ * @param [in] number of queued packets, 0 once caught up
+ */
+void decoder_set_backlog(H264DecoderData* decoder_data, int backlog);
+
+/**
+ * @brief scale the rgb output in the same swscale pass that converts it, e.g. to the
+ *        size the image is displayed at, instead of converting at full size first
+ * @param [in] input h264 decode data
+ * @param [in] output width, 0 for the width of the stream
+ * @param [in] output height, 0 for the height of the stream
+ */
+void decoder_set_output_size(H264DecoderData* decoder_data, int width, int height);
+
+/**
+ * @brief take the newest decoded frame in its native layout, e.g. planar yuv, for
+ *        callers converting it themselves, e.g. in a shader
+ * @param [in] input h264 decode data
+ * @return a reference to the frame to free with av_frame_free, NULL if no frame waits
+ */
+struct AVFrame* decoder_receive_frame(H264DecoderData* decoder_data);
+
+/**
+ * @brief flush the h264 decode data used in deinit step, the decoder takes no more
+ *        packets afterwards
+ * @param [in] input h264 decode data
+ * @return number of frames that came out, < 0 on error
  */
 int decoder_flush(H264DecoderData* decoder_data);
 
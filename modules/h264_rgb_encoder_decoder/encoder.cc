@@ -16,7 +16,56 @@ void encoder_dispose(H264EncoderData* encoder_data){
   free(encoder_data);
 }
 
+void encoder_config_default(H264EncoderConfig* config, int width, int height){
+  config->width = width;
+  config->height = height;
+  config->input_format = H264_INPUT_RGB;
+  config->preset = NULL;
+  config->tune = "zerolatency";
+  config->bitrate_kbps = 0;
+  config->crf = -1.f;
+  config->qp = -1;
+  config->threads = X264_THREADS_AUTO;
+  config->keyint = 0;
+  config->fps_num = 25;
+  config->fps_den = 1;
+  config->external_planes = 0;
+}
+
+static int encoder_csp(H264InputFormat format){
+  switch(format){
+    case H264_INPUT_BGR:
+      return X264_CSP_BGR;
+    case H264_INPUT_I420:
+      return X264_CSP_I420;
+    case H264_INPUT_NV12:
+      return X264_CSP_NV12;
+    default:
+      return X264_CSP_RGB;
+  }
+}
+
+static int encoder_plane_count(H264InputFormat format){
+  switch(format){
+    case H264_INPUT_I420:
+      return 3;
+    case H264_INPUT_NV12:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
 int encoder_init(H264EncoderData** p_encoder_data, int width, int height, bool lossless){
+  H264EncoderConfig config;
+  encoder_config_default(&config, width, height);
+  if(lossless){
+    config.qp = 0;
+  }
+  return encoder_init2(p_encoder_data, &config);
+}
+
+int encoder_init2(H264EncoderData** p_encoder_data, const H264EncoderConfig* config){
   
   // malloc new context
   H264EncoderData* encoder_data;
@@ -25,29 +74,66 @@ int encoder_init(H264EncoderData** p_encoder_data, int width, int height, bool l
 
   x264_param_t param;
 
-  encoder_data->raw_frame_size = width * height * 3;
+  const int yuv = config->input_format == H264_INPUT_I420 || config->input_format == H264_INPUT_NV12;
+  encoder_data->raw_frame_size = yuv ? config->width * config->height * 3 / 2
+                                     : config->width * config->height * 3;
   encoder_data->i_frame = 0;
   encoder_data->h264_encoder = NULL;
-  encoder_data->pic_valid = true;
+  encoder_data->pic_valid = false;
+  encoder_data->nal = NULL;
+  encoder_data->i_nal = 0;
+  encoder_data->width = config->width;
+  encoder_data->height = config->height;
+  encoder_data->input_format = config->input_format;
 
   /* Get default params for preset/tuning */
-  x264_param_default_preset( &param, NULL, "zerolatency" );
+  if( x264_param_default_preset( &param, config->preset, config->tune ) < 0 ){
+    printf("Unknown preset %s or tune %s\n", config->preset ? config->preset : "default",
+      config->tune ? config->tune : "default");
+    encoder_dispose(encoder_data);
+    return -1;
+  }
   /* Configure non-default params */
-  param.i_csp = X264_CSP_RGB;
-  param.i_width  = width;
-  param.i_height = height;
+  param.i_csp = encoder_csp(config->input_format);
+  param.i_width  = config->width;
+  param.i_height = config->height;
+  param.i_threads = config->threads;
+  param.i_fps_num = config->fps_num;
+  param.i_fps_den = config->fps_den;
   param.b_vfr_input = 0;
   param.b_repeat_headers = 1;
   param.b_annexb = 1;
-  if(lossless){
+  if(config->keyint > 0){
+    param.i_keyint_max = config->keyint;
+  }
+  if(config->bitrate_kbps > 0){
+    // the vbv keeps the rate within a second's worth of data
+    param.rc.i_rc_method = X264_RC_ABR;
+    param.rc.i_bitrate = config->bitrate_kbps;
+    param.rc.i_vbv_max_bitrate = config->bitrate_kbps;
+    param.rc.i_vbv_buffer_size = config->bitrate_kbps;
+  }
+  else if(config->crf >= 0.f){
+    param.rc.i_rc_method = X264_RC_CRF;
+    param.rc.f_rf_constant = config->crf;
+  }
+  else if(config->qp >= 0){
     param.rc.i_rc_method = X264_RC_CQP;
-    param.rc.i_qp_constant = 0;
+    param.rc.i_qp_constant = config->qp;
   }
-  // alloc picture
-  if( x264_picture_alloc( &encoder_data->pic, param.i_csp, param.i_width, param.i_height ) < 0 ){
-    printf("Fail to allocate picture buffer\n");
-    encoder_dispose(encoder_data);
-    return -1;
+  // alloc picture, external planes need none
+  if(!config->external_planes){
+    if( x264_picture_alloc( &encoder_data->pic, param.i_csp, param.i_width, param.i_height ) < 0 ){
+      printf("Fail to allocate picture buffer\n");
+      encoder_dispose(encoder_data);
+      return -1;
+    }
+    encoder_data->pic_valid = true;
+  }
+  else{
+    x264_picture_init( &encoder_data->pic );
+    encoder_data->pic.img.i_csp = param.i_csp;
+    encoder_data->pic.img.i_plane = encoder_plane_count(config->input_format);
   }
   // open encoder
   encoder_data->h264_encoder = x264_encoder_open( &param );
@@ -63,12 +149,16 @@ int encoder_init(H264EncoderData** p_encoder_data, int width, int height, bool l
 
 
 uint8_t* encoder_get_raw_data_buf(H264EncoderData* encoder_data){
-  return encoder_data->pic.img.plane[0];
+  return encoder_data->pic_valid ? encoder_data->pic.img.plane[0] : NULL;
 }
 
 int encoder_encode(H264EncoderData* encoder_data, uint8_t** p_encoded_buf, int* p_encoded_size){
   int i_frame_size;
-  encoder_data->pic.i_pts = encoder_data->i_frame;
+  if(!encoder_data->pic_valid){
+    printf("No raw data buffer, use encoder_encode_planes\n");
+    return -1;
+  }
+  encoder_data->pic.i_pts = encoder_data->i_frame++;
   i_frame_size = x264_encoder_encode( encoder_data->h264_encoder, &encoder_data->nal, &encoder_data->i_nal, &encoder_data->pic, &encoder_data->pic_out );
   if(i_frame_size < 0){
     printf("Encoding error\n");
@@ -85,5 +175,40 @@ int encoder_encode(H264EncoderData* encoder_data, uint8_t** p_encoded_buf, int*
   return 0;
 }
 
+int encoder_encode_planes(H264EncoderData* encoder_data, uint8_t* const* planes,
+                          const int* strides, H264EncodedFrame* frame){
+  x264_picture_t* pic_in = NULL;
+  x264_picture_t pic;
+  if(planes){
+    // only pointers, x264 reads the planes during the call
+    x264_picture_init( &pic );
+    pic.img.i_csp = encoder_csp(encoder_data->input_format);
+    pic.img.i_plane = encoder_plane_count(encoder_data->input_format);
+    for(int i = 0; i < pic.img.i_plane; ++i){
+      pic.img.plane[i] = planes[i];
+      pic.img.i_stride[i] = strides[i];
+    }
+    pic.i_pts = encoder_data->i_frame++;
+    pic_in = &pic;
+  }
+
+  const int i_frame_size = x264_encoder_encode( encoder_data->h264_encoder, &encoder_data->nal, &encoder_data->i_nal, pic_in, &encoder_data->pic_out );
+  if(i_frame_size < 0){
+    printf("Encoding error\n");
+    return -1;
+  }
+  frame->nals = i_frame_size ? encoder_data->nal : NULL;
+  frame->nal_count = i_frame_size ? encoder_data->i_nal : 0;
+  frame->data = i_frame_size ? encoder_data->nal->p_payload : NULL;
+  frame->size = i_frame_size;
+  frame->pts = encoder_data->pic_out.i_pts;
+  frame->keyframe = i_frame_size ? encoder_data->pic_out.b_keyframe : 0;
+  return 0;
+}
+
+int encoder_delayed_frames(H264EncoderData* encoder_data){
+  return x264_encoder_delayed_frames( encoder_data->h264_encoder );
+}
+
 }  // namespace airi
 }  // namespace crdc
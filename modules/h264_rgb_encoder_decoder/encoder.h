@@ -14,6 +14,61 @@
 namespace crdc {
 namespace airi {
 
+/**
+ * @brief layout of the input pictures
+ */
+typedef enum {
+  // packed, 3 bytes per pixel, encoded as 4:4:4
+  H264_INPUT_RGB = 0,
+  H264_INPUT_BGR,
+  // planar y, u and v, chroma of half width and height
+  H264_INPUT_I420,
+  // planar y and interleaved uv, e.g. from cameras and hardware decoders
+  H264_INPUT_NV12
+} H264InputFormat;
+
+/**
+ * @class H264EncoderConfig
+ * @brief The settings of an encoder, start from encoder_config_default
+ */
+typedef struct{
+  int width;
+  int height;
+  H264InputFormat input_format;
+  // x264 preset, e.g. "ultrafast" to "placebo", and tune, e.g. "zerolatency" or "film",
+  // NULL keeps the x264 default
+  const char* preset;
+  const char* tune;
+  // rate control, the first one set wins: average bitrate in kbit/s if > 0, constant rate
+  // factor if >= 0, constant quantizer if >= 0 where 0 is lossless, else the preset's
+  int bitrate_kbps;
+  float crf;
+  int qp;
+  // encoder threads, 0 picks them from the number of cores
+  int threads;
+  // maximum distance of key frames, 0 keeps the default
+  int keyint;
+  int fps_num;
+  int fps_den;
+  // 1 passes the caller's planes to the encoder with encoder_encode_planes instead of
+  // copying them into encoder_get_raw_data_buf
+  int external_planes;
+} H264EncoderConfig;
+
+/**
+ * @class H264EncodedFrame
+ * @brief All nal units of one encoded picture, valid until the next encode call
+ */
+typedef struct{
+  x264_nal_t* nals;
+  int nal_count;
+  // the payloads of all nals back to back
+  uint8_t* data;
+  int size;
+  int64_t pts;
+  int keyframe;
+} H264EncodedFrame;
+
 /**
  * @class H264EncoderData
  * @brief This struct is the data structure of encoder data of h264
@@ -27,6 +82,9 @@ typedef struct{
   x264_nal_t *nal;
   int i_nal;
   x264_t* h264_encoder;
+  int width;
+  int height;
+  H264InputFormat input_format;
 } H264EncoderData;
 
 /**
@@ -45,21 +103,58 @@ void encoder_dispose(H264EncoderData* encoder_data);
  */
 int encoder_init(H264EncoderData** p_encoder_data, int width, int height, bool lossless);
 
+/**
+ * @brief the defaults of encoder_init, rgb input, zerolatency tune and no copy avoidance
+ * @param [out] the config
+ * @param [in] the width of the input
+ * @param [in] the height of the input
+ */
+void encoder_config_default(H264EncoderConfig* config, int width, int height);
+
+/**
+ * @brief create a new context from a config and let p_encoder_data point to that
+ * @param [out] the h264 encode data
+ * @param [in] the config
+ * @return is the action success = 0 means success, -1 e.g. for an unknown preset or tune
+ */
+int encoder_init2(H264EncoderData** p_encoder_data, const H264EncoderConfig* config);
+
 /**
  * @brief like the name
  * @param [out] the output of the encoder raw data
- * @return the raw data in the encoder data
+ * @return the raw data in the encoder data, NULL with external_planes
  */
 uint8_t* encoder_get_raw_data_buf(H264EncoderData* encoder_data);
 
 /**
  * @brief encode the data
- * @param assume the RGB-raw data already in "encoder_get_raw_data_buf()"
+ * @param assume the RGB-raw data already in "encoder_get_raw_data_buf()", encoders with
+ *        external_planes have no such buffer and encode with encoder_encode_planes only
  * @param p_encoded_buf[out]: points to the buffer if frame emitted, NULL for no frame emitted
  * @param p_encoded_size[out]: the size of encoded data, 0 when no frame emitted
- * @return is the action success = 0 means success
+ * @return is the action success = 0 means success, -1 with external_planes
  */
 int encoder_encode(H264EncoderData* encoder_data , uint8_t** p_encoded_buf, int* p_encoded_size);
 
+/**
+ * @brief encode a picture from the caller's planes without copying it into the raw data
+ *        buffer first, x264 reads them during the call only
+ * @param [in] the h264 encode data
+ * @param [in] 1 plane for rgb and bgr, 3 for I420, 2 for NV12, NULL to flush a picture
+ *        the encoder delayed, e.g. for lookahead or B-frames
+ * @param [in] the bytes per row of every plane
+ * @param [out] all nals of the encoded picture, nal_count 0 when none was emitted
+ * @return is the action success = 0 means success
+ */
+int encoder_encode_planes(H264EncoderData* encoder_data, uint8_t* const* planes,
+                          const int* strides, H264EncodedFrame* frame);
+
+/**
+ * @brief the number of pictures the encoder holds back, flush them with NULL planes
+ * @param [in] the h264 encode data
+ * @return the number of delayed pictures
+ */
+int encoder_delayed_frames(H264EncoderData* encoder_data);
+
 }  // namespace airi
 }  // namespace crdc
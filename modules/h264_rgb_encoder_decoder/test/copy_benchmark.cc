@@ -0,0 +1,218 @@
+// bytes copied and allocated per frame on the camera paths, copied the way they were before
+// the pool against the way the image service decodes and the overlay uploads them now:
+// jpeg and raw messages, h264 output and the painted image
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "common/frame_buffer_pool.h"
+#include "h264_rgb_encoder_decoder/decoder.h"
+#include "h264_rgb_encoder_decoder/encoder.h"
+
+namespace {
+
+const int kWidth = 1280;
+const int kHeight = 720;
+const int kFrames = 100;
+
+struct Result {
+  uint64_t frames{0};
+  uint64_t bytes_copied{0};
+  uint64_t allocations{0};
+  double ms{0.0};
+};
+
+cv::Mat pattern(const int i) {
+  cv::Mat image(kHeight, kWidth, CV_8UC3);
+  for (int y = 0; y < kHeight; ++y) {
+    memset(image.ptr(y), (i + y) & 0xff, kWidth * 3);
+  }
+  return image;
+}
+
+std::vector<std::string> encode() {
+  std::vector<std::string> packets;
+  crdc::airi::H264EncoderData* encoder_data;
+  if (crdc::airi::encoder_init(&encoder_data, kWidth, kHeight, false) < 0) {
+    return packets;
+  }
+  uint8_t* raw_data_buf = crdc::airi::encoder_get_raw_data_buf(encoder_data);
+  for (int i = 0; i < kFrames; ++i) {
+    for (int y = 0; y < kHeight; ++y) {
+      memset(raw_data_buf + y * kWidth * 3, (i + y) & 0xff, kWidth * 3);
+    }
+    uint8_t* encoded_buf;
+    int encoded_size;
+    if (crdc::airi::encoder_encode(encoder_data, &encoded_buf, &encoded_size) == 0 &&
+        encoded_size > 0) {
+      packets.emplace_back(reinterpret_cast<char*>(encoded_buf), encoded_size);
+    }
+  }
+  crdc::airi::encoder_dispose(encoder_data);
+  return packets;
+}
+
+// every message through convert, which returns false if it produced no frame
+template <typename Convert>
+Result run(const std::vector<std::string>& messages, const Convert& convert) {
+  Result result;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& message : messages) {
+    if (convert(message, &result)) {
+      ++result.frames;
+    }
+  }
+  result.ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+// output of a decoder with auto_convert = 0, every packet parsed, every frame converted
+template <typename Convert>
+Result runDecoder(const std::vector<std::string>& packets, const Convert& convert) {
+  crdc::airi::H264DecoderData* decoder_data;
+  if (crdc::airi::decoder_init(&decoder_data) < 0) {
+    return Result();
+  }
+  decoder_data->auto_convert = 0;
+  const auto result = run(packets, [&](const std::string& packet, Result* counts) {
+    const int frames = crdc::airi::decoder_parse(
+        decoder_data, reinterpret_cast<uint8_t*>(const_cast<char*>(packet.data())),
+        packet.size());
+    return frames > 0 && convert(decoder_data, counts);
+  });
+  crdc::airi::decoder_dispose(decoder_data);
+  return result;
+}
+
+void print(const char* name, const Result& result) {
+  if (result.frames == 0) {
+    printf("%-14s no frames\n", name);
+    return;
+  }
+  printf("%-14s %4lu frames %10.0f bytes copied/frame %6.2f allocations/frame %7.3f ms/frame\n",
+         name, static_cast<unsigned long>(result.frames), double(result.bytes_copied) / result.frames,
+         double(result.allocations) / result.frames, result.ms / result.frames);
+}
+
+cv::Mat wrap(const std::string& message) {
+  return cv::Mat(1, message.size(), CV_8UC1, const_cast<char*>(message.data()));
+}
+
+}  // namespace
+
+int main() {
+  const auto packets = encode();
+  if (packets.empty()) {
+    printf("Fail to encode\n");
+    return -1;
+  }
+  std::vector<std::string> jpegs;
+  std::vector<std::string> raws;
+  for (int i = 0; i < kFrames; ++i) {
+    const auto image = pattern(i);
+    std::vector<uint8_t> jpeg;
+    cv::imencode(".jpg", image, jpeg);
+    jpegs.emplace_back(jpeg.begin(), jpeg.end());
+    raws.emplace_back(reinterpret_cast<const char*>(image.data), image.total() * 3);
+  }
+
+  // jpeg: the message bytes were copied into a vector to decode them into a new image,
+  // now they are decoded from the message into a pooled buffer
+  auto jpeg_before = run(jpegs, [](const std::string& message, Result* result) {
+    std::vector<uint8_t> bytes(message.begin(), message.end());
+    const auto image = cv::imdecode(bytes, cv::IMREAD_COLOR);
+    result->bytes_copied += bytes.size();
+    result->allocations += 2;
+    return !image.empty();
+  });
+  auto jpeg_pool = std::make_shared<crdc::airi::common::FrameBufferPool>();
+  auto jpeg_after = run(jpegs, [&](const std::string& message, Result* result) {
+    auto buffer = jpeg_pool->acquire(size_t(kWidth) * kHeight * 3);
+    cv::Mat image(kHeight, kWidth, CV_8UC3, buffer.get());
+    cv::imdecode(wrap(message), cv::IMREAD_COLOR, &image);
+    // imdecode allocates if the size does not match
+    if (image.data != buffer.get()) {
+      ++result->allocations;
+    }
+    return !image.empty();
+  });
+  jpeg_after.allocations += jpeg_pool->stats().allocations;
+
+  // raw: the message was cloned, now the image is a view of the message
+  auto raw_before = run(raws, [](const std::string& message, Result* result) {
+    const auto image = cv::Mat(kHeight, kWidth, CV_8UC3, const_cast<char*>(message.data()))
+                           .clone();
+    result->bytes_copied += image.total() * image.elemSize();
+    ++result->allocations;
+    return !image.empty();
+  });
+  auto raw_after = run(raws, [](const std::string& message, Result*) {
+    const cv::Mat image(kHeight, kWidth, CV_8UC3, const_cast<char*>(message.data()));
+    return !image.empty();
+  });
+
+  // h264: converted into out_buffer and cloned into an image of its own, now converted
+  // straight into a pooled buffer, the shown image holds the previous one
+  std::shared_ptr<std::vector<uint8_t>> shown;
+  const auto h264_before = runDecoder(packets, [&](crdc::airi::H264DecoderData* decoder_data,
+                                                   Result* result) {
+    if (crdc::airi::decoder_convert_frame(decoder_data) < 0) {
+      return false;
+    }
+    shown = std::make_shared<std::vector<uint8_t>>(
+        decoder_data->out_buffer, decoder_data->out_buffer + decoder_data->output_size);
+    result->bytes_copied += decoder_data->output_size;
+    ++result->allocations;
+    return true;
+  });
+  auto h264_pool = std::make_shared<crdc::airi::common::FrameBufferPool>();
+  std::shared_ptr<uint8_t> shown_pooled;
+  auto h264_after = runDecoder(packets, [&](crdc::airi::H264DecoderData* decoder_data,
+                                            Result*) {
+    int width, height;
+    if (crdc::airi::decoder_output_size(decoder_data, &width, &height) < 0) {
+      return false;
+    }
+    auto buffer = h264_pool->acquire(width * height * 3);
+    if (crdc::airi::decoder_convert_frame_into(decoder_data, buffer.get(), width * 3,
+                                               width * height * 3) < 0) {
+      return false;
+    }
+    shown_pooled = buffer;
+    return true;
+  });
+  h264_after.allocations = h264_pool->stats().allocations;
+
+  // paint: the shown image was cloned on every paint, now its planes are uploaded as they
+  // are and only cloned if their rows are not whole pixels
+  auto paint_before = run(raws, [](const std::string& message, Result* result) {
+    const cv::Mat latest(kHeight, kWidth, CV_8UC3, const_cast<char*>(message.data()));
+    const auto image = latest.clone();
+    result->bytes_copied += image.total() * image.elemSize();
+    ++result->allocations;
+    return !image.empty();
+  });
+  auto paint_after = run(raws, [](const std::string& message, Result* result) {
+    cv::Mat plane(kHeight, kWidth, CV_8UC3, const_cast<char*>(message.data()));
+    if (plane.step[0] % plane.elemSize() != 0) {
+      plane = plane.clone();
+      result->bytes_copied += plane.total() * plane.elemSize();
+      ++result->allocations;
+    }
+    return !plane.empty();
+  });
+
+  print("jpeg before", jpeg_before);
+  print("jpeg after", jpeg_after);
+  print("raw before", raw_before);
+  print("raw after", raw_after);
+  print("h264 before", h264_before);
+  print("h264 after", h264_after);
+  print("paint before", paint_before);
+  print("paint after", paint_after);
+  return 0;
+}
@@ -1,14 +1,70 @@
 #include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <vector>
 #include "h264_rgb_encoder_decoder/encoder.h"
 #include "h264_rgb_encoder_decoder/decoder.h"
+extern "C" {
+#include <libavutil/opt.h>
+}
 
 namespace crdc {
 namespace airi {
 
+// hevc packets of count gray frames from libx265 through libavcodec, empty if it is missing
+static std::vector<std::string> EncodeHevc(int count, int width, int height) {
+    std::vector<std::string> packets;
+    const AVCodec* codec = avcodec_find_encoder_by_name("libx265");
+    if (!codec) {
+        return packets;
+    }
+    AVCodecContext* ctx = avcodec_alloc_context3(codec);
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->time_base = AVRational{1, 25};
+    av_opt_set(ctx->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(ctx->priv_data, "tune", "zerolatency", 0);
+    av_opt_set(ctx->priv_data, "x265-params", "log-level=error", 0);
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        avcodec_free_context(&ctx);
+        return packets;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    frame->format = ctx->pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    av_frame_get_buffer(frame, 0);
+    AVPacket* packet = av_packet_alloc();
+    // the last round flushes the encoder
+    for (int i = 0; i <= count; ++i) {
+        if (i < count) {
+            av_frame_make_writable(frame);
+            memset(frame->data[0], i * 20, frame->linesize[0] * height);
+            memset(frame->data[1], 128, frame->linesize[1] * height / 2);
+            memset(frame->data[2], 128, frame->linesize[2] * height / 2);
+            frame->pts = i;
+            avcodec_send_frame(ctx, frame);
+        } else {
+            avcodec_send_frame(ctx, NULL);
+        }
+        while (avcodec_receive_packet(ctx, packet) == 0) {
+            packets.emplace_back(reinterpret_cast<char*>(packet->data), packet->size);
+            av_packet_unref(packet);
+        }
+    }
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return packets;
+}
+
 class EncoderDecoderTest : public ::testing::Test {
 protected:
     H264EncoderData* encoder_data;
     H264DecoderData* decoder_data;
+    int fed_packets = 0;
 
     void SetUp() override {
         ASSERT_EQ(encoder_init(&encoder_data, 640, 480, false), 0);
@@ -19,6 +75,23 @@ protected:
         encoder_dispose(encoder_data);
         decoder_dispose(decoder_data);
     }
+
+    // encodes frames of changing color and feeds all of them to the decoder
+    void FeedFrames(int count, int width = 640, int height = 480) {
+        uint8_t* raw_data_buf = encoder_get_raw_data_buf(encoder_data);
+        for (int i = 0; i < count; ++i) {
+            memset(raw_data_buf, i * 20, width * height * 3);
+            uint8_t* encoded_buf;
+            int encoded_size;
+            ASSERT_EQ(encoder_encode(encoder_data, &encoded_buf, &encoded_size), 0);
+            if (encoded_size > 0) {
+                ASSERT_GE(decoder_parse(decoder_data, encoded_buf, encoded_size), 0);
+                ++fed_packets;
+            }
+        }
+        // flush parser
+        decoder_parse(decoder_data, NULL, 0);
+    }
 };
 
 TEST_F(EncoderDecoderTest, EncoderDecoderInitialization) {
@@ -53,6 +126,395 @@ TEST_F(EncoderDecoderTest, DecoderFunctionality) {
     int frame_formed = decoder_parse(decoder_data, encoded_buf, encoded_size);
     EXPECT_GE(frame_formed, 0);
 }
+
+TEST_F(EncoderDecoderTest, AutoConvertConvertsEveryFrame) {
+    FeedFrames(5);
+    EXPECT_GT(decoder_data->decoded_frames, 0u);
+    EXPECT_EQ(decoder_data->converted_frames, decoder_data->decoded_frames);
+    EXPECT_EQ(decoder_data->width, 640);
+    EXPECT_EQ(decoder_data->height, 480);
+}
+
+TEST_F(EncoderDecoderTest, ConvertOnDemand) {
+    decoder_data->auto_convert = 0;
+    FeedFrames(5);
+    ASSERT_GT(decoder_data->decoded_frames, 0u);
+    EXPECT_EQ(decoder_data->converted_frames, 0u);
+    EXPECT_EQ(decoder_data->first_time, 1);
+
+    // only the newest frame is converted
+    EXPECT_EQ(decoder_convert_frame(decoder_data), 0);
+    EXPECT_EQ(decoder_data->converted_frames, 1u);
+    EXPECT_EQ(decoder_data->width, 640);
+    EXPECT_EQ(decoder_data->height, 480);
+    ASSERT_NE(decoder_data->out_buffer, nullptr);
+
+    EXPECT_EQ(decoder_convert_frame(decoder_data), -1);
+    EXPECT_EQ(decoder_data->converted_frames, 1u);
+}
+
+TEST_F(EncoderDecoderTest, ReceiveNativeFrame) {
+    decoder_data->auto_convert = 0;
+    FeedFrames(5);
+    ASSERT_GT(decoder_data->decoded_frames, 0u);
+
+    AVFrame* frame = decoder_receive_frame(decoder_data);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->width, 640);
+    EXPECT_EQ(frame->height, 480);
+    EXPECT_NE(frame->data[0], nullptr);
+    EXPECT_GE(frame->linesize[0], 640);
+    av_frame_free(&frame);
+
+    // handed out without any conversion
+    EXPECT_EQ(decoder_receive_frame(decoder_data), nullptr);
+    EXPECT_EQ(decoder_convert_frame(decoder_data), -1);
+    EXPECT_EQ(decoder_data->converted_frames, 0u);
+}
+
+TEST_F(EncoderDecoderTest, ScaledOutput) {
+    decoder_set_output_size(decoder_data, 160, 120);
+    FeedFrames(3);
+    ASSERT_GT(decoder_data->converted_frames, 0u);
+    EXPECT_EQ(decoder_data->width, 160);
+    EXPECT_EQ(decoder_data->height, 120);
+    EXPECT_EQ(decoder_data->output_size, 160 * 120 * 3);
+
+    // back to the size of the stream with the next frame
+    decoder_set_output_size(decoder_data, 0, 0);
+    FeedFrames(3);
+    EXPECT_EQ(decoder_data->width, 640);
+    EXPECT_EQ(decoder_data->height, 480);
+    EXPECT_EQ(decoder_data->output_size, 640 * 480 * 3);
+}
+
+TEST_F(EncoderDecoderTest, ConvertIntoCallerBuffer) {
+    decoder_data->auto_convert = 0;
+    decoder_set_output_size(decoder_data, 320, 240);
+    FeedFrames(5);
+
+    int width = 0, height = 0;
+    ASSERT_EQ(decoder_output_size(decoder_data, &width, &height), 0);
+    EXPECT_EQ(width, 320);
+    EXPECT_EQ(height, 240);
+
+    // too small
+    std::vector<uint8_t> buffer(width * 3 * height);
+    EXPECT_EQ(decoder_convert_frame_into(decoder_data, buffer.data(), width * 3,
+                                         buffer.size() - 1), -1);
+    EXPECT_EQ(decoder_data->converted_frames, 0u);
+
+    // rows may be padded
+    const int linesize = width * 3 + 64;
+    buffer.assign(linesize * height, 0xff);
+    ASSERT_EQ(decoder_convert_frame_into(decoder_data, buffer.data(), linesize, buffer.size()), 0);
+    EXPECT_EQ(decoder_data->converted_frames, 1u);
+    EXPECT_EQ(buffer[linesize - 1], 0xff);
+    EXPECT_EQ(decoder_output_size(decoder_data, &width, &height), -1);
+    EXPECT_EQ(decoder_convert_frame_into(decoder_data, buffer.data(), linesize, buffer.size()), -1);
+}
+
+TEST_F(EncoderDecoderTest, ResolutionChange) {
+    FeedFrames(3);
+    ASSERT_GT(decoder_data->converted_frames, 0u);
+    EXPECT_EQ(decoder_data->width, 640);
+    EXPECT_EQ(decoder_data->height, 480);
+
+    // a new stream of another size into the same decoder
+    encoder_dispose(encoder_data);
+    ASSERT_EQ(encoder_init(&encoder_data, 320, 240, false), 0);
+    const uint64_t converted = decoder_data->converted_frames;
+    FeedFrames(3, 320, 240);
+    EXPECT_GT(decoder_data->converted_frames, converted);
+    EXPECT_EQ(decoder_data->width, 320);
+    EXPECT_EQ(decoder_data->height, 240);
+    EXPECT_EQ(decoder_data->output_size, 320 * 240 * 3);
+
+    // and back, converted on demand into a buffer of the caller
+    decoder_data->auto_convert = 0;
+    encoder_dispose(encoder_data);
+    ASSERT_EQ(encoder_init(&encoder_data, 640, 480, false), 0);
+    FeedFrames(3);
+    int width = 0, height = 0;
+    ASSERT_EQ(decoder_output_size(decoder_data, &width, &height), 0);
+    EXPECT_EQ(width, 640);
+    EXPECT_EQ(height, 480);
+    std::vector<uint8_t> buffer(width * height * 3);
+    ASSERT_EQ(decoder_convert_frame_into(decoder_data, buffer.data(), width * 3, buffer.size()), 0);
+    EXPECT_EQ(decoder_data->width, 640);
+    EXPECT_EQ(decoder_data->height, 480);
+}
+
+TEST_F(EncoderDecoderTest, FrameThreading) {
+    decoder_dispose(decoder_data);
+    ASSERT_EQ(decoder_init_threaded(&decoder_data, 4, 1), 0);
+    FeedFrames(8);
+    ASSERT_GT(fed_packets, 0);
+
+    // frames held back by the threads come out with the flush
+    EXPECT_GE(decoder_flush(decoder_data), 0);
+    EXPECT_EQ(decoder_data->decoded_frames, uint64_t(fed_packets));
+    EXPECT_EQ(decoder_data->converted_frames, decoder_data->decoded_frames);
+    EXPECT_EQ(decoder_data->width, 640);
+    EXPECT_EQ(decoder_data->height, 480);
+}
+
+TEST_F(EncoderDecoderTest, FrameThreadingDelayIsNoSkip) {
+    decoder_dispose(decoder_data);
+    ASSERT_EQ(decoder_init_threaded(&decoder_data, 4, 1), 0);
+    // the P-frames are references, so nothing is dropped while the threads hold frames back
+    decoder_set_low_latency(decoder_data, 2, 0);
+    decoder_set_backlog(decoder_data, 5);
+    FeedFrames(8);
+    ASSERT_GT(fed_packets, 0);
+    EXPECT_EQ(decoder_data->pCodecCtx->skip_frame, AVDISCARD_NONREF);
+    EXPECT_EQ(decoder_data->skipped_frames, 0u);
+
+    EXPECT_GE(decoder_flush(decoder_data), 0);
+    EXPECT_EQ(decoder_data->decoded_frames, uint64_t(fed_packets));
+}
+
+TEST_F(EncoderDecoderTest, LowLatencySkipsWhenBehind) {
+    decoder_set_low_latency(decoder_data, 2, 4);
+
+    // keeping up, every frame is decoded
+    decoder_set_backlog(decoder_data, 1);
+    FeedFrames(3);
+    ASSERT_GT(fed_packets, 0);
+    EXPECT_EQ(decoder_data->decoded_frames, uint64_t(fed_packets));
+    EXPECT_EQ(decoder_data->skipped_frames, 0u);
+
+    // far behind, only key frames
+    decoder_set_backlog(decoder_data, 10);
+    const uint64_t decoded = decoder_data->decoded_frames;
+    const int fed = fed_packets;
+    FeedFrames(5);
+    EXPECT_EQ(decoder_data->decoded_frames, decoded);
+    EXPECT_EQ(decoder_data->skipped_frames, uint64_t(fed_packets - fed));
+
+    // caught up, but the P-frames refer to skipped ones until the next key frame
+    decoder_set_backlog(decoder_data, 0);
+    FeedFrames(2);
+    EXPECT_EQ(decoder_data->decoded_frames, decoded);
+    EXPECT_EQ(decoder_data->pCodecCtx->skip_frame, AVDISCARD_NONKEY);
+
+    // a new stream starts with one
+    encoder_dispose(encoder_data);
+    ASSERT_EQ(encoder_init(&encoder_data, 640, 480, false), 0);
+    FeedFrames(2);
+    EXPECT_GT(decoder_data->decoded_frames, decoded);
+    EXPECT_EQ(decoder_data->pCodecCtx->skip_frame, AVDISCARD_DEFAULT);
+}
+
+TEST_F(EncoderDecoderTest, DetectsH264) {
+    decoder_dispose(decoder_data);
+    ASSERT_EQ(decoder_init_codec(&decoder_data, AV_CODEC_ID_NONE, 1, 0), 0);
+    EXPECT_EQ(decoder_data->codec_id, AV_CODEC_ID_NONE);
+    EXPECT_EQ(decoder_data->pCodecCtx, nullptr);
+
+    FeedFrames(3);
+    EXPECT_EQ(decoder_data->codec_id, AV_CODEC_ID_H264);
+    EXPECT_GT(decoder_data->decoded_frames, 0u);
+    EXPECT_EQ(decoder_data->width, 640);
+    EXPECT_EQ(decoder_data->height, 480);
+}
+
+TEST(DecoderCodecTest, DetectCodec) {
+    const uint8_t h264[] = {0, 0, 0, 1, 0x67, 0x64, 0x00, 0x1f, 0, 0, 1, 0x68, 0xee};
+    const uint8_t hevc[] = {0, 0, 0, 1, 0x40, 0x01, 0x0c, 0x01, 0, 0, 1, 0x42, 0x01};
+    // a P-frame slice says nothing about the codec
+    const uint8_t slice[] = {0, 0, 0, 1, 0x41, 0x9a, 0x00, 0x10};
+    // hevc IDR_N_LP slice and end of sequence, both read like an h264 pps
+    const uint8_t hevc_idr[] = {0, 0, 0, 1, 0x28, 0x01, 0xaf, 0x1d, 0, 0, 1, 0x48, 0x01};
+    // the hevc vps after them still decides
+    const uint8_t hevc_late_vps[] = {0, 0, 1, 0x28, 0x01, 0xaf, 0, 0, 1, 0x40, 0x01, 0x0c};
+    // an h264 pps or IDR slice without sps does not
+    const uint8_t h264_pps[] = {0, 0, 0, 1, 0x68, 0xee, 0, 0, 1, 0x65, 0x88, 0x84};
+    EXPECT_EQ(decoder_detect_codec(h264, sizeof(h264)), AV_CODEC_ID_H264);
+    EXPECT_EQ(decoder_detect_codec(hevc, sizeof(hevc)), AV_CODEC_ID_HEVC);
+    EXPECT_EQ(decoder_detect_codec(slice, sizeof(slice)), AV_CODEC_ID_NONE);
+    EXPECT_EQ(decoder_detect_codec(hevc_idr, sizeof(hevc_idr)), AV_CODEC_ID_NONE);
+    EXPECT_EQ(decoder_detect_codec(hevc_late_vps, sizeof(hevc_late_vps)), AV_CODEC_ID_HEVC);
+    EXPECT_EQ(decoder_detect_codec(h264_pps, sizeof(h264_pps)), AV_CODEC_ID_NONE);
+    EXPECT_EQ(decoder_detect_codec(hevc, 3), AV_CODEC_ID_NONE);
+}
+
+TEST(DecoderCodecTest, HevcRoundTrip) {
+    std::vector<std::string> packets = EncodeHevc(5, 320, 240);
+    if (packets.empty()) {
+        GTEST_SKIP() << "libx265 is not available";
+    }
+
+    H264DecoderData* decoder_data;
+    ASSERT_EQ(decoder_init_codec(&decoder_data, AV_CODEC_ID_NONE, 1, 0), 0);
+    for (auto& packet : packets) {
+        ASSERT_GE(decoder_parse(decoder_data, reinterpret_cast<uint8_t*>(&packet[0]),
+                                packet.size()), 0);
+    }
+    decoder_parse(decoder_data, NULL, 0);
+    decoder_flush(decoder_data);
+
+    EXPECT_EQ(decoder_data->codec_id, AV_CODEC_ID_HEVC);
+    EXPECT_EQ(decoder_data->decoded_frames, 5u);
+    EXPECT_EQ(decoder_data->converted_frames, 5u);
+    EXPECT_EQ(decoder_data->width, 320);
+    EXPECT_EQ(decoder_data->height, 240);
+    decoder_dispose(decoder_data);
+}
+
+// encodes count frames from caller owned planes, flushes the delayed ones and feeds all
+// of them to a new decoder, returns the number of encoded pictures
+static int EncodePlanes(H264EncoderConfig* config, int count, H264DecoderData** p_decoder) {
+    const int w = config->width;
+    const int h = config->height;
+    // padded rows, the encoder has to honor the strides
+    const int stride = w + 32;
+    std::vector<uint8_t> luma(stride * h);
+    std::vector<uint8_t> chroma(stride * h);
+    uint8_t* planes[3];
+    int strides[3];
+    planes[0] = luma.data();
+    strides[0] = stride;
+    if (config->input_format == H264_INPUT_NV12) {
+        planes[1] = chroma.data();
+        strides[1] = stride;
+    } else {
+        planes[1] = chroma.data();
+        planes[2] = chroma.data() + stride / 2 * h / 2;
+        strides[1] = strides[2] = stride / 2;
+    }
+
+    H264EncoderData* encoder_data;
+    EXPECT_EQ(encoder_init2(&encoder_data, config), 0);
+    EXPECT_EQ(encoder_get_raw_data_buf(encoder_data), nullptr);
+    EXPECT_EQ(decoder_init(p_decoder), 0);
+    int encoded = 0;
+    auto encode = [&](uint8_t* const* in) {
+        H264EncodedFrame frame;
+        EXPECT_EQ(encoder_encode_planes(encoder_data, in, strides, &frame), 0);
+        if (frame.nal_count == 0) {
+            return;
+        }
+        int size = 0;
+        for (int n = 0; n < frame.nal_count; ++n) {
+            EXPECT_EQ(frame.nals[n].p_payload, frame.data + size);
+            size += frame.nals[n].i_payload;
+        }
+        EXPECT_EQ(size, frame.size);
+        EXPECT_GE(decoder_parse(*p_decoder, frame.data, frame.size), 0);
+        ++encoded;
+    };
+    for (int i = 0; i < count; ++i) {
+        memset(luma.data(), i * 20, luma.size());
+        memset(chroma.data(), 128 + i, chroma.size());
+        encode(planes);
+    }
+    while (encoder_delayed_frames(encoder_data) > 0) {
+        encode(NULL);
+    }
+    decoder_parse(*p_decoder, NULL, 0);
+    decoder_flush(*p_decoder);
+    encoder_dispose(encoder_data);
+    return encoded;
+}
+
+TEST(EncoderConfigTest, I420Planes) {
+    H264EncoderConfig config;
+    encoder_config_default(&config, 320, 240);
+    config.input_format = H264_INPUT_I420;
+    config.external_planes = 1;
+
+    H264DecoderData* decoder_data;
+    EXPECT_EQ(EncodePlanes(&config, 5, &decoder_data), 5);
+    EXPECT_EQ(decoder_data->decoded_frames, 5u);
+    EXPECT_EQ(decoder_data->width, 320);
+    EXPECT_EQ(decoder_data->height, 240);
+    decoder_dispose(decoder_data);
+}
+
+TEST(EncoderConfigTest, NV12Planes) {
+    H264EncoderConfig config;
+    encoder_config_default(&config, 320, 240);
+    config.input_format = H264_INPUT_NV12;
+    config.external_planes = 1;
+    config.crf = 28.f;
+
+    H264DecoderData* decoder_data;
+    EXPECT_EQ(EncodePlanes(&config, 5, &decoder_data), 5);
+    EXPECT_EQ(decoder_data->decoded_frames, 5u);
+    EXPECT_EQ(decoder_data->width, 320);
+    decoder_dispose(decoder_data);
+}
+
+TEST(EncoderConfigTest, PresetBitrateAndThreads) {
+    H264EncoderConfig config;
+    encoder_config_default(&config, 320, 240);
+    config.input_format = H264_INPUT_I420;
+    config.external_planes = 1;
+    // lookahead and B-frames, pictures come out late and have to be flushed
+    config.preset = "fast";
+    config.tune = NULL;
+    config.bitrate_kbps = 500;
+    config.threads = 4;
+    config.keyint = 10;
+
+    H264DecoderData* decoder_data;
+    EXPECT_EQ(EncodePlanes(&config, 20, &decoder_data), 20);
+    EXPECT_EQ(decoder_data->decoded_frames, 20u);
+    decoder_dispose(decoder_data);
+}
+
+TEST(EncoderConfigTest, FirstFrameCarriesHeaders) {
+    H264EncoderConfig config;
+    encoder_config_default(&config, 320, 240);
+    config.input_format = H264_INPUT_I420;
+    config.external_planes = 1;
+    std::vector<uint8_t> yuv(320 * 240 * 3 / 2, 100);
+    uint8_t* planes[3] = {yuv.data(), yuv.data() + 320 * 240, yuv.data() + 320 * 240 * 5 / 4};
+    const int strides[3] = {320, 160, 160};
+
+    H264EncoderData* encoder_data;
+    ASSERT_EQ(encoder_init2(&encoder_data, &config), 0);
+    H264EncodedFrame frame;
+    ASSERT_EQ(encoder_encode_planes(encoder_data, planes, strides, &frame), 0);
+    ASSERT_GE(frame.nal_count, 3);
+    EXPECT_EQ(frame.keyframe, 1);
+    EXPECT_EQ(frame.pts, 0);
+    bool sps = false, pps = false, idr = false;
+    for (int n = 0; n < frame.nal_count; ++n) {
+        sps |= frame.nals[n].i_type == NAL_SPS;
+        pps |= frame.nals[n].i_type == NAL_PPS;
+        idr |= frame.nals[n].i_type == NAL_SLICE_IDR;
+    }
+    EXPECT_TRUE(sps && pps && idr);
+
+    ASSERT_EQ(encoder_encode_planes(encoder_data, planes, strides, &frame), 0);
+    EXPECT_EQ(frame.keyframe, 0);
+    EXPECT_EQ(frame.pts, 1);
+    encoder_dispose(encoder_data);
+}
+
+TEST(EncoderConfigTest, UnknownPreset) {
+    H264EncoderConfig config;
+    encoder_config_default(&config, 320, 240);
+    config.preset = "warp";
+    H264EncoderData* encoder_data = NULL;
+    EXPECT_EQ(encoder_init2(&encoder_data, &config), -1);
+    EXPECT_EQ(encoder_data, nullptr);
+}
+
+TEST(EncoderConfigTest, ExternalPlanesNeedPlanes) {
+    H264EncoderConfig config;
+    encoder_config_default(&config, 320, 240);
+    config.input_format = H264_INPUT_I420;
+    config.external_planes = 1;
+    H264EncoderData* encoder_data;
+    ASSERT_EQ(encoder_init2(&encoder_data, &config), 0);
+    uint8_t* encoded_buf;
+    int encoded_size;
+    EXPECT_EQ(encoder_encode(encoder_data, &encoded_buf, &encoded_size), -1);
+    encoder_dispose(encoder_data);
+}
 }  // namespace airi
 }  // namespace crdc
 
@@ -55,15 +55,13 @@ void Camera::paintGL() {
 #endif
 }
 
-#ifdef __aarch64__
-glm::dmat4x4 Camera::getProjectionMatrix() {
+glm::dmat4x4 Camera::getProjectionMatrix() const {
     return projection_matrix_;
 }
 
-glm::dmat4x4 Camera::getModelMatrix() {
+glm::dmat4x4 Camera::getModelMatrix() const {
     return model_matrix_;
 }
-#endif
 
 void Camera::mousePressEvent(QMouseEvent *e) {
   pt_previous_ = e->pos();
@@ -26,10 +26,8 @@ class Camera {
   void mouseMoveEvent(QMouseEvent *e);
   void wheelEvent(QWheelEvent *e);
 
-#ifdef __aarch64__
-  glm::dmat4x4 getProjectionMatrix();
-  glm::dmat4x4 getModelMatrix();
-#endif
+  glm::dmat4x4 getProjectionMatrix() const;
+  glm::dmat4x4 getModelMatrix() const;
 
   void lockBirdview(const bool lock);
 
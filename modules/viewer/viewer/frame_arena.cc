@@ -0,0 +1,66 @@
+#include "viewer/frame_arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace crdc {
+namespace airi {
+
+namespace {
+
+const size_t kAlignment = 16;
+
+size_t alignUp(const size_t size) { return (size + kAlignment - 1) & ~(kAlignment - 1); }
+
+}  // namespace
+
+FrameArena::FrameArena(const size_t block_size) : block_size_(alignUp(block_size)) {
+  blocks_.push_back(makeBlock(block_size_));
+}
+
+void *FrameArena::allocateBytes(const size_t bytes) {
+  const size_t size = alignUp(bytes);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto *block = &blocks_.back();
+  if (block->used + size > block->size) {
+    blocks_.push_back(makeBlock(std::max(block_size_, size)));
+    block = &blocks_.back();
+  }
+  void *p = block->begin + block->used;
+  block->used += size;
+  return p;
+}
+
+void FrameArena::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (blocks_.size() > 1) {
+    // one block big enough for the whole last frame
+    size_t size = 0;
+    for (const auto &block : blocks_) {
+      size += block.size;
+    }
+    blocks_.clear();
+    blocks_.push_back(makeBlock(size));
+  }
+  blocks_.back().used = 0;
+}
+
+size_t FrameArena::capacity() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t size = 0;
+  for (const auto &block : blocks_) {
+    size += block.size;
+  }
+  return size;
+}
+
+FrameArena::Block FrameArena::makeBlock(const size_t size) {
+  Block block;
+  block.memory.reset(new char[size + kAlignment]);
+  const auto address = reinterpret_cast<uintptr_t>(block.memory.get());
+  block.begin = block.memory.get() + (alignUp(address) - address);
+  block.size = size;
+  return block;
+}
+
+}  // namespace airi
+}  // namespace crdc
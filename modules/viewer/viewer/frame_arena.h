@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace crdc {
+namespace airi {
+
+// contiguous read only view on vertices, e.g. of a std::vector or of arena memory
+template <typename T>
+struct VertexSpan {
+  VertexSpan() = default;
+  VertexSpan(const T *data, const size_t size) : data(data), size(size) {}
+  template <typename Allocator>
+  VertexSpan(const std::vector<T, Allocator> &v) : data(v.data()), size(v.size()) {}
+
+  bool empty() const { return size == 0; }
+  const T *begin() const { return data; }
+  const T *end() const { return data + size; }
+  const T &operator[](const size_t i) const { return data[i]; }
+
+  const T *data{nullptr};
+  size_t size{0};
+};
+
+/**
+ * @brief Bump allocator for vertex data that only lives for one frame, reset
+ *        at the end of paintGL. Blocks are merged on reset, so after a few
+ *        frames a frame costs no heap allocation at all.
+ */
+class FrameArena {
+ public:
+  explicit FrameArena(const size_t block_size = 1 << 20);
+
+ public:
+  // thread safe, uninitialized and 16 byte aligned, valid until the next reset()
+  template <typename T>
+  T *allocate(const size_t count) {
+    return static_cast<T *>(allocateBytes(sizeof(T) * count));
+  }
+
+  // GUI thread, once nothing of this frame is referenced any more
+  void reset();
+
+  size_t capacity() const;
+
+ protected:
+  struct Block {
+    std::unique_ptr<char[]> memory;
+    char *begin{nullptr};
+    size_t size{0};
+    size_t used{0};
+  };
+
+  void *allocateBytes(const size_t bytes);
+
+  static Block makeBlock(const size_t size);
+
+ protected:
+  const size_t block_size_;
+  mutable std::mutex mutex_;
+  std::vector<Block> blocks_;
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include "cyber/sensor_proto/localization.pb.h"
+#include "viewer/proto/config.pb.h"
+
+namespace crdc {
+namespace airi {
+
+class Renderer;
+
+// knobs of the adaptive quality controller, the defaults are full quality
+struct QualitySettings {
+  int level{0};
+  // draw every n-th point of a cloud
+  int point_stride{1};
+  size_t max_labels{std::numeric_limits<size_t>::max()};
+  // multiplies the angular step of circles and divides sphere slices
+  float tessellation{1.f};
+  // fraction of the device pixels the scene is rendered at
+  float render_scale{1.f};
+  size_t history_depth{std::numeric_limits<size_t>::max()};
+};
+
+// read only data of one paintGL, shared by all renderers while preparing and
+// submitting, so nothing below paintGL has to lock GlobalData
+struct FrameContext {
+  uint64_t sequence{0};
+  uint64_t utime{0};
+
+  std::shared_ptr<const crdc::airi::LocalizationEstimate> pose;
+  // shared with the other frames until the config changes
+  std::shared_ptr<const viewer::Config> config;
+
+  glm::dmat4x4 projection_matrix;
+  glm::dmat4x4 model_matrix;
+  glm::mat4 mvp;
+  int viewport_w{0};
+  int viewport_h{0};
+  double eye_distance{0};
+  glm::dvec3 eye;
+
+  // resolution of the frame, full quality for everything else
+  QualitySettings quality;
+  // knobs of every renderer and channel the quality controller degraded on its own
+  std::unordered_map<const Renderer *, QualitySettings> renderer_quality;
+
+  float poseZ() const { return pose ? pose->pose().position().z() : 0.f; }
+};
+
+}  // namespace airi
+}  // namespace crdc
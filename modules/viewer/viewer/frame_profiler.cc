@@ -0,0 +1,220 @@
+#include "viewer/frame_profiler.h"
+#include <QOpenGLContext>
+#ifndef QT_OPENGL_ES_2
+#include <QOpenGLTimerQuery>
+#endif
+#include <algorithm>
+#include "common/common.h"
+#include "viewer/renderers/renderer.h"
+
+namespace crdc {
+namespace airi {
+
+FrameProfiler::FrameProfiler() = default;
+
+FrameProfiler::~FrameProfiler() = default;
+
+void FrameProfiler::beginFrame(const bool enabled) {
+  const bool was_enabled = enabled_;
+  enabled_ = enabled;
+  if (!enabled_) {
+    return;
+  }
+
+  frame_begin_us_ = get_now_microsecond();
+  if (!was_enabled) {
+    window_begin_us_ = frame_begin_us_;
+    window_frames_ = 0;
+    num_frame_times_ = 0;
+    entries_.clear();
+    indices_.clear();
+    for (auto &pending : pending_) {
+      pending.clear();
+    }
+
+#ifndef QT_OPENGL_ES_2
+    auto context = QOpenGLContext::currentContext();
+    gpu_supported_ = context && !context->isOpenGLES() &&
+                     (context->format().version() >= qMakePair(3, 3) ||
+                      context->hasExtension("GL_ARB_timer_query"));
+#endif
+  }
+
+  slot_ = (slot_ + 1) % kNumSlots;
+  collectGpu();
+}
+
+void FrameProfiler::endFrame() {
+  if (!enabled_) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &prepare : prepare_us_) {
+      entries_[entry(prepare.first)].sum.prepare_ms += prepare.second / 1000.f;
+    }
+    prepare_us_.clear();
+  }
+
+  const auto now = get_now_microsecond();
+  frame_times_ms_[num_frame_times_++ % kNumFrameTimes] = (now - frame_begin_us_) / 1000.f;
+  ++window_frames_;
+  if (now - window_begin_us_ >= 500000) {
+    publish(now);
+  }
+}
+
+void FrameProfiler::addPrepare(const Renderer *renderer, const uint64_t elapsed_us) {
+  if (!enabled_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  prepare_us_[renderer] += elapsed_us;
+}
+
+void FrameProfiler::beginSubmit(const Renderer *renderer) {
+  if (!enabled_) {
+    return;
+  }
+  const auto index = entry(renderer);
+  entries_[index].sum.depth = open_.size();
+  open_.push_back({index, get_now_microsecond(), recordTimestamp()});
+}
+
+void FrameProfiler::endSubmit() {
+  if (!enabled_ || open_.empty()) {
+    return;
+  }
+  const auto open = open_.back();
+  open_.pop_back();
+
+  entries_[open.index].sum.submit_ms += (get_now_microsecond() - open.begin_us) / 1000.f;
+  const int query_end = recordTimestamp();
+  if (open.query_begin >= 0 && query_end >= 0) {
+    pending_[slot_].push_back({open.index, open.query_begin, query_end});
+  }
+}
+
+void FrameProfiler::countDraw(const size_t vertices) {
+  if (!enabled_) {
+    return;
+  }
+  for (const auto &open : open_) {
+    entries_[open.index].sum.vertices += vertices;
+    ++entries_[open.index].sum.draw_calls;
+  }
+}
+
+FrameProfiler::Report FrameProfiler::report() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return report_;
+}
+
+size_t FrameProfiler::entry(const Renderer *renderer) {
+  auto it = indices_.find(renderer);
+  if (it != indices_.end()) {
+    return it->second;
+  }
+  entries_.emplace_back();
+  entries_.back().sum.name = renderer->name();
+  indices_[renderer] = entries_.size() - 1;
+  return entries_.size() - 1;
+}
+
+int FrameProfiler::recordTimestamp() {
+  if (!gpu_supported_) {
+    return -1;
+  }
+#ifndef QT_OPENGL_ES_2
+  auto &queries = queries_[slot_];
+  if (used_[slot_] == int(queries.size())) {
+    queries.emplace_back(new QOpenGLTimerQuery());
+    if (!queries.back()->create()) {
+      gpu_supported_ = false;
+      queries.pop_back();
+      return -1;
+    }
+  }
+  queries[used_[slot_]]->recordTimestamp();
+  return used_[slot_]++;
+#else
+  return -1;
+#endif
+}
+
+void FrameProfiler::collectGpu() {
+#ifndef QT_OPENGL_ES_2
+  auto &queries = queries_[slot_];
+  for (const auto &pending : pending_[slot_]) {
+    // results are dropped rather than waited for
+    if (!queries[pending.query_end]->isResultAvailable()) {
+      continue;
+    }
+    const auto begin = queries[pending.query_begin]->waitForResult();
+    const auto end = queries[pending.query_end]->waitForResult();
+    entries_[pending.index].gpu_sum_ms += (end - begin) / 1e6f;
+    ++entries_[pending.index].gpu_frames;
+  }
+#endif
+  pending_[slot_].clear();
+  used_[slot_] = 0;
+}
+
+void FrameProfiler::publish(const uint64_t now) {
+  Report report;
+  report.sequence = report_sequence_ + 1;
+  report.fps = window_frames_ * 1e6f / (now - window_begin_us_);
+
+  const size_t count = num_frame_times_ < kNumFrameTimes ? num_frame_times_ : kNumFrameTimes;
+  std::vector<float> frame_times(frame_times_ms_.begin(), frame_times_ms_.begin() + count);
+  if (!frame_times.empty()) {
+    auto p50 = frame_times.begin() + frame_times.size() / 2;
+    std::nth_element(frame_times.begin(), p50, frame_times.end());
+    report.frame_p50_ms = *p50;
+    auto p99 = frame_times.begin() + frame_times.size() * 99 / 100;
+    std::nth_element(frame_times.begin(), p99, frame_times.end());
+    report.frame_p99_ms = *p99;
+  }
+
+  // averages per frame of the renderers active in this window
+  for (auto &entry : entries_) {
+    auto &sum = entry.sum;
+    if (sum.prepare_ms > 0.f || sum.submit_ms > 0.f) {
+      Stats stats = sum;
+      stats.prepare_ms /= window_frames_;
+      stats.submit_ms /= window_frames_;
+      stats.vertices /= window_frames_;
+      stats.draw_calls /= window_frames_;
+      stats.gpu_ms = entry.gpu_frames > 0 ? entry.gpu_sum_ms / entry.gpu_frames : -1.f;
+      report.renderers.push_back(stats);
+    }
+    sum.prepare_ms = sum.submit_ms = 0.f;
+    sum.vertices = sum.draw_calls = 0;
+    entry.gpu_sum_ms = 0.f;
+    entry.gpu_frames = 0;
+  }
+
+  window_begin_us_ = now;
+  window_frames_ = 0;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  report_ = report;
+  report_sequence_ = report.sequence;
+}
+
+FrameProfiler::Scope::Scope(FrameProfiler *profiler, const Renderer *renderer)
+    : profiler_(profiler && profiler->enabled() ? profiler : nullptr) {
+  if (profiler_) {
+    profiler_->beginSubmit(renderer);
+  }
+}
+
+FrameProfiler::Scope::~Scope() {
+  if (profiler_) {
+    profiler_->endSubmit();
+  }
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef QT_OPENGL_ES_2
+class QOpenGLTimerQuery;
+#endif
+
+namespace crdc {
+namespace airi {
+
+class Renderer;
+
+/**
+ * @brief Per renderer CPU and GPU cost, vertex and draw call counts and frame
+ *        times, averaged over half a second for the HUD.
+ */
+class FrameProfiler {
+ public:
+  struct Stats {
+    std::string name;
+    int depth{0};
+    float prepare_ms{0.f};
+    float submit_ms{0.f};
+    // negative if GPU timer queries are not supported
+    float gpu_ms{-1.f};
+    size_t vertices{0};
+    size_t draw_calls{0};
+  };
+
+  struct Report {
+    uint64_t sequence{0};
+    float fps{0.f};
+    float frame_p50_ms{0.f};
+    float frame_p99_ms{0.f};
+    std::vector<Stats> renderers;
+  };
+
+ public:
+  FrameProfiler();
+  ~FrameProfiler();
+
+ public:
+  // GUI thread, everything below is a no-op while disabled
+  void beginFrame(const bool enabled);
+  void endFrame();
+
+  // any thread
+  void addPrepare(const Renderer *renderer, const uint64_t elapsed_us);
+
+  // GUI thread, after all prepares of the frame returned
+  // scopes nest, draws are counted for every open scope
+  void beginSubmit(const Renderer *renderer);
+  void endSubmit();
+  void countDraw(const size_t vertices);
+
+  bool enabled() const { return enabled_; }
+  Report report() const;
+  // changes whenever a new report was published
+  uint64_t reportSequence() const { return report_sequence_; }
+
+  class Scope {
+   public:
+    Scope(FrameProfiler *profiler, const Renderer *renderer);
+    ~Scope();
+
+   private:
+    FrameProfiler *profiler_;
+  };
+
+ protected:
+  struct Entry {
+    Stats sum;
+    float gpu_sum_ms{0.f};
+    size_t gpu_frames{0};
+  };
+
+  struct Open {
+    size_t index;
+    uint64_t begin_us;
+    int query_begin;
+  };
+
+  struct Pending {
+    size_t index;
+    int query_begin;
+    int query_end;
+  };
+
+  size_t entry(const Renderer *renderer);
+  int recordTimestamp();
+  void collectGpu();
+  void publish(const uint64_t now);
+
+ protected:
+  static const size_t kNumSlots = 3;
+  static const size_t kNumFrameTimes = 256;
+
+  bool enabled_{false};
+  mutable std::mutex mutex_;
+  std::unordered_map<const Renderer *, size_t> indices_;
+  std::vector<Entry> entries_;
+  std::vector<Open> open_;
+  // prepare runs on the workers, merged into entries_ at the end of the frame
+  std::unordered_map<const Renderer *, uint64_t> prepare_us_;
+
+  // GPU timestamps are read back kNumSlots frames later to never stall
+  bool gpu_supported_{false};
+#ifndef QT_OPENGL_ES_2
+  std::array<std::vector<std::unique_ptr<QOpenGLTimerQuery>>, kNumSlots> queries_;
+#endif
+  std::array<std::vector<Pending>, kNumSlots> pending_;
+  std::array<int, kNumSlots> used_{};
+  size_t slot_{0};
+
+  uint64_t frame_begin_us_{0};
+  uint64_t window_begin_us_{0};
+  size_t window_frames_{0};
+  std::array<float, kNumFrameTimes> frame_times_ms_{};
+  size_t num_frame_times_{0};
+
+  Report report_;
+  std::atomic<uint64_t> report_sequence_{0};
+};
+
+}  // namespace airi
+}  // namespace crdc
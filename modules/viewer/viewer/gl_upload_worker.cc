@@ -0,0 +1,143 @@
+#include "viewer/gl_upload_worker.h"
+#include <glog/logging.h>
+#include <QOpenGLExtraFunctions>
+#include <exception>
+
+namespace crdc {
+namespace airi {
+
+namespace {
+
+// polls the fence so stop() is not held up by a stalled GPU
+const GLuint64 kFenceTimeoutNs = 100000000;
+
+}  // namespace
+
+GLUploadWorker::~GLUploadWorker() { stop(); }
+
+bool GLUploadWorker::start(QOpenGLContext *share_context, const Task &notify) {
+  if (running_.load()) {
+    return true;
+  }
+  notify_ = notify;
+  if (!share_context || !QOpenGLContext::supportsThreadedOpenGL()) {
+    LOG(WARNING) << "Threaded OpenGL is not supported, uploading on the GUI thread";
+    return false;
+  }
+  share_context_ = share_context;
+
+  // some platforms only create surfaces on the GUI thread
+  surface_.reset(new QOffscreenSurface());
+  surface_->setFormat(share_context->format());
+  surface_->create();
+  if (!surface_->isValid()) {
+    LOG(WARNING) << "No offscreen surface for the upload context, uploading on the GUI thread";
+    surface_.reset();
+    return false;
+  }
+
+  running_.store(true);
+  auto started = std::make_shared<std::promise<bool>>();
+  auto result = started->get_future();
+  thread_.reset(new std::thread(&GLUploadWorker::run, this, started));
+  if (!result.get()) {
+    LOG(WARNING) << "Failed to create the shared upload context, uploading on the GUI thread";
+    stop();
+    return false;
+  }
+  LOG(INFO) << "Uploading textures and buffers on a shared context";
+  return true;
+}
+
+void GLUploadWorker::stop() {
+  running_.store(false);
+  jobs_.break_all_wait();
+  if (thread_ && thread_->joinable()) {
+    thread_->join();
+  }
+  thread_.reset();
+  surface_.reset();
+}
+
+void GLUploadWorker::post(const Task &upload, const Task &done) {
+  if (!running_.load()) {
+    finished_.enqueue([upload, done]() {
+      upload();
+      if (done) {
+        done();
+      }
+    });
+    if (notify_) {
+      notify_();
+    }
+    return;
+  }
+  jobs_.enqueue({upload, done});
+}
+
+void GLUploadWorker::collect() {
+  Task task;
+  while (finished_.dequeue(&task)) {
+    try {
+      task();
+    } catch (std::exception &e) {
+      LOG(ERROR) << "Upload: " << e.what();
+    }
+  }
+}
+
+void GLUploadWorker::run(std::shared_ptr<std::promise<bool>> started) {
+  QOpenGLContext context;
+  context.setFormat(share_context_->format());
+  context.setShareContext(share_context_);
+  if (!context.create() || !context.makeCurrent(surface_.get())) {
+    running_.store(false);
+    started->set_value(false);
+    return;
+  }
+
+  // fences are core since GL 3.2 and GLES 3.0, otherwise glFinish has to do
+  auto functions = context.extraFunctions();
+  const auto version = context.format().version();
+  const bool has_fence = context.isOpenGLES()
+                             ? version >= qMakePair(3, 0)
+                             : version >= qMakePair(3, 2) || context.hasExtension("GL_ARB_sync");
+  started->set_value(true);
+
+  while (running_.load()) {
+    Job job;
+    if (!jobs_.wait_for_dequeue(&job)) {
+      continue;
+    }
+
+    try {
+      job.upload();
+    } catch (std::exception &e) {
+      LOG(ERROR) << "Upload: " << e.what();
+    }
+
+    // the GUI thread must not draw from the objects before the GPU has them
+    if (has_fence) {
+      auto fence = functions->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+      while (running_.load() &&
+             functions->glClientWaitSync(fence, flags, kFenceTimeoutNs) == GL_TIMEOUT_EXPIRED) {
+        flags = 0;
+      }
+      functions->glDeleteSync(fence);
+    } else {
+      functions->glFinish();
+    }
+
+    if (job.done) {
+      finished_.enqueue(job.done);
+    }
+    if (notify_) {
+      notify_();
+    }
+  }
+  context.doneCurrent();
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include "common/thread_safe_queue.h"
+
+namespace crdc {
+namespace airi {
+
+/**
+ * @brief Uploads large textures and vertex buffers on a thread of its own with
+ *        a GL context shared with the widget's, so big clouds and map tiles
+ *        never stall paintGL. Finished uploads are handed back to the GUI thread
+ *        once a fence says the GPU has them.
+ */
+class GLUploadWorker {
+ public:
+  using Task = std::function<void()>;
+
+ public:
+  GLUploadWorker() = default;
+  ~GLUploadWorker();
+
+  // GUI thread with the widget's context current, false falls back to uploading in collect()
+  bool start(QOpenGLContext *share_context, const Task &notify = nullptr);
+
+  void stop();
+
+  // thread safe, upload runs with the worker's context current and may only create
+  // shareable objects, i.e. buffers and textures but no VAOs, done runs in collect()
+  void post(const Task &upload, const Task &done);
+
+  // GUI thread with the widget's context current, e.g. at the start of paintGL
+  void collect();
+
+  bool running() const { return running_.load(); }
+
+ protected:
+  struct Job {
+    Task upload;
+    Task done;
+  };
+
+  void run(std::shared_ptr<std::promise<bool>> started);
+
+ protected:
+  QOpenGLContext *share_context_{nullptr};
+  std::unique_ptr<QOffscreenSurface> surface_;
+  std::unique_ptr<std::thread> thread_;
+  std::atomic<bool> running_{false};
+  Task notify_;
+  common::ThreadSafeQueue<Job> jobs_;
+  common::ThreadSafeQueue<Task> finished_;
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -60,6 +60,21 @@ std::shared_ptr<crdc::airi::LocalizationEstimate> GlobalData::pose() {
   return pose_;
 }
 
+void GlobalData::updateConfig(const std::function<void(viewer::Config *)> &update) {
+  std::lock_guard<std::mutex> lock(mutex_config_);
+  update(&config_);
+  ++config_version_;
+}
+
+std::shared_ptr<const viewer::Config> GlobalData::configSnapshot() {
+  std::lock_guard<std::mutex> lock(mutex_config_);
+  if (config_snapshot_version_ != config_version_) {
+    config_snapshot_ = std::make_shared<const viewer::Config>(config_);
+    config_snapshot_version_ = config_version_;
+  }
+  return config_snapshot_;
+}
+
 void GlobalData::threadMock() {
   while (enable_thread_mock_.load()) {
     auto image_markers = std::make_shared<ImageMarkerList>();
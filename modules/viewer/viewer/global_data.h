@@ -2,6 +2,7 @@
 
 #include <QPoint>
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -22,6 +23,15 @@ namespace airi {
 class GLWidget;
 class MessageHub;
 class Camera;
+class IconAtlas;
+class ImageService;
+class FrameArena;
+class FrameProfiler;
+class GLUploadWorker;
+class GpuResourceManager;
+class PolylineShader;
+class RedrawScheduler;
+class RenderQueue;
 class RendererManager;
 class Toolbar;
 class ImagePlayer;
@@ -34,6 +44,12 @@ class GlobalData {
  public:
   std::shared_ptr<crdc::airi::LocalizationEstimate> pose();
 
+  // every change of config_ goes through here, the next frame takes a new snapshot
+  void updateConfig(const std::function<void(viewer::Config *)> &update);
+
+  // copy of config_ shared by all frames until it changes
+  std::shared_ptr<const viewer::Config> configSnapshot();
+
  protected:
 
   void threadMock();
@@ -47,10 +63,19 @@ class GlobalData {
   std::shared_ptr<FTFont> font_bold_;
   std::shared_ptr<Camera> camera_;
   std::unordered_map<std::string, GLTexture> textures_;
+  std::shared_ptr<IconAtlas> icon_atlas_;
+  std::shared_ptr<PolylineShader> polyline_shader_;
+  std::shared_ptr<RedrawScheduler> redraw_scheduler_;
+  std::shared_ptr<FrameProfiler> profiler_;
+  std::shared_ptr<FrameArena> frame_arena_;
+  std::shared_ptr<GpuResourceManager> gpu_resources_;
+  std::shared_ptr<RenderQueue> render_queue_;
+  std::shared_ptr<GLUploadWorker> upload_worker_;
   GLWidget *glwidget_;
   RendererManager *renderer_manager_;
   Toolbar *toolbar_;
   size_t ip_counter_;
+  std::shared_ptr<ImageService> image_service_;
   std::vector<ImagePlayer*> image_players_;
   bool is_mining_ = false;
   MainWindow *main_window_;
@@ -69,6 +94,11 @@ class GlobalData {
   std::shared_ptr<crdc::airi::LocalizationEstimate> pose_;
   std::mutex mutex_pose_;
 
+  std::mutex mutex_config_;
+  uint64_t config_version_{1};
+  uint64_t config_snapshot_version_{0};
+  std::shared_ptr<const viewer::Config> config_snapshot_;
+
   std::atomic<bool> enable_thread_mock_;
   std::unique_ptr<std::thread> handle_thread_mock_;
 
@@ -1,17 +1,30 @@
 #include "viewer/glwidget.h"
 #include <QMouseEvent>
+#include <QOpenGLFramebufferObject>
 #include <QPainter>
-#include <QTimer>
 #include <QWheelEvent>
+#include "common/thread_pool.h"
 #include "viewer/camera.h"
+#include "viewer/frame_arena.h"
+#include "viewer/frame_context.h"
+#include "viewer/frame_profiler.h"
+#include "viewer/gl_upload_worker.h"
 #include "viewer/global_data.h"
+#include "viewer/gpu_resource_manager.h"
+#include "viewer/quality_controller.h"
+#include "viewer/redraw_scheduler.h"
 #include "viewer/renderers/view_renderer.h"
 #include "viewer/renderers/context_renderer.h"
 #include "viewer/renderers/frame_renderer.h"
+#include "viewer/renderers/hud_renderer.h"
+#include "viewer/renderers/image_overlay_renderer.h"
 #include "viewer/renderers/marker_renderer.h"
 #include "viewer/renderers/perception_renderer.h"
 #include "viewer/renderers/pointcloud_renderer.h"
 #include "viewer/renderers/pointclouds_renderer.h"
+#include "viewer/renderers/render_queue.h"
+#include "viewer/renderers/texturemap_renderer.h"
+#include "viewer/renderers/triangulation_service.h"
 #ifdef __aarch64__
 #include <QOpenGLShaderProgram>
 #include <QCoreApplication>
@@ -40,6 +53,18 @@ static const char *fragmentShaderSource =
 GLWidget::GLWidget() {
   global_data_ = crdc::airi::common::Singleton<GlobalData>::get();
   global_data_->camera_.reset(new Camera());
+  global_data_->redraw_scheduler_.reset(new RedrawScheduler(this));
+  global_data_->profiler_.reset(new FrameProfiler());
+  global_data_->frame_arena_.reset(new FrameArena());
+  global_data_->gpu_resources_ = std::make_shared<GpuResourceManager>();
+}
+
+GLWidget::~GLWidget() {
+  // its context has to go while the application still exists
+  if (global_data_->upload_worker_) {
+    global_data_->upload_worker_->stop();
+  }
+  crdc::airi::common::Singleton<TriangulationService>::get()->shutdown();
 }
 
 #ifdef __aarch64__
@@ -54,6 +79,8 @@ void GLWidget::loadConfigPost() {
   for (auto &renderer : renderers_) {
     renderer->loadConfigPost();
   }
+  global_data_->redraw_scheduler_->setMaxFps(global_data_->config_.max_fps());
+  global_data_->redraw_scheduler_->request();
 }
 
 void GLWidget::initializeGL() {
@@ -64,20 +91,26 @@ void GLWidget::initializeGL() {
   // order of construction influences order in renderer manager
   auto view_renderer = std::make_shared<ViewRenderer>();
   auto context_renderer = std::make_shared<ContextRenderer>();
+  auto texturemap_renderer = std::make_shared<TexturemapRenderer>();
   auto frame_renderer = std::make_shared<FrameRenderer>();
   auto pointcloud_renderer = std::make_shared<PointCloudRenderer>();
   auto pointclouds_renderer = std::make_shared<PointCloudsRenderer>();
   auto perception_renderer = std::make_shared<PerceptionRenderer>();
   auto marker_renderer = std::make_shared<MarkerRenderer>();
+  auto image_overlay_renderer = std::make_shared<ImageOverlayRenderer>();
+  auto hud_renderer = std::make_shared<HudRenderer>();
 
   // order in renderers_ decides order of rendering
   renderers_.push_back(view_renderer);
   renderers_.push_back(context_renderer);
+  renderers_.push_back(texturemap_renderer);
   renderers_.push_back(pointcloud_renderer);
   renderers_.push_back(pointclouds_renderer);
   renderers_.push_back(perception_renderer);
   renderers_.push_back(frame_renderer);
   renderers_.push_back(marker_renderer);
+  renderers_.push_back(image_overlay_renderer);
+  renderers_.push_back(hud_renderer);
 
 #ifdef __aarch64__
   m_program = new QOpenGLShaderProgram;
@@ -95,21 +128,107 @@ void GLWidget::initializeGL() {
 
 #endif
 
+  // large textures and clouds are uploaded on a context shared with this one
+  global_data_->upload_worker_ = std::make_shared<GLUploadWorker>();
+  global_data_->upload_worker_->start(context()->contextHandle(),
+                                      [this]() { global_data_->redraw_scheduler_->request(); });
+
+  global_data_->render_queue_ = std::make_shared<RenderQueue>();
+  global_data_->render_queue_->initialize();
   for (auto &renderer : renderers_) {
     renderer->initialize();
   }
 
-  auto timer = new QTimer();
-  QObject::connect(timer, &QTimer::timeout, [&]() { this->update(); });
-  timer->start(33);
+  static_cache_supported_ = QOpenGLFramebufferObject::hasOpenGLFramebufferObjects() &&
+                           QOpenGLFramebufferObject::hasOpenGLFramebufferBlit();
+  // a CombinedDepthStencil attachment is 24 bit depth and 8 bit stencil, blits need the
+  // same depth format and a single sampled target
+  default_depth_blittable_ = format().depthBufferSize() == 24 &&
+                             format().stencilBufferSize() == 8 && !format().sampleBuffers();
+
+  quality_.reset(new QualityController());
+  quality_->setScalable(QOpenGLFramebufferObject::hasOpenGLFramebufferObjects() &&
+                        QOpenGLFramebufferObject::hasOpenGLFramebufferBlit());
+
+  // the GUI thread takes part in parallel_for as well
+  pool_.reset(new common::ThreadPool(std::max(2u, std::thread::hardware_concurrency()) - 1));
+
+  // repaint on new data, camera motion and config changes only
+  global_data_->redraw_scheduler_->setMaxFps(global_data_->config_.max_fps());
+  global_data_->redraw_scheduler_->watchInput();
+  global_data_->redraw_scheduler_->request();
 }
 
 void GLWidget::resizeGL(int w, int h) {
   glViewport(0, 0, w, h);
   global_data_->camera_->resizeGL(w, h);
+  viewport_w_ = w;
+  viewport_h_ = h;
+}
+
+size_t GLWidget::staticLayerKey(const FrameContext &frame,
+                                const std::vector<std::shared_ptr<Renderer>> &layers) const {
+  std::string key(reinterpret_cast<const char *>(glm::value_ptr(frame.mvp)), sizeof(frame.mvp));
+  const float state[] = {float(frame.viewport_w), float(frame.viewport_h), frame.poseZ()};
+  key.append(reinterpret_cast<const char *>(state), sizeof(state));
+  for (const auto &layer : layers) {
+    const auto version = layer->layerVersion();
+    key.append(reinterpret_cast<const char *>(&version), sizeof(version));
+  }
+  return std::hash<std::string>()(key);
 }
 
 void GLWidget::paintGL() {
+  global_data_->redraw_scheduler_->onPaint();
+  const auto paint_begin = get_now_microsecond();
+
+  // uploads finished since the last frame are handed to their renderers
+  global_data_->upload_worker_->collect();
+
+  // everything renderers read while drawing this frame is copied once here
+  auto frame = std::make_shared<FrameContext>();
+  frame->sequence = ++frame_sequence_;
+  frame->utime = paint_begin;
+  frame->pose = global_data_->pose();
+  frame->config = global_data_->configSnapshot();
+  auto profiler = global_data_->profiler_.get();
+  profiler->beginFrame(frame->config->hud_renderer_enable());
+
+  quality_->configure(frame->config->adaptive_quality_enable(),
+                      frame->config->target_frame_time_ms());
+  quality_->setDevicePixelRatio(devicePixelRatioF());
+  frame->quality = quality_->settings();
+
+  std::vector<std::shared_ptr<Renderer>> static_layers;
+  for (auto &renderer : renderers_) {
+    if (renderer->isStaticLayer()) {
+      static_layers.push_back(renderer);
+    }
+  }
+
+  // over budget the scene is drawn smaller offscreen and stretched to the widget
+  frame->viewport_w = viewport_w_;
+  frame->viewport_h = viewport_h_;
+  const bool scaled = frame->quality.render_scale < 1.f;
+  if (scaled) {
+    frame->viewport_w = std::max(1, int(viewport_w_ * frame->quality.render_scale));
+    frame->viewport_h = std::max(1, int(viewport_h_ * frame->quality.render_scale));
+    if (!fbo_ || fbo_->width() != frame->viewport_w || fbo_->height() != frame->viewport_h) {
+      fbo_.reset(new QOpenGLFramebufferObject(frame->viewport_w, frame->viewport_h,
+                                              QOpenGLFramebufferObject::CombinedDepthStencil));
+    }
+    fbo_->bind();
+    glViewport(0, 0, frame->viewport_w, frame->viewport_h);
+    global_data_->camera_->resizeGL(frame->viewport_w, frame->viewport_h);
+  } else {
+    fbo_.reset();
+  }
+
+  // the cache is copied with its depth into the framebuffer the scene is drawn to, which
+  // needs the same depth format
+  const bool cache_static = !static_layers.empty() && static_cache_supported_ &&
+                            (scaled || default_depth_blittable_);
+
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_BLEND);
@@ -117,17 +236,19 @@ void GLWidget::paintGL() {
   glEnable(GL_POINT_SMOOTH);
   glEnable(GL_LINE_SMOOTH);
 
-  global_data_->camera_->setLookatZ(global_data_->pose()->pose().position().z());
+  global_data_->camera_->setLookatZ(frame->poseZ());
   global_data_->camera_->paintGL();
+  frame->projection_matrix = global_data_->camera_->getProjectionMatrix();
+  frame->model_matrix = global_data_->camera_->getModelMatrix();
+  frame->mvp = glm::mat4(frame->projection_matrix * frame->model_matrix);
+  frame->eye_distance = global_data_->camera_->getEyeDistance();
+  frame->eye = global_data_->camera_->getEye();
 
 #ifdef __aarch64__
-  glm::dmat4x4 project_tmp = global_data_->camera_->getProjectionMatrix();
-  glm::dmat4x4 model_tmp = global_data_->camera_->getModelMatrix();
-
   for (int i = 0; i <4;i++) {
     for (int j = 0; j < 4; j++) {
-      m_model(i,j) = model_tmp[j][i];
-      m_proj(i,j) = project_tmp[j][i];     
+      m_model(i,j) = frame->model_matrix[j][i];
+      m_proj(i,j) = frame->projection_matrix[j][i];
     }
   }
 
@@ -136,28 +257,128 @@ void GLWidget::paintGL() {
   m_program->setUniformValue(m_mvMatrixLoc, m_model);
 #endif
 
+  // CPU side work of all renderers and channels in parallel, each channel is degraded
+  // together with the renderer that scheduled it
+  std::vector<Renderer *> tasks;
+  std::vector<const Renderer *> owners;
   for (auto &renderer : renderers_) {
-    if (global_data_->config_.has_default_color()) {
-      const auto &color = global_data_->config_.default_color();
+    renderer->schedule(&tasks);
+    owners.resize(tasks.size(), renderer.get());
+    if (quality_->degraded(renderer.get())) {
+      const auto settings = quality_->settings(renderer.get());
+      frame->renderer_quality[renderer.get()] = settings;
+      for (size_t i = owners.size(); i-- > 0 && owners[i] == renderer.get();) {
+        frame->renderer_quality[tasks[i]] = settings;
+      }
+    }
+  }
+  std::vector<uint64_t> prepare_us(tasks.size(), 0);
+  pool_->parallel_for(tasks.size(), [&](size_t i) {
+    try {
+      const auto begin = get_now_microsecond();
+      tasks[i]->prepare(frame);
+      prepare_us[i] = get_now_microsecond() - begin;
+      profiler->addPrepare(tasks[i], prepare_us[i]);
+    } catch (std::exception &e) {
+      LOG(ERROR) << tasks[i]->name() << ": " << e.what();
+    }
+  });
+
+  std::unordered_map<const Renderer *, float> costs;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    costs[owners[i]] += prepare_us[i] / 1000.f;
+  }
+
+  auto submit = [&](const std::shared_ptr<Renderer> &renderer) {
+    if (frame->config->has_default_color()) {
+      const auto &color = frame->config->default_color();
       glColor4f(color.r(), color.g(), color.b(), color.a());
     }
-    if (global_data_->config_.has_default_point_size()) {
-      glPointSize(global_data_->config_.default_point_size());
+    if (frame->config->has_default_point_size()) {
+      glPointSize(frame->config->default_point_size());
     }
-    if (global_data_->config_.has_default_line_width()) {
-      glLineWidth(global_data_->config_.default_line_width());
+    if (frame->config->has_default_line_width()) {
+      glLineWidth(frame->config->default_line_width());
     }
 
+    const auto begin = get_now_microsecond();
     try {
       GLPushGuard pg;
-      renderer->render();
+      FrameProfiler::Scope scope(profiler, renderer.get());
+      renderer->submit();
+      global_data_->render_queue_->flush();
     } catch (std::exception &e) {
+      global_data_->render_queue_->discard();
       LOG(ERROR) << renderer->name() << ": " << e.what();
     }
+    costs[renderer.get()] += (get_now_microsecond() - begin) / 1000.f;
+  };
+
+  // static layers come first and are copied from their cache while nothing changed
+  if (cache_static) {
+    const auto key = staticLayerKey(*frame, static_layers);
+    if (!static_fbo_ || static_fbo_->width() != frame->viewport_w ||
+        static_fbo_->height() != frame->viewport_h) {
+      static_fbo_.reset(new QOpenGLFramebufferObject(
+          frame->viewport_w, frame->viewport_h, QOpenGLFramebufferObject::CombinedDepthStencil));
+      static_key_ = 0;
+    }
+    if (key != static_key_) {
+      static_fbo_->bind();
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      for (auto &renderer : static_layers) {
+        submit(renderer);
+      }
+      static_fbo_->release();
+      if (scaled) {
+        fbo_->bind();
+      }
+      static_key_ = key;
+    } else {
+      for (auto &renderer : static_layers) {
+        renderer->touchCached();
+      }
+    }
+    // one copy of color and depth, so dynamic layers are still hidden below the static ones
+    const QRect rect(0, 0, frame->viewport_w, frame->viewport_h);
+    QOpenGLFramebufferObject::blitFramebuffer(fbo_.get(), rect, static_fbo_.get(), rect,
+                                              GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+                                              GL_NEAREST);
+  } else {
+    for (auto &renderer : static_layers) {
+      submit(renderer);
+    }
+  }
+
+  for (auto &renderer : renderers_) {
+    if (!renderer->isStaticLayer()) {
+      submit(renderer);
+    }
   }
 #ifdef __aarch64__
   m_program->release();
 #endif
+
+  if (scaled) {
+    fbo_->release();
+    glViewport(0, 0, viewport_w_, viewport_h_);
+    global_data_->camera_->resizeGL(viewport_w_, viewport_h_);
+    QOpenGLFramebufferObject::blitFramebuffer(
+        nullptr, QRect(0, 0, viewport_w_, viewport_h_), fbo_.get(),
+        QRect(0, 0, frame->viewport_w, frame->viewport_h), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  }
+
+  global_data_->gpu_resources_->setBudget(
+      size_t(frame->config->gpu_memory_budget_mb()) << 20);
+  global_data_->gpu_resources_->enforce();
+
+  quality_->update((get_now_microsecond() - paint_begin) / 1000.f, costs);
+  // a static view is not painted again by itself, quality could not recover
+  if (quality_->degraded()) {
+    global_data_->redraw_scheduler_->request();
+  }
+  profiler->endFrame();
+  global_data_->frame_arena_->reset();
 }
 
 void GLWidget::mousePressEvent(QMouseEvent *e) {
@@ -202,6 +423,10 @@ void GLWidget::mouseReleaseEvent(QMouseEvent *e) {
 }
 
 void GLWidget::mouseMoveEvent(QMouseEvent *e) {
+  if (global_data_->measuring_ || e->buttons() != Qt::NoButton) {
+    global_data_->redraw_scheduler_->request();
+  }
+
   if (global_data_->measuring_) {
     global_data_->pt_mouse_current_ = e->pos();
 
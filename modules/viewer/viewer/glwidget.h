@@ -3,6 +3,7 @@
 #include <QGLWidget>
 #include <list>
 #include <memory>
+#include <vector>
 #ifdef __aarch64__
 #include <QOpenGLFunctions>
 #include <QOpenGLVertexArrayObject>
@@ -12,15 +13,24 @@
 QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
 #endif
 
+QT_FORWARD_DECLARE_CLASS(QOpenGLFramebufferObject)
+
 namespace crdc {
 namespace airi {
 
+namespace common {
+class ThreadPool;
+}
+
 class GlobalData;
+class QualityController;
 class Renderer;
+struct FrameContext;
 
 class GLWidget : public QGLWidget {
  public:
   GLWidget();
+  ~GLWidget() override;
 #ifdef __aarch64__
   void setColor(QVector4D color);
 #endif
@@ -39,9 +49,26 @@ class GLWidget : public QGLWidget {
   void mouseMoveEvent(QMouseEvent *e) override;
   void wheelEvent(QWheelEvent *e) override;
 
+ protected:
+  // changes with the camera, the viewport, the config and the layer versions
+  size_t staticLayerKey(const FrameContext &frame,
+                        const std::vector<std::shared_ptr<Renderer>> &layers) const;
+
  protected:
   GlobalData *global_data_;
   std::list<std::shared_ptr<Renderer>> renderers_;
+  std::shared_ptr<common::ThreadPool> pool_;
+  uint64_t frame_sequence_{0};
+  std::shared_ptr<QualityController> quality_;
+  std::shared_ptr<QOpenGLFramebufferObject> fbo_;
+  int viewport_w_{0};
+  int viewport_h_{0};
+  bool static_cache_supported_{false};
+  // depth of the window can be blitted from a framebuffer object, otherwise static layers
+  // are only cached while drawing offscreen anyway
+  bool default_depth_blittable_{false};
+  std::shared_ptr<QOpenGLFramebufferObject> static_fbo_;
+  size_t static_key_{0};
 #ifdef __aarch64__
   QOpenGLVertexArrayObject m_vao;
   QOpenGLShaderProgram *m_program;
@@ -0,0 +1,130 @@
+#include "viewer/gpu_resource_manager.h"
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace crdc {
+namespace airi {
+
+GpuLease::~GpuLease() {
+  if (auto manager = manager_.lock()) {
+    manager->release(id_);
+  }
+}
+
+void GpuResourceManager::setBudget(const size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  budget_ = bytes;
+}
+
+std::shared_ptr<GpuLease> GpuResourceManager::track(const std::string &owner, const size_t bytes,
+                                                    const Evictor &evictor) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto id = ++next_id_;
+  auto &entry = entries_[id];
+  entry.owner = owner;
+  entry.bytes = bytes;
+  entry.evictor = evictor;
+  entry.lru = lru_.insert(lru_.begin(), id);
+  used_ += bytes;
+  return std::make_shared<GpuLease>(id, shared_from_this());
+}
+
+void GpuResourceManager::setEvictor(const std::shared_ptr<GpuLease> &lease,
+                                    const Evictor &evictor) {
+  if (!lease) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(lease->id());
+  if (it != entries_.end()) {
+    it->second.evictor = evictor;
+  }
+}
+
+void GpuResourceManager::touch(const std::shared_ptr<GpuLease> &lease) {
+  if (!lease) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(lease->id());
+  if (it != entries_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+  }
+}
+
+void GpuResourceManager::enforce() {
+  // evictors drop leases, which lock again, so they are called unlocked
+  std::vector<std::pair<uint64_t, Evictor>> candidates;
+  size_t excess = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (budget_ == 0 || used_ <= budget_) {
+      return;
+    }
+    excess = used_ - budget_;
+    size_t planned = 0;
+    for (auto it = lru_.rbegin(); it != lru_.rend() && planned < excess; ++it) {
+      const auto &entry = entries_.at(*it);
+      if (entry.evictor) {
+        candidates.emplace_back(*it, entry.evictor);
+        planned += entry.bytes;
+      }
+    }
+  }
+
+  size_t evicted = 0;
+  for (const auto &candidate : candidates) {
+    if (used() <= budget()) {
+      break;
+    }
+    if (candidate.second()) {
+      ++evicted;
+      // in case the owner still holds a copy of the lease
+      release(candidate.first);
+    }
+  }
+  if (evicted > 0) {
+    LOG(INFO) << "GPU memory over budget by " << excess / (1 << 20) << " MB, evicted "
+              << evicted << " resources";
+  }
+}
+
+size_t GpuResourceManager::used() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return used_;
+}
+
+size_t GpuResourceManager::budget() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return budget_;
+}
+
+std::vector<std::pair<std::string, size_t>> GpuResourceManager::usage() const {
+  std::unordered_map<std::string, size_t> owners;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : entries_) {
+      owners[entry.second.owner] += entry.second.bytes;
+    }
+  }
+  std::vector<std::pair<std::string, size_t>> usage(owners.begin(), owners.end());
+  std::sort(usage.begin(), usage.end(),
+            [](const std::pair<std::string, size_t> &a, const std::pair<std::string, size_t> &b) {
+              return a.second > b.second;
+            });
+  return usage;
+}
+
+void GpuResourceManager::release(const uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+  used_ -= it->second.bytes;
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+}  // namespace airi
+}  // namespace crdc
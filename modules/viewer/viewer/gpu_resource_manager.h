@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace crdc {
+namespace airi {
+
+class GpuResourceManager;
+
+// accounts the bytes of one GL resource while any copy of its buffer or texture lives
+class GpuLease {
+ public:
+  GpuLease(const uint64_t id, const std::weak_ptr<GpuResourceManager> &manager)
+      : id_(id), manager_(manager) {}
+  ~GpuLease();
+
+  uint64_t id() const { return id_; }
+
+ protected:
+  const uint64_t id_;
+  std::weak_ptr<GpuResourceManager> manager_;
+};
+
+/**
+ * @brief Tracks the VRAM of all buffers and textures per owner and keeps it under
+ *        the configured budget by evicting the least recently drawn resources
+ *        that can be rebuilt or dropped, e.g. old cloud frames or off-screen tiles.
+ */
+class GpuResourceManager : public std::enable_shared_from_this<GpuResourceManager> {
+ public:
+  // frees the resource and returns true, or false if it must stay for now
+  using Evictor = std::function<bool()>;
+
+ public:
+  // 0 disables the budget
+  void setBudget(const size_t bytes);
+
+  // thread safe, without an evictor the resource is only accounted
+  std::shared_ptr<GpuLease> track(const std::string &owner, const size_t bytes,
+                                  const Evictor &evictor = nullptr);
+
+  void setEvictor(const std::shared_ptr<GpuLease> &lease, const Evictor &evictor);
+
+  // marks the resource as drawn
+  void touch(const std::shared_ptr<GpuLease> &lease);
+
+  // GUI thread with the GL context current, evictors free GL objects
+  void enforce();
+
+  size_t used() const;
+  size_t budget() const;
+
+  // bytes per owner, largest first
+  std::vector<std::pair<std::string, size_t>> usage() const;
+
+ protected:
+  friend class GpuLease;
+
+  void release(const uint64_t id);
+
+ protected:
+  struct Entry {
+    std::string owner;
+    size_t bytes{0};
+    Evictor evictor;
+    std::list<uint64_t>::iterator lru;
+  };
+
+  mutable std::mutex mutex_;
+  size_t budget_{0};
+  size_t used_{0};
+  uint64_t next_id_{0};
+  // most recently drawn first
+  std::list<uint64_t> lru_;
+  std::unordered_map<uint64_t, Entry> entries_;
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -1,11 +1,10 @@
 #include "viewer/image_player.h"
 #include <QCheckBox>
-#include <QPainter>
-#include <QTimer>
 #include "common/common.h"
-#include "viewer/util/image_conversion.h"
 #include "viewer/global_data.h"
 #include "viewer/glwidget.h"
+#include "viewer/image_service.h"
+#include "viewer/redraw_scheduler.h"
 
 namespace crdc {
 namespace airi {
@@ -80,7 +79,6 @@ void applyImageMarkerList(cv::Mat &image, const ImageMarkerList &marker_list) {
 
 ImagePlayer::ImagePlayer() {
   auto global_data = crdc::airi::common::Singleton<GlobalData>::get();
-  crdc::airi::util::init_h264_decoder();
   this->setFocusPolicy(Qt::NoFocus);
   this->setParent(global_data->glwidget_);
   this->setGeometry(0, 0, 200, 100);
@@ -93,31 +91,87 @@ ImagePlayer::ImagePlayer() {
   cb_channel_->addItem("OFF");
   cb_channel_->setStyleSheet("background-color: gray");
   cb_channel_->setFocusPolicy(Qt::NoFocus);
+  QObject::connect(cb_channel_, &QComboBox::currentTextChanged, [&](const QString &text) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      current_channel_ = text.toStdString();
+    }
+    updateWatch();
+    this->update();
+  });
 
-  global_data->message_hub_->subscribe<crdc::airi::Image2>(
-      [&](const std::string &channel, const std::shared_ptr<crdc::airi::Image2> &msg) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        proto_images_[channel] = msg;
-        needs_update_[channel] = true;
-        seen_channels_.insert(channel);
-      });
+  // repaint only while shown and when the displayed channel or the channel list changed
+  redraw_scheduler_.reset(new RedrawScheduler(this, 10.f));
+
+  listener_id_ = global_data->image_service_->addListener([&](const std::string &channel) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const bool is_new = seen_channels_.insert(channel).second;
+    if (visible_ && (is_new || channel == current_channel_)) {
+      redraw_scheduler_->request();
+    }
+    // new frames are uploaded and drawn by the GL widget
+    if (visible_ && channel == current_channel_) {
+      crdc::airi::common::Singleton<GlobalData>::get()->redraw_scheduler_->request();
+    }
+  });
 
   global_data->message_hub_->subscribe<ImageMarkerList>(
       [&](const std::string &channel, const std::shared_ptr<ImageMarkerList> &msg) {
         std::lock_guard<std::mutex> lock(mutex_marker_);
         marker_lists_[channel] = msg;
       });
-
-  auto timer = new QTimer();
-  QObject::connect(timer, &QTimer::timeout, [&]() { this->update(); });
-  timer->start(100);
 }
 
 ImagePlayer::~ImagePlayer() {
-  crdc::airi::util::deinit_h264_decoder();
+  auto image_service = crdc::airi::common::Singleton<GlobalData>::get()->image_service_;
+  image_service->removeListener(listener_id_);
+  if (!watched_channel_.empty()) {
+    image_service->unwatch(watched_channel_, watched_size_);
+  }
+}
+
+void ImagePlayer::showEvent(QShowEvent *) {
+  visible_ = true;
+  updateWatch();
+}
+
+void ImagePlayer::hideEvent(QHideEvent *) {
+  visible_ = false;
+  updateWatch();
+}
+
+void ImagePlayer::resizeEvent(QResizeEvent *) { updateWatch(); }
+
+void ImagePlayer::updateWatch() {
+  auto global_data = crdc::airi::common::Singleton<GlobalData>::get();
+  // the overlay of the GL widget follows the shown channel
+  global_data->redraw_scheduler_->request();
+
+  std::string channel;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (visible_ && current_channel_ != "OFF") {
+      channel = current_channel_;
+    }
+  }
+  // in device pixels, enlarged players get the full resolution back with the next frame
+  const double ratio = devicePixelRatioF();
+  const cv::Size size(std::ceil(width() * ratio), std::ceil(height() * ratio));
+  if (channel == watched_channel_ && size == watched_size_) {
+    return;
+  }
+  if (!watched_channel_.empty()) {
+    global_data->image_service_->unwatch(watched_channel_, watched_size_);
+  }
+  if (!channel.empty()) {
+    global_data->image_service_->watch(channel, size);
+  }
+  watched_channel_ = channel;
+  watched_size_ = size;
 }
 
 void ImagePlayer::paintEvent(QPaintEvent *) {
+  redraw_scheduler_->onPaint();
   auto global_data = crdc::airi::common::Singleton<GlobalData>::get();
   std::lock_guard<std::mutex> lock(mutex_);
   for (const auto &channel : seen_channels_) {
@@ -132,17 +186,18 @@ void ImagePlayer::paintEvent(QPaintEvent *) {
     return;
   }
 
-  if (needs_update_[channel]) {
-    needs_update_[channel] = false;
-    crdc::airi::util::convert_from_proto(*proto_images_[channel], &images_[channel]);
-    if (proto_images_[channel]->type() == std::to_string(crdc::airi::BGR8)) {
-      cv::cvtColor(images_[channel], images_[channel], CV_BGR2RGB);
-    }
-  }
+  const auto stats = global_data->image_service_->stats()[channel];
+  cb_channel_->setToolTip(QString("decoded %1, converted %2, skipped %3")
+                              .arg(stats.decoded)
+                              .arg(stats.converted)
+                              .arg(stats.skipped));
 
-  cv::Mat image = images_[channel].clone();
+  auto image = global_data->image_service_->latest(channel);
+  if (!image) {
+    return;
+  }
+  image_ = image;
 
-  auto qimg = QImage(image.data, image.cols, image.rows, QImage::Format::Format_RGB888);
   static std::string mining_path;
   static std::string mining_package;
   if (global_data->is_mining_) {
@@ -155,16 +210,18 @@ void ImagePlayer::paintEvent(QPaintEvent *) {
         mining_path = std::string(std::getenv("CRDC_EXPORT"));
       }
 
-      // dump all received channel images
-      for (auto iter = proto_images_.begin(); iter != proto_images_.end(); ++iter){
-        cv::Mat image_dump = image.clone();
-
-        crdc::airi::util::convert_from_proto(*proto_images_[iter->first], &image_dump);
-        cv::cvtColor(image_dump, image_dump, CV_BGRA2RGB);
+      // dump the latest image of all received channels
+      for (const auto &name : global_data->image_service_->channels()) {
+        const auto decoded = global_data->image_service_->snapshot(name);
+        if (!decoded) {
+          continue;
+        }
+        cv::Mat image_dump;
+        cv::cvtColor(decoded->rgb(), image_dump, cv::COLOR_RGB2BGR);
 
         if (crdc::airi::util::is_path_exists(mining_path)) {
           const auto save_dir_ = mining_path + "/" + mining_package + "/data_mining/" +
-                                 iter->first + "/";
+                                 name + "/";
           if (!crdc::airi::util::is_directory_exists(save_dir_)) {
             if (!crdc::airi::util::ensure_directory(save_dir_)) {
               LOG(ERROR) << "Data mining saving directory could not be created!";
@@ -172,7 +229,7 @@ void ImagePlayer::paintEvent(QPaintEvent *) {
             }
           }
           const auto save_path_ = save_dir_ +
-                                  std::to_string(proto_images_[iter->first]->header().timestamp_sec()) +
+                                  std::to_string(decoded->proto->header().timestamp_sec()) +
                                   ".png";
           LOG(INFO) << "Data mining: " << save_path_;
           cv::imwrite(save_path_, image_dump); // png compression param is 3 by default
@@ -187,20 +244,17 @@ void ImagePlayer::paintEvent(QPaintEvent *) {
 
   global_data->is_mining_ = false;
 
-  // adjust widget to fit image ratio
-  float image_ratio = float(qimg.height()) / qimg.width();
+  // adjust widget to fit image ratio, the image itself is drawn by the GL widget
+  float image_ratio = float(image->height) / image->width;
   float widget_ratio = float(height()) / width();
   if (std::fabs(image_ratio - widget_ratio) > 0.01f) {
     setFixedHeight(width() * image_ratio);
   }
+}
 
-  // rescale image to fit widget size
-  qimg = qimg.scaled(this->width(), this->height());
-
-  // paint image
-  auto painter = new QPainter(this);
-  painter->drawImage(QPoint(0, 0), qimg);
-  painter->end();
+std::string ImagePlayer::channel() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return current_channel_;
 }
 
 void ImagePlayer::mousePressEvent(QMouseEvent *event) {
@@ -235,10 +289,9 @@ void ImagePlayer::mouseMoveEvent(QMouseEvent *event) {
       this->move(tl_point_ + distance);
     } else {
       const auto diff = event->pos() - pos_start_;
-      const auto current_item = images_.find(cb_channel_->currentText().toStdString());
-      const float ratio = (current_item == images_.end()
+      const float ratio = (!image_ || image_->width <= 0 || image_->height <= 0
                               ? 16.0f / 9
-                              : current_item->second.cols * 1.0f / current_item->second.rows);
+                              : image_->width * 1.0f / image_->height);
       QSize new_size;
       switch (mouse_pos_) {
         case MousePosition::RIGHT_BOTTOM:
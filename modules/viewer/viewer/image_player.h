@@ -3,7 +3,11 @@
 #include <QComboBox>
 #include <QMouseEvent>
 #include <QPaintEvent>
+#include <QResizeEvent>
+#include <QShowEvent>
 #include <QWidget>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <opencv2/opencv.hpp>
 #include <set>
@@ -17,6 +21,9 @@
 namespace crdc {
 namespace airi {
 
+class RedrawScheduler;
+struct DecodedImage;
+
 class ImagePlayer : public QWidget {
   enum MousePosition { NORMAL = 0, RIGHT_BOTTOM, RIGHT, BOTTOM };
 
@@ -24,23 +31,40 @@ class ImagePlayer : public QWidget {
   ImagePlayer();
   ~ImagePlayer();
 
+ public:
+  // thread safe, "OFF" if no channel is shown
+  std::string channel() const;
+
  protected:
   void paintEvent(QPaintEvent *event) override;
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
 
  protected:
   void mousePressEvent(QMouseEvent *event) override;
   void mouseReleaseEvent(QMouseEvent *event) override;
   void mouseMoveEvent(QMouseEvent *event) override;
 
+ protected:
+  // only the channel of a shown player is converted, at the size it is shown at
+  void updateWatch();
+
  protected:
   QComboBox *cb_channel_;
   QCheckBox *cb_marker_;
   std::set<std::string> seen_channels_;
   std::set<std::string> show_channels_;
-  std::unordered_map<std::string, std::shared_ptr<crdc::airi::Image2>> proto_images_;
-  std::unordered_map<std::string, cv::Mat> images_;
-  std::unordered_map<std::string, bool> needs_update_;
-  std::mutex mutex_;
+  // decoded by the image service, shared with the other players
+  std::shared_ptr<const DecodedImage> image_;
+  size_t listener_id_{0};
+  std::string watched_channel_;
+  cv::Size watched_size_;
+  std::string current_channel_{"OFF"};
+  mutable std::mutex mutex_;
+
+  std::shared_ptr<RedrawScheduler> redraw_scheduler_;
+  std::atomic<bool> visible_{false};
 
   std::unordered_map<std::string, std::shared_ptr<ImageMarkerList>> marker_lists_;
   std::mutex mutex_marker_;
@@ -0,0 +1,575 @@
+#include "viewer/image_service.h"
+#include <algorithm>
+#include "viewer/global_data.h"
+#include "viewer/message/message_hub.h"
+#include "viewer/util/image_conversion.h"
+
+namespace crdc {
+namespace airi {
+
+namespace {
+
+// h264 and hevc packets a channel may fall behind before its stream is restarted
+const size_t kMaxPendingPackets = 30;
+
+// packets queued before non-reference frames resp. all but key frames are skipped
+const int kSkipNonRefBacklog = 3;
+const int kSkipNonKeyBacklog = 10;
+
+// slice threads of every video decoder, the channels already decode in parallel
+const int kDecoderThreads = 2;
+
+// images are only scaled down in the decoder if they are shown at this fraction of
+// their width and height or less, the GPU scales the rest
+const double kMaxReduction = 0.7;
+
+// scale of a width x height image to cover the target, 1 if it is not reduced
+double reduction(const int width, const int height, const cv::Size &target) {
+  if (target.empty() || width <= 0 || height <= 0) {
+    return 1.0;
+  }
+  const double scale = std::max(static_cast<double>(target.width) / width,
+                                static_cast<double>(target.height) / height);
+  return scale > kMaxReduction ? 1.0 : scale;
+}
+
+// imdecode flag of the largest jpeg dct scaling that still covers the target
+int jpegReduction(const int width, const int height, const cv::Size &target, bool *reduced,
+                  int *factor) {
+  const double scale = reduction(width, height, target);
+  *reduced = true;
+  if (scale <= 0.125) {
+    *factor = 8;
+    return cv::IMREAD_REDUCED_COLOR_8;
+  } else if (scale <= 0.25) {
+    *factor = 4;
+    return cv::IMREAD_REDUCED_COLOR_4;
+  } else if (scale <= 0.5) {
+    *factor = 2;
+    return cv::IMREAD_REDUCED_COLOR_2;
+  }
+  *reduced = false;
+  *factor = 1;
+  return cv::IMREAD_COLOR;
+}
+
+}  // namespace
+
+ImageService::ImageService(const size_t num_threads)
+    : buffers_(std::make_shared<common::FrameBufferPool>(4 * num_threads)),
+      pool_(new common::ThreadPool(num_threads)) {}
+
+void ImageService::initialize() {
+  auto global_data = crdc::airi::common::Singleton<GlobalData>::get();
+  global_data->message_hub_->subscribe<crdc::airi::Image2>(
+      [this](const std::string &channel, const std::shared_ptr<crdc::airi::Image2> &msg) {
+        onImage(channel, msg);
+      });
+}
+
+size_t ImageService::addListener(const Listener &listener) {
+  std::lock_guard<std::mutex> lock(mutex_listeners_);
+  listeners_[next_listener_] = listener;
+  return next_listener_++;
+}
+
+void ImageService::removeListener(const size_t id) {
+  std::lock_guard<std::mutex> lock(mutex_listeners_);
+  listeners_.erase(id);
+}
+
+void ImageService::watch(const std::string &name, const cv::Size &size) {
+  auto channel = find(name);
+  if (!channel) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(channel->mutex);
+    channel->views.push_back(size);
+    if (channel->views.size() > 1) {
+      return;
+    }
+  }
+
+  // the newest frame is shown right away instead of with the next one
+  pool_->enqueue([this, name, channel]() {
+    bool converted = false;
+    {
+      std::lock_guard<std::mutex> lock(channel->mutex_decoder);
+      cv::Size size;
+      {
+        std::lock_guard<std::mutex> lock(channel->mutex);
+        size = target(*channel);
+      }
+      converted = convert(channel, size);
+    }
+    if (converted) {
+      notify(name);
+    }
+  });
+}
+
+void ImageService::unwatch(const std::string &name, const cv::Size &size) {
+  auto channel = find(name);
+  if (!channel) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(channel->mutex);
+  auto it = std::find(channel->views.begin(), channel->views.end(), size);
+  if (it != channel->views.end()) {
+    channel->views.erase(it);
+  }
+}
+
+cv::Size ImageService::target(const Channel &channel) const {
+  cv::Size size;
+  for (const auto &view : channel.views) {
+    if (view.empty()) {
+      return cv::Size();
+    }
+    size.width = std::max(size.width, view.width);
+    size.height = std::max(size.height, view.height);
+  }
+  return size;
+}
+
+std::vector<std::string> ImageService::channels() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> names;
+  for (const auto &channel : channels_) {
+    names.push_back(channel.first);
+  }
+  return names;
+}
+
+std::shared_ptr<const DecodedImage> ImageService::latest(const std::string &name) const {
+  auto channel = find(name);
+  if (!channel) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(channel->mutex);
+  return channel->latest;
+}
+
+std::shared_ptr<const DecodedImage> ImageService::snapshot(const std::string &name) {
+  auto channel = find(name);
+  if (!channel) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock_decoder(channel->mutex_decoder);
+  convert(channel, cv::Size());
+  std::shared_ptr<const DecodedImage> latest;
+  {
+    std::lock_guard<std::mutex> lock(channel->mutex);
+    latest = channel->latest;
+  }
+  if (!latest || !latest->reduced) {
+    return latest;
+  }
+
+  // shown smaller, decoded again in full resolution for the caller only
+  auto full = std::make_shared<DecodedImage>();
+  full->proto = latest->proto;
+  full->sequence = latest->sequence;
+  const bool ok = latest->frame ? fromFrame(latest->frame, full.get())
+                                : fromProto(*latest->proto, cv::Size(), full.get());
+  return ok ? full : latest;
+}
+
+std::unordered_map<std::string, ImageStats> ImageService::stats() const {
+  std::unordered_map<std::string, std::shared_ptr<Channel>> channels;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    channels = channels_;
+  }
+  std::unordered_map<std::string, ImageStats> stats;
+  for (const auto &channel : channels) {
+    std::lock_guard<std::mutex> lock(channel.second->mutex);
+    stats[channel.first] = channel.second->stats;
+  }
+  return stats;
+}
+
+std::shared_ptr<ImageService::Channel> ImageService::find(const std::string &name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = channels_.find(name);
+  return it == channels_.end() ? nullptr : it->second;
+}
+
+void ImageService::onImage(const std::string &name,
+                           const std::shared_ptr<crdc::airi::Image2> &msg) {
+  std::shared_ptr<Channel> channel;
+  bool is_new = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &entry = channels_[name];
+    if (!entry) {
+      entry = std::make_shared<Channel>();
+      is_new = true;
+    }
+    channel = entry;
+  }
+
+  bool start = false;
+  {
+    std::lock_guard<std::mutex> lock(channel->mutex);
+    if (!util::is_video_stream(*msg)) {
+      channel->pending.clear();
+    } else if (channel->pending.size() >= kMaxPendingPackets) {
+      // skipping packets breaks the P-frames after them, a new decoder waits for a key frame
+      LOG(WARNING) << "Decoding of " << name << " falls behind, restarting the stream";
+      channel->pending.clear();
+      channel->pending.push_back(nullptr);
+    }
+    channel->pending.push_back(msg);
+    if (!channel->decoding) {
+      channel->decoding = true;
+      start = true;
+    }
+  }
+
+  if (start) {
+    pool_->enqueue([this, name, channel]() { decode(name, channel); });
+  }
+  if (is_new) {
+    notify(name);
+  }
+}
+
+void ImageService::decode(const std::string &name, const std::shared_ptr<Channel> &channel) {
+  while (true) {
+    std::shared_ptr<const crdc::airi::Image2> msg;
+    size_t backlog = 0;
+    {
+      std::lock_guard<std::mutex> lock(channel->mutex);
+      if (channel->pending.empty()) {
+        channel->decoding = false;
+        return;
+      }
+      msg = channel->pending.front();
+      channel->pending.pop_front();
+      backlog = channel->pending.size();
+    }
+
+    bool converted = false;
+    {
+      std::lock_guard<std::mutex> lock_decoder(channel->mutex_decoder);
+      if (!msg) {
+        // restart of the stream
+        channel->decoder.reset();
+        channel->unconverted.reset();
+        continue;
+      }
+
+      // other streams are only decoded when they are converted
+      uint64_t decoded = 0;
+      uint64_t skipped = 0;
+      bool has_frame = true;
+      if (util::is_video_stream(*msg)) {
+        if (!channel->decoder) {
+          channel->decoder = util::create_video_decoder(kDecoderThreads);
+          if (channel->decoder) {
+            channel->decoder->auto_convert = 0;
+            crdc::airi::decoder_set_low_latency(channel->decoder.get(), kSkipNonRefBacklog,
+                                                kSkipNonKeyBacklog);
+          }
+        }
+        if (!channel->decoder) {
+          continue;
+        }
+        // every packet goes through the decoder unless it falls behind, the conversion waits
+        crdc::airi::decoder_set_backlog(channel->decoder.get(), backlog);
+        skipped = channel->decoder->skipped_frames;
+        const int frames = crdc::airi::decoder_parse(
+            channel->decoder.get(),
+            reinterpret_cast<uint8_t *>(const_cast<char *>(msg->data().data())),
+            msg->data().size());
+        decoded = std::max(frames, 0);
+        skipped = channel->decoder->skipped_frames - skipped;
+        has_frame = frames > 0;
+      }
+      if (has_frame) {
+        channel->unconverted = msg;
+      }
+
+      bool watched = false;
+      cv::Size size;
+      {
+        std::lock_guard<std::mutex> lock(channel->mutex);
+        channel->stats.decoded += decoded;
+        channel->stats.skipped += skipped;
+        // newer packets overwrite the frame anyway
+        watched = !channel->views.empty() && channel->pending.empty();
+        size = target(*channel);
+      }
+      if (watched) {
+        converted = convert(channel, size);
+      }
+    }
+    if (converted) {
+      notify(name);
+    }
+  }
+}
+
+bool ImageService::convert(const std::shared_ptr<Channel> &channel, const cv::Size &target) {
+  auto msg = channel->unconverted;
+  if (!msg) {
+    return false;
+  }
+  channel->unconverted.reset();
+
+  auto decoded = std::make_shared<DecodedImage>();
+  decoded->proto = msg;
+  if (util::is_video_stream(*msg)) {
+    if (!fromDecoder(channel->decoder.get(), target, decoded.get())) {
+      return false;
+    }
+  } else {
+    const bool ok = fromProto(*msg, target, decoded.get());
+    std::lock_guard<std::mutex> lock(channel->mutex);
+    ++channel->stats.decoded;
+    if (!ok) {
+      return false;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(channel->mutex);
+  decoded->sequence = ++channel->sequence;
+  channel->latest = decoded;
+  ++channel->stats.converted;
+  return true;
+}
+
+bool ImageService::fromDecoder(crdc::airi::H264DecoderData *decoder, const cv::Size &target,
+                               DecodedImage *decoded) const {
+  if (!decoder || !decoder->frame_pending) {
+    return false;
+  }
+
+  const auto latest = decoder->pFrameLatest;
+  const int format = latest->format;
+  const double scale = reduction(latest->width, latest->height, target);
+  if (scale >= 1.0 && (format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P ||
+                       format == AV_PIX_FMT_GBRP)) {
+    std::shared_ptr<AVFrame> frame(crdc::airi::decoder_receive_frame(decoder),
+                                   [](AVFrame *frame) { av_frame_free(&frame); });
+    return frame && fromFrame(frame, decoded);
+  }
+
+  // scaled and converted in one swscale pass, the frame stays referenced for export
+  std::shared_ptr<AVFrame> frame(av_frame_clone(latest),
+                                 [](AVFrame *frame) { av_frame_free(&frame); });
+  if (scale < 1.0) {
+    crdc::airi::decoder_set_output_size(
+        decoder, std::max(2, static_cast<int>(latest->width * scale) & ~1),
+        std::max(2, static_cast<int>(latest->height * scale) & ~1));
+  } else {
+    crdc::airi::decoder_set_output_size(decoder, 0, 0);
+  }
+  int w = 0;
+  int h = 0;
+  if (crdc::airi::decoder_output_size(decoder, &w, &h) < 0) {
+    return false;
+  }
+  // converted into a buffer the image owns instead of cloned out of the decoder
+  auto buffer = buffers_->acquire(size_t(w) * h * 3);
+  if (!buffer ||
+      crdc::airi::decoder_convert_frame_into(decoder, buffer.get(), w * 3, w * h * 3) < 0) {
+    return false;
+  }
+  decoded->format = DecodedImage::RGB;
+  decoded->width = w;
+  decoded->height = h;
+  decoded->planes = {cv::Mat(h, w, CV_8UC3, buffer.get())};
+  decoded->buffer = buffer;
+  decoded->reduced = scale < 1.0;
+  decoded->frame = frame;
+  return true;
+}
+
+bool ImageService::fromFrame(const std::shared_ptr<AVFrame> &frame,
+                             DecodedImage *decoded) const {
+  const int format = frame->format;
+  const int w = frame->width;
+  const int h = frame->height;
+  decoded->width = w;
+  decoded->height = h;
+  decoded->frame = frame;
+  if (format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P ||
+      format == AV_PIX_FMT_GBRP) {
+    // the planes stay in the frame's buffers as long as the image references them
+    const int cw = format == AV_PIX_FMT_GBRP ? w : (w + 1) / 2;
+    const int ch = format == AV_PIX_FMT_GBRP ? h : (h + 1) / 2;
+    decoded->format = format == AV_PIX_FMT_GBRP ? DecodedImage::GBRP : DecodedImage::I420;
+    decoded->planes = {cv::Mat(h, w, CV_8UC1, frame->data[0], frame->linesize[0]),
+                       cv::Mat(ch, cw, CV_8UC1, frame->data[1], frame->linesize[1]),
+                       cv::Mat(ch, cw, CV_8UC1, frame->data[2], frame->linesize[2])};
+    decoded->full_range =
+        format == AV_PIX_FMT_YUVJ420P || frame->color_range == AVCOL_RANGE_JPEG;
+    return true;
+  }
+
+  // other layouts go through swscale
+  auto context = sws_getContext(w, h, static_cast<AVPixelFormat>(format), w, h,
+                                AV_PIX_FMT_RGB24, SWS_BICUBIC, NULL, NULL, NULL);
+  if (!context) {
+    return false;
+  }
+  auto buffer = buffers_->acquire(size_t(w) * h * 3);
+  if (!buffer) {
+    sws_freeContext(context);
+    return false;
+  }
+  cv::Mat rgb(h, w, CV_8UC3, buffer.get());
+  uint8_t *data[4] = {rgb.data, nullptr, nullptr, nullptr};
+  int linesize[4] = {static_cast<int>(rgb.step[0]), 0, 0, 0};
+  sws_scale(context, (const uint8_t *const *)frame->data, frame->linesize, 0, h, data,
+            linesize);
+  sws_freeContext(context);
+  decoded->format = DecodedImage::RGB;
+  decoded->planes = {rgb};
+  decoded->buffer = buffer;
+  return true;
+}
+
+bool ImageService::fromProto(const crdc::airi::Image2 &msg, const cv::Size &target,
+                             DecodedImage *decoded) const {
+  auto data = reinterpret_cast<uchar *>(const_cast<char *>(msg.data().data()));
+  const size_t size = msg.data().size();
+  const int w = msg.width();
+  const int h = msg.height();
+
+  if (msg.compression() == crdc::airi::Image2_Compression_RAW) {
+    const auto &type = msg.type();
+    if (type == std::to_string(crdc::airi::MONO8) || type == std::string("Y")) {
+      const size_t step = msg.step() > 0 ? msg.step() : w;
+      if (size < step * h) {
+        LOG(ERROR) << "Image of " << size << " bytes is too small for " << w << "x" << h;
+        return false;
+      }
+      decoded->format = DecodedImage::GRAY;
+      decoded->planes = {cv::Mat(h, w, CV_8UC1, data, step)};
+    } else if (type == std::to_string(crdc::airi::RGB8) ||
+               type == std::to_string(crdc::airi::BGR8)) {
+      const size_t step = msg.step() > 0 ? msg.step() : w * 3;
+      if (size < step * h) {
+        LOG(ERROR) << "Image of " << size << " bytes is too small for " << w << "x" << h;
+        return false;
+      }
+      decoded->format =
+          type == std::to_string(crdc::airi::RGB8) ? DecodedImage::RGB : DecodedImage::BGR;
+      decoded->planes = {cv::Mat(h, w, CV_8UC3, data, step)};
+    } else if (type == std::string("NV12")) {
+      if (size < size_t(w) * h * 3 / 2) {
+        LOG(ERROR) << "Image of " << size << " bytes is too small for " << w << "x" << h;
+        return false;
+      }
+      decoded->format = DecodedImage::NV12;
+      decoded->planes = {cv::Mat(h, w, CV_8UC1, data, w),
+                         cv::Mat(h / 2, w / 2, CV_8UC2, data + size_t(w) * h, w)};
+    } else if (type == std::string("JPG")) {
+      decoded->format = DecodedImage::BGR;
+      decoded->planes = {imdecode(msg, w, h, target, decoded)};
+    } else {
+      LOG(ERROR) << "Unexpected image type: " << type;
+      return false;
+    }
+  } else {
+    // decoded images are in order bgr, jpeg scales by 1/2, 1/4 or 1/8 in its dct
+    decoded->format = DecodedImage::BGR;
+    decoded->planes = {imdecode(msg, w, h, target, decoded)};
+  }
+
+  if (decoded->planes.front().empty()) {
+    return false;
+  }
+  decoded->width = decoded->planes.front().cols;
+  decoded->height = decoded->planes.front().rows;
+  return true;
+}
+
+cv::Mat ImageService::imdecode(const crdc::airi::Image2 &msg, const int width,
+                               const int height, const cv::Size &target,
+                               DecodedImage *decoded) const {
+  auto data = reinterpret_cast<uchar *>(const_cast<char *>(msg.data().data()));
+  const cv::Mat input(1, msg.data().size(), CV_8UC1, data);
+  int factor = 1;
+  const int flags = jpegReduction(width, height, target, &decoded->reduced, &factor);
+  if (width <= 0 || height <= 0) {
+    return cv::imdecode(input, flags);
+  }
+
+  // the decoder writes into the buffer as long as the size matches, else allocates
+  const int w = (width + factor - 1) / factor;
+  const int h = (height + factor - 1) / factor;
+  auto buffer = buffers_->acquire(size_t(w) * h * 3);
+  if (!buffer) {
+    return cv::imdecode(input, flags);
+  }
+  cv::Mat image(h, w, CV_8UC3, buffer.get());
+  cv::imdecode(input, flags, &image);
+  if (image.data == buffer.get()) {
+    decoded->buffer = buffer;
+  }
+  return image;
+}
+
+cv::Mat DecodedImage::rgb() const {
+  cv::Mat rgb;
+  if (planes.empty()) {
+    return rgb;
+  }
+  switch (format) {
+    case RGB:
+      rgb = planes[0].clone();
+      break;
+    case BGR:
+      cv::cvtColor(planes[0], rgb, cv::COLOR_BGR2RGB);
+      break;
+    case GRAY:
+      cv::cvtColor(planes[0], rgb, cv::COLOR_GRAY2RGB);
+      break;
+    case GBRP:
+      cv::merge(std::vector<cv::Mat>{planes[2], planes[0], planes[1]}, rgb);
+      break;
+    case I420:
+    case NV12: {
+      // packed into the layout OpenCV expects, chroma of even sizes only
+      const int w = width & ~1;
+      const int h = height & ~1;
+      cv::Mat yuv(h * 3 / 2, w, CV_8UC1);
+      planes[0](cv::Rect(0, 0, w, h)).copyTo(yuv.rowRange(0, h));
+      auto chroma = yuv.ptr(h);
+      if (format == I420) {
+        cv::Mat u(h / 2, w / 2, CV_8UC1, chroma);
+        cv::Mat v(h / 2, w / 2, CV_8UC1, chroma + w * h / 4);
+        planes[1](cv::Rect(0, 0, w / 2, h / 2)).copyTo(u);
+        planes[2](cv::Rect(0, 0, w / 2, h / 2)).copyTo(v);
+        cv::cvtColor(yuv, rgb, cv::COLOR_YUV2RGB_I420);
+      } else {
+        cv::Mat uv(h / 2, w / 2, CV_8UC2, chroma);
+        planes[1](cv::Rect(0, 0, w / 2, h / 2)).copyTo(uv);
+        cv::cvtColor(yuv, rgb, cv::COLOR_YUV2RGB_NV12);
+      }
+      break;
+    }
+  }
+  return rgb;
+}
+
+void ImageService::notify(const std::string &name) {
+  std::vector<Listener> listeners;
+  {
+    std::lock_guard<std::mutex> lock(mutex_listeners_);
+    for (const auto &listener : listeners_) {
+      listeners.push_back(listener.second);
+    }
+  }
+  for (const auto &listener : listeners) {
+    listener(name);
+  }
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "common/frame_buffer_pool.h"
+#include "common/thread_pool.h"
+#include "cyber/sensor_proto/image.pb.h"
+#include "h264_rgb_encoder_decoder/decoder.h"
+
+namespace crdc {
+namespace airi {
+
+// latest image of a channel in the layout it was decoded to, the display converts
+// it to rgb in a shader
+struct DecodedImage {
+  enum Format { RGB, BGR, GRAY, I420, NV12, GBRP };
+
+  Format format{RGB};
+  int width{0};
+  int height{0};
+  // one plane for RGB, BGR and GRAY, y u v for I420, y and interleaved uv for NV12,
+  // g b r for GBRP, every plane with its own row stride
+  std::vector<cv::Mat> planes;
+  // limited range yuv unless the stream says otherwise
+  bool full_range{false};
+  // decoded below the resolution of the stream for the players showing it
+  bool reduced{false};
+  // owners of the plane memory
+  std::shared_ptr<AVFrame> frame;
+  std::shared_ptr<uint8_t> buffer;
+  std::shared_ptr<const crdc::airi::Image2> proto;
+  uint64_t sequence{0};
+
+  // converted on the CPU, for export and GL without shaders only
+  cv::Mat rgb() const;
+};
+
+// frames that came out of the decoder against the ones converted to rgb, and the
+// ones the decoder skipped to catch up
+struct ImageStats {
+  uint64_t decoded{0};
+  uint64_t converted{0};
+  uint64_t skipped{0};
+};
+
+/**
+ * @brief Subscribes to all image channels once and decodes them on worker threads,
+ *        every channel in order and with a decoder of its own. Any number of image
+ *        players show the latest decoded image of a channel without decoding again.
+ *
+ * H264 and HEVC channels are always decoded as their frames refer to each other, but only
+ * the newest frame of watched channels is published.
+ */
+class ImageService {
+ public:
+  // worker thread, a channel was seen the first time or has a new image
+  using Listener = std::function<void(const std::string &channel)>;
+
+ public:
+  explicit ImageService(const size_t num_threads = 2);
+
+  // subscribes to the message hub of the global data
+  void initialize();
+
+  // thread safe, returns the id to remove it with
+  size_t addListener(const Listener &listener);
+  void removeListener(const size_t id);
+
+  // thread safe and counted, images of watched channels are converted as they come, at
+  // the largest size they are shown at, an empty size asks for the full resolution
+  void watch(const std::string &channel, const cv::Size &size = cv::Size());
+  void unwatch(const std::string &channel, const cv::Size &size = cv::Size());
+
+  std::vector<std::string> channels() const;
+
+  // nullptr until the first image of the channel is converted
+  std::shared_ptr<const DecodedImage> latest(const std::string &channel) const;
+
+  // the newest image in full resolution, converted in the caller if the channel is not
+  // watched or shown smaller, e.g. for export
+  std::shared_ptr<const DecodedImage> snapshot(const std::string &channel);
+
+  std::unordered_map<std::string, ImageStats> stats() const;
+
+ protected:
+  struct Channel {
+    std::mutex mutex;
+    // h264 and hevc packets all have to be decoded, of other streams only the newest
+    std::deque<std::shared_ptr<const crdc::airi::Image2>> pending;
+    bool decoding{false};
+    // display sizes of the watching players
+    std::vector<cv::Size> views;
+    std::shared_ptr<const DecodedImage> latest;
+    uint64_t sequence{0};
+    ImageStats stats;
+
+    // held while the decoder is used, before mutex if both are needed
+    std::mutex mutex_decoder;
+    std::shared_ptr<crdc::airi::H264DecoderData> decoder;
+    // newest message not converted yet, for video streams its frame waits in the decoder
+    std::shared_ptr<const crdc::airi::Image2> unconverted;
+  };
+
+  std::shared_ptr<Channel> find(const std::string &name) const;
+
+  void onImage(const std::string &name, const std::shared_ptr<crdc::airi::Image2> &msg);
+
+  // one task per channel at a time, runs until nothing is pending
+  void decode(const std::string &name, const std::shared_ptr<Channel> &channel);
+
+  // with mutex, empty if any view wants the full resolution
+  cv::Size target(const Channel &channel) const;
+
+  // with mutex_decoder held, returns false if there was nothing new, target is the size
+  // the image is shown at or empty for the full resolution
+  bool convert(const std::shared_ptr<Channel> &channel, const cv::Size &target);
+
+  // the planes of the newest decoded frame, without copying them where the layout allows,
+  // scaled by swscale if the target is much smaller
+  bool fromDecoder(crdc::airi::H264DecoderData *decoder, const cv::Size &target,
+                   DecodedImage *decoded) const;
+
+  // planes of a frame in full resolution, converted by swscale if the layout has no shader
+  bool fromFrame(const std::shared_ptr<AVFrame> &frame, DecodedImage *decoded) const;
+
+  // raw images are wrapped in place, compressed ones decoded to bgr, jpeg scaled down
+  // in the decoder if the target is much smaller
+  bool fromProto(const crdc::airi::Image2 &msg, const cv::Size &target,
+                 DecodedImage *decoded) const;
+
+  // decoded into a pooled buffer if the size is known, width and height may be 0
+  cv::Mat imdecode(const crdc::airi::Image2 &msg, const int width, const int height,
+                   const cv::Size &target, DecodedImage *decoded) const;
+
+  void notify(const std::string &name);
+
+ protected:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Channel>> channels_;
+
+  std::mutex mutex_listeners_;
+  std::unordered_map<size_t, Listener> listeners_;
+  size_t next_listener_{0};
+
+  // rgb and jpeg output, the images of a channel mostly have the same size
+  std::shared_ptr<common::FrameBufferPool> buffers_;
+
+  // last member, its workers are joined before the channels go
+  std::unique_ptr<common::ThreadPool> pool_;
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -4,10 +4,13 @@
 #include <QDesktopWidget>
 #include <QLayout>
 #include <QSplitter>
+#include <algorithm>
+#include <thread>
 #include "common/io/file.h"
 #include "viewer/global_data.h"
 #include "viewer/glwidget.h"
 #include "viewer/image_player.h"
+#include "viewer/image_service.h"
 #include "viewer/renderer_manager.h"
 #include "viewer/toolbar.h"
 
@@ -23,6 +26,10 @@ MainWindow::MainWindow() {
   global_data->main_window_ = this;
   global_data->glwidget_ = new GLWidget();
   global_data->ip_counter_ = 0;
+  // images are decoded once for all players
+  global_data->image_service_ = std::make_shared<ImageService>(
+      std::max(2u, std::thread::hardware_concurrency() / 2));
+  global_data->image_service_->initialize();
   for (int i = 0; i < 6; i++) {
     global_data->image_players_.push_back(new ImagePlayer());
   }
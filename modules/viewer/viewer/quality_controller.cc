@@ -0,0 +1,180 @@
+#include "viewer/quality_controller.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <limits>
+#include "viewer/renderers/renderer.h"
+
+namespace crdc {
+namespace airi {
+
+namespace {
+
+// frames to wait after a change before judging it
+const int kCooldownFrames = 15;
+// frames well under budget before quality is raised again
+const int kHeadroomFrames = 60;
+const float kHeadroomRatio = 0.6f;
+const float kSmoothing = 0.1f;
+// share of the frame time from which a renderer is degraded on its own
+const float kDominantShare = 0.25f;
+
+struct Level {
+  int point_stride;
+  size_t max_labels;
+  float tessellation;
+  size_t history_depth;
+};
+
+const size_t kAll = std::numeric_limits<size_t>::max();
+
+// per renderer, cheap knobs first
+const Level kLevels[QualityController::kMaxLevel + 1] = {
+    {1, kAll, 1.f, kAll},
+    {1, 200, 2.f, kAll},
+    {2, 100, 2.f, 4},
+    {4, 50, 4.f, 2},
+    {8, 20, 4.f, 1},
+};
+
+// relative to logical pixels, i.e. before the device pixel ratio, 0 is native
+const float kScales[QualityController::kMaxScaleLevel + 1] = {0.f, 1.f, .75f, .5f};
+
+}  // namespace
+
+void QualityController::configure(const bool enabled, const float target_frame_time_ms) {
+  enabled_ = enabled;
+  if (target_frame_time_ms > 0.f) {
+    target_ms_ = target_frame_time_ms;
+  }
+  if (!enabled_) {
+    scale_level_ = 0;
+    levels_.clear();
+  }
+}
+
+void QualityController::update(const float frame_ms,
+                               const std::unordered_map<const Renderer *, float> &costs) {
+  frame_ms_ = frame_ms_ > 0.f ? frame_ms_ + (frame_ms - frame_ms_) * kSmoothing : frame_ms;
+  for (const auto &cost : costs) {
+    auto &cost_ms = costs_ms_[cost.first];
+    cost_ms = cost_ms > 0.f ? cost_ms + (cost.second - cost_ms) * kSmoothing : cost.second;
+  }
+
+  if (!enabled_) {
+    return;
+  }
+  if (cooldown_ > 0) {
+    --cooldown_;
+    return;
+  }
+
+  if (frame_ms_ > target_ms_) {
+    headroom_frames_ = 0;
+    if (lower()) {
+      cooldown_ = kCooldownFrames;
+    }
+  } else if (frame_ms_ < target_ms_ * kHeadroomRatio && degraded()) {
+    if (++headroom_frames_ >= kHeadroomFrames) {
+      raise();
+      cooldown_ = kCooldownFrames;
+      headroom_frames_ = 0;
+    }
+  } else {
+    headroom_frames_ = 0;
+  }
+}
+
+const Renderer *QualityController::degradable() const {
+  const Renderer *renderer = nullptr;
+  float cost_ms = frame_ms_ * kDominantShare;
+  for (const auto &cost : costs_ms_) {
+    auto it = levels_.find(cost.first);
+    const int level = it == levels_.end() ? 0 : it->second;
+    if (level < kMaxLevel && cost.second >= cost_ms) {
+      renderer = cost.first;
+      cost_ms = cost.second;
+    }
+  }
+  return renderer;
+}
+
+bool QualityController::lower() {
+  auto renderer = degradable();
+  if (renderer) {
+    const int level = ++levels_[renderer];
+    LOG(INFO) << "Frame time " << frame_ms_ << " ms over budget " << target_ms_ << " ms, "
+              << renderer->name() << " (" << costs_ms_[renderer] << " ms) at quality level "
+              << level;
+    return true;
+  }
+  if (scalable_ && scale_level_ < kMaxScaleLevel) {
+    ++scale_level_;
+    LOG(INFO) << "Frame time " << frame_ms_ << " ms over budget " << target_ms_
+              << " ms, most expensive " << mostExpensive() << ", resolution level "
+              << scale_level_;
+    return true;
+  }
+  return false;
+}
+
+bool QualityController::raise() {
+  if (scale_level_ > 0) {
+    --scale_level_;
+    LOG(INFO) << "Frame time " << frame_ms_ << " ms, resolution level " << scale_level_;
+    return true;
+  }
+  auto it = std::max_element(
+      levels_.begin(), levels_.end(),
+      [](const std::pair<const Renderer *const, int> &a,
+         const std::pair<const Renderer *const, int> &b) { return a.second < b.second; });
+  if (it == levels_.end() || it->second == 0) {
+    return false;
+  }
+  LOG(INFO) << "Frame time " << frame_ms_ << " ms, " << it->first->name()
+            << " at quality level " << it->second - 1;
+  if (--it->second == 0) {
+    levels_.erase(it);
+  }
+  return true;
+}
+
+bool QualityController::degraded() const { return scale_level_ > 0 || !levels_.empty(); }
+
+QualitySettings QualityController::settings() const {
+  QualitySettings settings;
+  settings.level = scale_level_;
+  const float logical_scale = kScales[scale_level_];
+  if (scalable_ && logical_scale > 0.f) {
+    settings.render_scale = std::min(1.f, logical_scale / device_pixel_ratio_);
+  }
+  return settings;
+}
+
+QualitySettings QualityController::settings(const Renderer *renderer) const {
+  auto settings = this->settings();
+  auto it = levels_.find(renderer);
+  if (it == levels_.end()) {
+    return settings;
+  }
+  const auto &level = kLevels[it->second];
+  settings.level = it->second;
+  settings.point_stride = level.point_stride;
+  settings.max_labels = level.max_labels;
+  settings.tessellation = level.tessellation;
+  settings.history_depth = level.history_depth;
+  return settings;
+}
+
+std::string QualityController::mostExpensive() const {
+  auto it = std::max_element(
+      costs_ms_.begin(), costs_ms_.end(),
+      [](const std::pair<const Renderer *const, float> &a,
+         const std::pair<const Renderer *const, float> &b) { return a.second < b.second; });
+  if (it == costs_ms_.end()) {
+    return "none";
+  }
+  return it->first->name() + " (" + std::to_string(it->second) + " ms)";
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include "viewer/frame_context.h"
+
+namespace crdc {
+namespace airi {
+
+class Renderer;
+
+/**
+ * @brief Keeps the frame time under the configured budget by stepping the
+ *        renderers that cost the most through quality levels, and the
+ *        resolution of the whole frame once no single renderer dominates.
+ *        Quality is raised again when there is headroom.
+ */
+class QualityController {
+ public:
+  static const int kMaxLevel = 4;
+  static const int kMaxScaleLevel = 3;
+
+ public:
+  void configure(const bool enabled, const float target_frame_time_ms);
+
+  void setDevicePixelRatio(const float ratio) { device_pixel_ratio_ = ratio; }
+
+  // false disables the render_scale knob, e.g. without framebuffer blits
+  void setScalable(const bool scalable) { scalable_ = scalable; }
+
+  // once per frame with the frame time and what every renderer cost in it, the
+  // prepare() of the tasks it scheduled included
+  void update(const float frame_ms, const std::unordered_map<const Renderer *, float> &costs);
+
+  // resolution of the frame, the other knobs at full quality
+  QualitySettings settings() const;
+
+  // knobs of one renderer at its own level
+  QualitySettings settings(const Renderer *renderer) const;
+
+  // while true the view has to be repainted to find out when quality can be raised,
+  // e.g. a static view that would not be painted again otherwise
+  bool degraded() const;
+
+  bool degraded(const Renderer *renderer) const { return levels_.count(renderer) > 0; }
+
+ protected:
+  std::string mostExpensive() const;
+
+  // the most expensive renderer worth degrading, nullptr if none dominates the frame
+  const Renderer *degradable() const;
+
+  // lowers the quality one step, false if nothing is left to lower
+  bool lower();
+
+  // raises the quality one step, resolution first
+  bool raise();
+
+ protected:
+  bool enabled_{false};
+  float target_ms_{33.f};
+  float device_pixel_ratio_{1.f};
+  bool scalable_{true};
+
+  int scale_level_{0};
+  std::unordered_map<const Renderer *, int> levels_;
+  float frame_ms_{0.f};
+  int cooldown_{0};
+  int headroom_frames_{0};
+  std::unordered_map<const Renderer *, float> costs_ms_;
+};
+
+}  // namespace airi
+}  // namespace crdc
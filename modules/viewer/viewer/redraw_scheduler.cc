@@ -0,0 +1,77 @@
+#include "viewer/redraw_scheduler.h"
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QScreen>
+#include <algorithm>
+#include <cmath>
+#include "common/common.h"
+
+namespace crdc {
+namespace airi {
+
+const QEvent::Type RedrawScheduler::kRequestEvent =
+    static_cast<QEvent::Type>(QEvent::registerEventType());
+
+RedrawScheduler::RedrawScheduler(QWidget *widget, const float max_fps) : widget_(widget) {
+  timer_.setSingleShot(true);
+  timer_.setTimerType(Qt::PreciseTimer);
+  QObject::connect(&timer_, &QTimer::timeout, [this]() {
+    pending_ = false;
+    widget_->update();
+  });
+  setMaxFps(max_fps);
+}
+
+void RedrawScheduler::setMaxFps(const float max_fps) {
+  // swapping faster than the screen refreshes only blocks in the driver
+  float fps = max_fps > 0.f ? max_fps : 30.f;
+  auto screen = QGuiApplication::primaryScreen();
+  if (screen && screen->refreshRate() > 0) {
+    fps = std::min<float>(fps, screen->refreshRate());
+  }
+  interval_ms_ = std::lround(1000.f / fps);
+}
+
+void RedrawScheduler::request() {
+  if (pending_.exchange(true)) {
+    return;
+  }
+  // the timer lives in the GUI thread, callers may not
+  QCoreApplication::postEvent(this, new QEvent(kRequestEvent));
+}
+
+void RedrawScheduler::watchInput() { qApp->installEventFilter(this); }
+
+void RedrawScheduler::onPaint() { last_paint_ = get_now_microsecond(); }
+
+bool RedrawScheduler::event(QEvent *e) {
+  if (e->type() == kRequestEvent) {
+    schedule();
+    return true;
+  }
+  return QObject::event(e);
+}
+
+bool RedrawScheduler::eventFilter(QObject *obj, QEvent *e) {
+  switch (e->type()) {
+    case QEvent::MouseButtonRelease:
+    case QEvent::KeyRelease:
+    case QEvent::Wheel:
+      request();
+      break;
+    default:
+      break;
+  }
+  return QObject::eventFilter(obj, e);
+}
+
+void RedrawScheduler::schedule() {
+  if (timer_.isActive()) {
+    return;
+  }
+  const int64_t elapsed_ms = (get_now_microsecond() - last_paint_) / 1000;
+  timer_.start(std::max<int64_t>(0, interval_ms_ - elapsed_ms));
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QEvent>
+#include <QObject>
+#include <QTimer>
+#include <QWidget>
+#include <atomic>
+#include <cstdint>
+
+namespace crdc {
+namespace airi {
+
+/**
+ * @brief Repaints a widget only after something asked for it, at most max_fps
+ *        times per second and never faster than the screen refreshes.
+ */
+class RedrawScheduler : public QObject {
+ public:
+  explicit RedrawScheduler(QWidget *widget, const float max_fps = 30.f);
+
+ public:
+  void setMaxFps(const float max_fps);
+
+  // thread safe, new data, camera motion or config changes call this
+  void request();
+
+  // repaint whenever the user interacts with any widget of the application
+  void watchInput();
+
+  // called by the widget when it starts painting
+  void onPaint();
+
+ protected:
+  bool event(QEvent *e) override;
+  bool eventFilter(QObject *obj, QEvent *e) override;
+
+  void schedule();
+
+ protected:
+  static const QEvent::Type kRequestEvent;
+
+  QWidget *widget_;
+  QTimer timer_;
+  std::atomic<bool> pending_{false};
+  int interval_ms_{33};
+  uint64_t last_paint_{0};
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -9,6 +9,7 @@
 #include "common/io/file.h"
 #include "viewer/global_data.h"
 #include "viewer/glwidget.h"
+#include "viewer/gpu_resource_manager.h"
 #include "viewer/widgets/push_button.h"
 #include "viewer/widgets/renderer_item.h"
 
@@ -23,7 +24,8 @@ RendererManager::RendererManager() {
     if (!path.isEmpty()) {
      viewer::Config cfg;
       if (crdc::airi::util::get_proto_from_file(path.toStdString(), &cfg)) {
-        crdc::airi::common::Singleton<GlobalData>::get()->config_ = cfg;
+        crdc::airi::common::Singleton<GlobalData>::get()->updateConfig(
+            [&cfg](viewer::Config *config) { config->Swap(&cfg); });
         crdc::airi::common::Singleton<GlobalData>::get()->glwidget_->loadConfigPost();
       }
     }
@@ -54,6 +56,11 @@ RendererManager::RendererManager() {
   hbox_->addWidget(bt_export);
   layout_->addLayout(hbox_);
 
+  lb_gpu_memory_ = new QLabel();
+  layout_->addWidget(lb_gpu_memory_);
+  QObject::connect(&timer_gpu_memory_, &QTimer::timeout, [this]() { updateGpuMemory(); });
+  timer_gpu_memory_.start(1000);
+
   container_ = new QWidget();
   scroll_area_ = new QScrollArea();
   container_->setLayout(vbox_);
@@ -72,6 +79,32 @@ RendererManager::RendererManager() {
 
 void RendererManager::addWidget(QWidget *widget) { vbox_->addWidget(widget); }
 
+void RendererManager::updateGpuMemory() {
+  auto gpu_resources = crdc::airi::common::Singleton<GlobalData>::get()->gpu_resources_;
+  if (!gpu_resources) {
+    return;
+  }
+
+  const auto mb = [](const size_t bytes) {
+    return QString::number(bytes / double(1 << 20), 'f', 1);
+  };
+  auto text = "GPU Memory: " + mb(gpu_resources->used()) + " MB";
+  if (gpu_resources->budget() > 0) {
+    text += " / " + mb(gpu_resources->budget()) + " MB";
+  }
+  lb_gpu_memory_->setText(text);
+
+  QString tooltip;
+  for (const auto &owner : gpu_resources->usage()) {
+    if (!tooltip.isEmpty()) {
+      tooltip += "\n";
+    }
+    tooltip += QString::fromStdString(owner.first.empty() ? "other" : owner.first) + ": " +
+               mb(owner.second) + " MB";
+  }
+  lb_gpu_memory_->setToolTip(tooltip);
+}
+
 void RendererManager::resizeEvent(QResizeEvent *e) {
   scroll_area_->setMaximumSize(e->size());
   container_->setFixedWidth(e->size().width() - 25);
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <QLabel>
 #include <QLayout>
+#include <QTimer>
 #include <QWidget>
 #include <QScrollArea>
 #include <QResizeEvent>
@@ -18,6 +20,9 @@ class RendererManager : public QWidget {
  protected:
   void resizeEvent(QResizeEvent *e) override;
 
+  // GPU memory in use against the budget, per owner in the tooltip
+  void updateGpuMemory();
+
  protected:
   QHBoxLayout *hbox_;
   QVBoxLayout *vbox_;
@@ -25,6 +30,8 @@ class RendererManager : public QWidget {
 
   QWidget *container_;
   QScrollArea *scroll_area_;
+  QLabel *lb_gpu_memory_;
+  QTimer timer_gpu_memory_;
 };
 
 }  // namespace airi
@@ -1,7 +1,10 @@
 #include "viewer/renderers/context_renderer.h"
 #include "viewer/camera.h"
+#include "viewer/frame_context.h"
+#include "viewer/frame_profiler.h"
 #include "viewer/global_data.h"
 #include "viewer/renderer_manager.h"
+#include "viewer/renderers/grid_shader.h"
 #include "viewer/widgets/check_box.h"
 #include "viewer/widgets/renderer_item.h"
 #include "viewer/widgets/slider.h"
@@ -15,22 +18,38 @@ class GLWidget;
 ContextRenderer::ContextRenderer() {
   item_ = new RendererItem(
       "Context", global_data_->config_.context_renderer_enable(),
-      [&](bool is_checked) { global_data_->config_.set_context_renderer_enable(is_checked); });
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_context_renderer_enable(is_checked); });
+        ++version_;
+      });
   global_data_->renderer_manager_->addWidget(item_);
 
   auto cb_grid_enable = new CheckBox(
       "Show Grid", global_data_->config_.context_grid_enable(),
-      [&](bool is_checked) { global_data_->config_.set_context_grid_enable(is_checked); });
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_context_grid_enable(is_checked); });
+        ++version_;
+      });
   item_->addWidget(cb_grid_enable);
 
   auto slider_grid_range =
       new Slider("Grid Range", 1, 10, 5000, global_data_->config_.context_grid_range(),
-                 [&](double val) { global_data_->config_.set_context_grid_range(val); });
+                 [&](double val) {
+                   global_data_->updateConfig(
+                       [&](viewer::Config *config) { config->set_context_grid_range(val); });
+                   ++version_;
+                 });
   item_->addWidget(slider_grid_range);
 
   auto slider_grid_size =
       new Slider("Grid Size", 1, 0.1, 100, global_data_->config_.context_grid_size(),
-                 [&](double val) { global_data_->config_.set_context_grid_size(val); });
+                 [&](double val) {
+                   global_data_->updateConfig(
+                       [&](viewer::Config *config) { config->set_context_grid_size(val); });
+                   ++version_;
+                 });
   item_->addWidget(slider_grid_size);
 
   auto hbox = new QHBoxLayout();
@@ -47,6 +66,8 @@ ContextRenderer::ContextRenderer() {
   // cb_grid_frame_id_->addItem("ROBO_FRONT");
   // cb_grid_frame_id_->addItem("ROBO_BACK");
   // cb_grid_frame_id_->addItem("CAR_HEAD");
+  QObject::connect(cb_grid_frame_id_, &QComboBox::currentTextChanged,
+                   [&](const QString &) { ++version_; });
   hbox->addWidget(label);
   hbox->addWidget(cb_grid_frame_id_);
   item_->addLayout(hbox);
@@ -54,45 +75,79 @@ ContextRenderer::ContextRenderer() {
 
 bool ContextRenderer::enabled() const { return global_data_->config_.context_renderer_enable(); }
 
-void ContextRenderer::render() {
-  if (!enabled()) {
+void ContextRenderer::submit() {
+  const auto &config = *frame_->config;
+  if (!config.context_renderer_enable()) {
     return;
   }
 
-  if (cb_grid_frame_id_->currentText() == "global") {
-    glTranslatef(0, 0, global_data_->pose()->pose().position().z());
+  const bool global = cb_grid_frame_id_->currentText() == "global";
+  if (global) {
+    glTranslatef(0, 0, frame_->poseZ());
   }
   else {
     // transform(cb_grid_frame_id_->currentText().toStdString());
   }
 
-  if (global_data_->config_.context_grid_enable()) {
-    const auto grid_size = global_data_->config_.context_grid_size();
-    const auto grid_range = global_data_->config_.context_grid_range();
-    const auto grid_color = global_data_->config_.context_grid_color();
-    const auto grid_line_width = global_data_->config_.context_grid_line_width();
+  if (config.context_grid_enable()) {
+    const auto grid_color = config.context_grid_color();
+    const auto grid_line_width = config.context_grid_line_width();
 
-    std::vector<Eigen::VectorXf> points;
-    for (float x = -grid_range; x <= grid_range; x += grid_size) {
-      points.push_back(Eigen::Vector2f(x, -grid_range));
-      points.push_back(Eigen::Vector2f(x, grid_range));
+    if (!grid_shader_) {
+      grid_shader_.reset(new GridShader());
+      if (!grid_shader_->initialize()) {
+        LOG(WARNING) << "Grid shader unavailable, fall back to line lists";
+      }
     }
-    for (float y = -grid_range; y <= grid_range; y += grid_size) {
-      points.push_back(Eigen::Vector2f(-grid_range, y));
-      points.push_back(Eigen::Vector2f(grid_range, y));
+    if (grid_shader_->available()) {
+      const float color[] = {grid_color.r(), grid_color.g(), grid_color.b(), grid_color.a()};
+      grid_shader_->draw(glm::value_ptr(frame_->mvp), color, grid_line_width,
+                         config.context_grid_size(), config.context_grid_range(),
+                         global ? frame_->poseZ() : 0.f, frame_->eye.x, frame_->eye.y);
+      global_data_->profiler_->countDraw(4);
+      return;
     }
+
 #ifdef __aarch64__
     global_data_->glwidget_->setColor(QVector4D(grid_color.r(), grid_color.g(), grid_color.b(), grid_color.a()));
 #else
     glColor4f(grid_color.r(), grid_color.g(), grid_color.b(), grid_color.a());
 #endif
     glLineWidth(grid_line_width);
-    drawLines(points);
+    drawFallbackGrid(config.context_grid_size(), config.context_grid_range());
+  }
+}
+
+void ContextRenderer::drawFallbackGrid(const float grid_size, const float grid_range) {
+  if (grid_size <= 0.f || grid_range <= 0.f) {
+    return;
+  }
+
+  if (grid_size != grid_size_ || grid_range != grid_range_) {
+    grid_size_ = grid_size;
+    grid_range_ = grid_range;
+
+    // too dense grids are thinned out, they would not be readable anyway
+    const int max_lines = 1000;
+    const int count = std::min(max_lines, int(2 * grid_range / grid_size) + 1);
+    const float step = 2 * grid_range / std::max(1, count - 1);
+    Eigen::MatrixXf vertex(2, count * 4);
+    for (int i = 0; i < count; ++i) {
+      const float v = -grid_range + i * step;
+      vertex.col(i * 4) << v, -grid_range;
+      vertex.col(i * 4 + 1) << v, grid_range;
+      vertex.col(i * 4 + 2) << -grid_range, v;
+      vertex.col(i * 4 + 3) << grid_range, v;
+    }
+    grid_buffer_ = generateGLBuffer(vertex, 2, 0);
   }
+  drawArrays(GL_LINES, grid_buffer_);
 }
 
 void ContextRenderer::loadConfigPost() {
   item_->setChecked(enabled());
+  // colors and line width only come from the config file
+  ++version_;
 }
 
 }  // namespace airi
@@ -2,10 +2,12 @@
 
 #include "viewer/renderers/renderer.h"
 #include <QComboBox>
+#include <memory>
 
 namespace crdc {
 namespace airi {
 
+class GridShader;
 class RendererItem;
 
 class ContextRenderer : public Renderer {
@@ -17,13 +19,28 @@ class ContextRenderer : public Renderer {
 
   bool enabled() const override;
 
-  void render() override;
+  void submit() override;
+
+  bool isStaticLayer() const override { return true; }
+
+  uint64_t layerVersion() const override { return version_; }
 
   void loadConfigPost() override;
 
+ protected:
+  // line list for GL without shaders, rebuilt only when size or range change
+  void drawFallbackGrid(const float grid_size, const float grid_range);
+
  protected:
   RendererItem *item_;
   QComboBox *cb_grid_frame_id_;
+  uint64_t version_{0};
+
+  std::shared_ptr<GridShader> grid_shader_;
+
+  float grid_size_{0.f};
+  float grid_range_{0.f};
+  GLBuffer grid_buffer_;
 };
 
 }  // namespace airi
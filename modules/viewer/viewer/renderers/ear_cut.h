@@ -116,8 +116,13 @@ class Earcut {
     template <typename... Args>
     T* construct(Args&&... args) {
       if (currentIndex >= blockSize) {
-        currentBlock = alloc.allocate(blockSize);
-        allocations.emplace_back(currentBlock);
+        if (nextBlock < allocations.size()) {
+          currentBlock = allocations[nextBlock];
+        } else {
+          currentBlock = alloc.allocate(blockSize);
+          allocations.emplace_back(currentBlock);
+        }
+        ++nextBlock;
         currentIndex = 0;
       }
       T* object = &currentBlock[currentIndex++];
@@ -130,6 +135,17 @@ class Earcut {
       blockSize = std::max<std::size_t>(1, newBlockSize);
       currentBlock = nullptr;
       currentIndex = blockSize;
+      nextBlock = 0;
+    }
+    // keeps the allocated blocks for the next polygon if they are big enough
+    void rewind(std::size_t newBlockSize) {
+      if (newBlockSize > blockSize || allocations.empty()) {
+        reset(newBlockSize);
+        return;
+      }
+      currentBlock = nullptr;
+      currentIndex = blockSize;
+      nextBlock = 0;
     }
     void clear() { reset(blockSize); }
 
@@ -137,6 +153,7 @@ class Earcut {
     T* currentBlock = nullptr;
     std::size_t currentIndex = 1;
     std::size_t blockSize = 1;
+    std::size_t nextBlock = 0;
     std::vector<T*> allocations;
     Alloc alloc;
   };
@@ -163,7 +180,7 @@ void Earcut<N>::operator()(const Polygon& points) {
   }
 
   // estimate size of nodes and indices
-  nodes.reset(len * 3 / 2);
+  nodes.rewind(len * 3 / 2);
   indices.reserve(len + points[0].size());
 
   Node* outerNode = linkedList(points[0], true);
@@ -195,8 +212,6 @@ void Earcut<N>::operator()(const Polygon& points) {
   }
 
   earcutLinked(outerNode);
-
-  nodes.clear();
 }
 
 // create a circular doubly linked list from polygon points in the specified
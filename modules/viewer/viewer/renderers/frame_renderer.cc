@@ -1,6 +1,8 @@
 #include "viewer/renderers/frame_renderer.h"
+#include "viewer/frame_context.h"
 #include "viewer/global_data.h"
 #include "viewer/renderer_manager.h"
+#include "viewer/renderers/render_queue.h"
 #include "viewer/widgets/check_box.h"
 #include "viewer/widgets/renderer_item.h"
 
@@ -10,7 +12,10 @@ namespace airi {
 FrameRenderer::FrameRenderer() {
   item_ = new RendererItem(
       "Frame", global_data_->config_.frame_renderer_enable(),
-      [&](bool is_checked) { global_data_->config_.set_frame_renderer_enable(is_checked); });
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_frame_renderer_enable(is_checked); });
+      });
   global_data_->renderer_manager_->addWidget(item_);
 
   for (const auto &frame : global_data_->config_.frame_renderer_frames()) {
@@ -24,51 +29,51 @@ FrameRenderer::FrameRenderer() {
 bool FrameRenderer::enabled() const { return global_data_->config_.frame_renderer_enable(); }
 
 void FrameRenderer::render() {
-  if (!enabled()) {
+  const auto &config = *frame_->config;
+  if (!config.frame_renderer_enable()) {
     return;
   }
 
-  for (const auto &frame : global_data_->config_.frame_renderer_frames()) {
+  // axes of all frames share one bucket without blending and depth test
+  RenderState state;
+  state.depth_test = false;
+  state.blend = false;
+  state.line_width = config.frame_line_width();
+
+  for (const auto &frame : config.frame_renderer_frames()) {
     if (!enables_[frame]) {
       continue;
     }
 
-    GLPushGuard pg;
-
-    glLineWidth(global_data_->config_.frame_line_width());
-    glDisable(GL_BLEND);
-    glDisable(GL_DEPTH_TEST);
-
-    glColor4f(1, 0, 0, 1);
-    glBegin(GL_LINES);
-    glVertex3f(0, 0, 0);
-    glVertex3f(global_data_->config_.frame_line_length(), 0, 0);
-    glEnd();
-    drawText(Eigen::Vector3f(global_data_->config_.frame_line_length(), 0, 0), "X",
-             global_data_->config_.frame_font_size(), global_data_->config_.frame_font_bold());
-
-    glColor4f(0, 1, 0, 1);
-    glBegin(GL_LINES);
-    glVertex3f(0, 0, 0);
-    glVertex3f(0, global_data_->config_.frame_line_length(), 0);
-    glEnd();
-    drawText(Eigen::Vector3f(0, global_data_->config_.frame_line_length(), 0), "Y",
-             global_data_->config_.frame_font_size(), global_data_->config_.frame_font_bold());
+    enqueue(state, [this, &config, &frame]() {
+      glColor4f(1, 0, 0, 1);
+      glBegin(GL_LINES);
+      glVertex3f(0, 0, 0);
+      glVertex3f(config.frame_line_length(), 0, 0);
+      glEnd();
+      drawText(Eigen::Vector3f(config.frame_line_length(), 0, 0), "X",
+               config.frame_font_size(), config.frame_font_bold());
 
-    glColor4f(0, 0, 1, 1);
-    glBegin(GL_LINES);
-    glVertex3f(0, 0, 0);
-    glVertex3f(0, 0, global_data_->config_.frame_line_length());
-    glEnd();
-    drawText(Eigen::Vector3f(0, 0, global_data_->config_.frame_line_length()), "Z",
-             global_data_->config_.frame_font_size(), global_data_->config_.frame_font_bold());
+      glColor4f(0, 1, 0, 1);
+      glBegin(GL_LINES);
+      glVertex3f(0, 0, 0);
+      glVertex3f(0, config.frame_line_length(), 0);
+      glEnd();
+      drawText(Eigen::Vector3f(0, config.frame_line_length(), 0), "Y",
+               config.frame_font_size(), config.frame_font_bold());
 
-    glColor4f(1, 1, 1, 1);
-    drawText(Eigen::Vector3f(0, 0, 0), frame, global_data_->config_.frame_font_size(),
-             global_data_->config_.frame_font_bold());
+      glColor4f(0, 0, 1, 1);
+      glBegin(GL_LINES);
+      glVertex3f(0, 0, 0);
+      glVertex3f(0, 0, config.frame_line_length());
+      glEnd();
+      drawText(Eigen::Vector3f(0, 0, config.frame_line_length()), "Z",
+               config.frame_font_size(), config.frame_font_bold());
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
+      glColor4f(1, 1, 1, 1);
+      drawText(Eigen::Vector3f(0, 0, 0), frame, config.frame_font_size(),
+               config.frame_font_bold());
+    });
   }
 }
 
@@ -0,0 +1,115 @@
+#include "viewer/renderers/grid_shader.h"
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace crdc {
+namespace airi {
+
+static const char *gridVertexShaderSource =
+    "attribute vec2 corner;\n"
+    "uniform mat4 mvp;\n"
+    "uniform float range;\n"
+    "uniform float height;\n"
+    "varying vec2 world;\n"
+    "void main() {\n"
+    "   world = corner * range;\n"
+    "   gl_Position = mvp * vec4(world, height, 1.0);\n"
+    "}\n";
+
+// lines are anti aliased by their distance in pixels, levels are 10 times apart
+// and the finer one fades out before its cells get smaller than 8 pixels
+static const char *gridFragmentShaderSource =
+    "#ifdef GL_ES\n"
+    "#extension GL_OES_standard_derivatives : enable\n"
+    "precision highp float;\n"
+    "#endif\n"
+    "uniform vec4 color;\n"
+    "uniform float half_width;\n"
+    "uniform float cell;\n"
+    "uniform float range;\n"
+    "uniform vec2 eye;\n"
+    "varying vec2 world;\n"
+    "float lines(float size) {\n"
+    "   vec2 coord = world / size;\n"
+    "   vec2 d = abs(fract(coord - 0.5) - 0.5) / max(fwidth(coord), vec2(1e-6));\n"
+    "   float dist = min(d.x, d.y);\n"
+    "   return 1.0 - smoothstep(half_width - 0.5, half_width + 0.5, dist);\n"
+    "}\n"
+    "void main() {\n"
+    "   vec2 footprint = fwidth(world);\n"
+    "   float pixel = max(footprint.x, footprint.y);\n"
+    "   float lod = max(0.0, log(pixel * 8.0 / cell) * 0.4342945);\n"
+    "   float size = cell * pow(10.0, floor(lod));\n"
+    "   float alpha = max(lines(size) * (1.0 - fract(lod)), lines(size * 10.0));\n"
+    "   alpha *= 1.0 - smoothstep(0.5 * range, range, length(world - eye));\n"
+    "   if (alpha * color.a < 0.01) {\n"
+    "     discard;\n"
+    "   }\n"
+    "   gl_FragColor = vec4(color.rgb, color.a * alpha);\n"
+    "}\n";
+
+bool GridShader::initialize() {
+  initializeOpenGLFunctions();
+
+  program_.reset(new QOpenGLShaderProgram());
+  program_->addShaderFromSourceCode(QOpenGLShader::Vertex, gridVertexShaderSource);
+  program_->addShaderFromSourceCode(QOpenGLShader::Fragment, gridFragmentShaderSource);
+  program_->bindAttributeLocation("corner", 0);
+  if (!program_->link()) {
+    LOG(ERROR) << "Failed to link grid shader: " << program_->log().toStdString();
+    return false;
+  }
+  loc_mvp_ = program_->uniformLocation("mvp");
+  loc_color_ = program_->uniformLocation("color");
+  loc_half_width_ = program_->uniformLocation("half_width");
+  loc_cell_ = program_->uniformLocation("cell");
+  loc_range_ = program_->uniformLocation("range");
+  loc_height_ = program_->uniformLocation("height");
+  loc_eye_ = program_->uniformLocation("eye");
+
+  // the unit quad is the only geometry, scaled by range in the shader
+  const float corners[] = {-1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f};
+  vao_.reset(new QOpenGLVertexArrayObject());
+  vbo_.reset(new QOpenGLBuffer(QOpenGLBuffer::Type::VertexBuffer));
+  vao_->create();
+  vao_->bind();
+  vbo_->create();
+  vbo_->bind();
+  vbo_->allocate(corners, sizeof(corners));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, nullptr);
+  vbo_->release();
+  vao_->release();
+
+  available_ = true;
+  return true;
+}
+
+void GridShader::draw(const float *mvp, const float *color, const float line_width,
+                      const float cell, const float range, const float height,
+                      const float eye_x, const float eye_y) {
+  if (!available_ || cell <= 0.f || range <= 0.f) {
+    return;
+  }
+
+  GLint program_prev = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program_prev);
+
+  program_->bind();
+  glUniformMatrix4fv(loc_mvp_, 1, GL_FALSE, mvp);
+  glUniform4fv(loc_color_, 1, color);
+  glUniform1f(loc_half_width_, std::max(line_width, 1.f) * .5f);
+  glUniform1f(loc_cell_, cell);
+  glUniform1f(loc_range_, range);
+  glUniform1f(loc_height_, height);
+  glUniform2f(loc_eye_, eye_x, eye_y);
+
+  vao_->bind();
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  vao_->release();
+
+  glUseProgram(program_prev);
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <memory>
+
+namespace crdc {
+namespace airi {
+
+/**
+ * @brief Draws the ground grid as a single quad, lines are evaluated per pixel
+ *        in the shader, so any range and cell size cost the same.
+ */
+class GridShader : protected QOpenGLFunctions {
+ public:
+  GridShader() = default;
+
+ public:
+  // needs a current GL context
+  bool initialize();
+
+  bool available() const { return available_; }
+
+  // cell is the finest line spacing, coarser lines take over when cells get too
+  // small on screen, the grid covers range around the origin and fades towards it
+  void draw(const float *mvp, const float *color, const float line_width, const float cell,
+            const float range, const float height, const float eye_x, const float eye_y);
+
+ protected:
+  bool available_{false};
+  std::shared_ptr<QOpenGLShaderProgram> program_;
+  std::shared_ptr<QOpenGLVertexArrayObject> vao_;
+  std::shared_ptr<QOpenGLBuffer> vbo_;
+  int loc_mvp_{-1};
+  int loc_color_{-1};
+  int loc_half_width_{-1};
+  int loc_cell_{-1};
+  int loc_range_{-1};
+  int loc_height_{-1};
+  int loc_eye_{-1};
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,127 @@
+#include "viewer/renderers/hud_renderer.h"
+#include <QFontMetrics>
+#include <QImage>
+#include <QPainter>
+#include <cstdio>
+#include "viewer/frame_context.h"
+#include "viewer/frame_profiler.h"
+#include "viewer/global_data.h"
+#include "viewer/renderer_manager.h"
+#include "viewer/widgets/renderer_item.h"
+
+namespace crdc {
+namespace airi {
+
+HudRenderer::HudRenderer() {
+  item_ = new RendererItem(
+      "HUD", global_data_->config_.hud_renderer_enable(),
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_hud_renderer_enable(is_checked); });
+      });
+  global_data_->renderer_manager_->addWidget(item_);
+
+  font_.setFamily("Monospace");
+  font_.setStyleHint(QFont::TypeWriter);
+  font_.setPixelSize(12);
+}
+
+bool HudRenderer::enabled() const { return global_data_->config_.hud_renderer_enable(); }
+
+void HudRenderer::render() {
+  if (!frame_->config->hud_renderer_enable() || !global_data_->profiler_) {
+    return;
+  }
+
+  if (global_data_->profiler_->reportSequence() != sequence_) {
+    updateTexture();
+  }
+  if (!texture_) {
+    return;
+  }
+
+  const float w = texture_->width();
+  const float h = texture_->height();
+  const float top = frame_->viewport_h - 10.f;
+  const float left = 10.f;
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0.0, frame_->viewport_w, 0.0, frame_->viewport_h, -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_TEXTURE_2D);
+  glColor4f(1, 1, 1, 1);
+
+  // first image row is the top of the HUD
+  texture_->bind();
+  glBegin(GL_QUADS);
+    glTexCoord2f(0, 1);
+    glVertex2f(left, top - h);
+    glTexCoord2f(1, 1);
+    glVertex2f(left + w, top - h);
+    glTexCoord2f(1, 0);
+    glVertex2f(left + w, top);
+    glTexCoord2f(0, 0);
+    glVertex2f(left, top);
+  glEnd();
+  texture_->release();
+
+  glPopAttrib();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+}
+
+void HudRenderer::loadConfigPost() { item_->setChecked(enabled()); }
+
+void HudRenderer::updateTexture() {
+  const auto report = global_data_->profiler_->report();
+  sequence_ = report.sequence;
+
+  char line[256];
+  std::vector<std::string> lines;
+  snprintf(line, sizeof(line), "FPS %5.1f   frame p50 %6.2f ms   p99 %6.2f ms", report.fps,
+           report.frame_p50_ms, report.frame_p99_ms);
+  lines.push_back(line);
+  snprintf(line, sizeof(line), "%-44s %8s %8s %8s %9s %6s", "renderer", "prep ms", "cpu ms",
+           "gpu ms", "vertices", "draws");
+  lines.push_back(line);
+  for (const auto &stats : report.renderers) {
+    const auto name = std::string(stats.depth * 2, ' ') + stats.name;
+    char gpu[16] = "-";
+    if (stats.gpu_ms >= 0.f) {
+      snprintf(gpu, sizeof(gpu), "%8.2f", stats.gpu_ms);
+    }
+    snprintf(line, sizeof(line), "%-44.44s %8.2f %8.2f %8s %9zu %6zu", name.c_str(),
+             stats.prepare_ms, stats.submit_ms, gpu, stats.vertices, stats.draw_calls);
+    lines.push_back(line);
+  }
+
+  const QFontMetrics metrics(font_);
+  int width = 0;
+  for (const auto &text : lines) {
+    width = std::max(width, metrics.width(QString::fromStdString(text)));
+  }
+  QImage image(width + 8, metrics.height() * lines.size() + 8, QImage::Format_RGBA8888);
+  image.fill(QColor(0, 0, 0, 160));
+  QPainter painter(&image);
+  painter.setFont(font_);
+  painter.setPen(Qt::white);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    painter.drawText(4, 4 + metrics.ascent() + i * metrics.height(),
+                     QString::fromStdString(lines[i]));
+  }
+  painter.end();
+
+  texture_.reset(new QOpenGLTexture(image, QOpenGLTexture::DontGenerateMipMaps));
+  texture_->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+}
+
+}  // namespace airi
+}  // namespace crdc
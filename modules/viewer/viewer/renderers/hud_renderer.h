@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QFont>
+#include <QOpenGLTexture>
+#include <memory>
+#include "viewer/renderers/renderer.h"
+
+namespace crdc {
+namespace airi {
+
+class RendererItem;
+
+// frame time and cost of every renderer and channel, drawn last on top of the scene
+class HudRenderer : public Renderer {
+ public:
+  HudRenderer();
+
+ public:
+  std::string name() const override { return "HudRenderer"; }
+
+  bool enabled() const override;
+
+  void render() override;
+
+  void loadConfigPost() override;
+
+ protected:
+  // text is only laid out again when the profiler published a new report
+  void updateTexture();
+
+ protected:
+  RendererItem *item_;
+  QFont font_;
+  std::shared_ptr<QOpenGLTexture> texture_;
+  uint64_t sequence_{0};
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,195 @@
+#include "viewer/renderers/icon_atlas.h"
+#include <QOpenGLContext>
+#include <glog/logging.h>
+#include <cmath>
+#include <cstddef>
+#include <opencv2/opencv.hpp>
+#include "common/io/file.h"
+
+namespace crdc {
+namespace airi {
+
+static const char *iconVertexShaderSource =
+    "attribute vec2 corner;\n"
+    "attribute vec3 center;\n"
+    "attribute vec4 uv_rect;\n"
+    "uniform mat4 mvp;\n"
+    "uniform vec2 viewport;\n"
+    "uniform float eye_distance;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "   float size = clamp(floor(eye_distance * -0.8 + 48.0), 12.0, 48.0);\n"
+    "   vec4 clip = mvp * vec4(center, 1.0);\n"
+    "   clip.xy += corner * size * 2.0 / viewport * clip.w;\n"
+    "   gl_Position = clip;\n"
+    "   uv = mix(uv_rect.xy, uv_rect.zw, corner + 0.5);\n"
+    "}\n";
+
+static const char *iconFragmentShaderSource =
+    "uniform sampler2D atlas;\n"
+    "varying highp vec2 uv;\n"
+    "void main() {\n"
+    "   gl_FragColor = texture2D(atlas, uv);\n"
+    "}\n";
+
+bool IconAtlas::load(const std::string &dir) {
+  initializeOpenGLFunctions();
+
+  // instancing is core in GL 3.3 and ES 3.0
+  auto context = QOpenGLContext::currentContext();
+  if (!context) {
+    return false;
+  }
+  const auto version = context->format().version();
+  const bool instancing = context->isOpenGLES()
+                              ? version >= qMakePair(3, 0)
+                              : (version >= qMakePair(3, 3) ||
+                                 context->hasExtension("GL_ARB_instanced_arrays"));
+  if (!instancing) {
+    LOG(WARNING) << "Instanced arrays not supported, icon atlas disabled";
+    return false;
+  }
+
+  // load icons as RGBA
+  std::vector<std::pair<std::string, cv::Mat>> icons;
+  int cell = 0;
+  for (const auto &icon_name : crdc::airi::util::list_sub_paths(dir, DT_REG)) {
+    auto image = cv::imread(crdc::airi::util::get_absolute_path(dir, icon_name),
+                            cv::IMREAD_UNCHANGED);
+    switch (image.channels()) {
+      case 1:
+        cv::cvtColor(image, image, cv::COLOR_GRAY2RGBA);
+        break;
+      case 3:
+        cv::cvtColor(image, image, cv::COLOR_BGR2RGBA);
+        break;
+      case 4:
+        cv::cvtColor(image, image, cv::COLOR_BGRA2RGBA);
+        break;
+      default:
+        LOG(WARNING) << "Not supported channels: " << image.channels() << " of " << icon_name;
+        continue;
+    }
+    cell = std::max(cell, std::max(image.cols, image.rows));
+    icons.emplace_back(icon_name.substr(0, icon_name.rfind('.')), image);
+  }
+  if (icons.empty()) {
+    return false;
+  }
+
+  // pack icons into a square grid of cells, each icon centered in its cell
+  const int cols = std::ceil(std::sqrt(icons.size()));
+  const int rows = (icons.size() + cols - 1) / cols;
+  cv::Mat atlas(rows * cell, cols * cell, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+  for (size_t i = 0; i < icons.size(); ++i) {
+    const auto &image = icons[i].second;
+    const int x = (i % cols) * cell + (cell - image.cols) / 2;
+    const int y = (i / cols) * cell + (cell - image.rows) / 2;
+    image.copyTo(atlas(cv::Rect(x, y, image.cols, image.rows)));
+
+    // texture rows are flipped below, v grows upwards
+    Rect rect;
+    rect.u0 = float(x) / atlas.cols;
+    rect.u1 = float(x + image.cols) / atlas.cols;
+    rect.v0 = 1.f - float(y + image.rows) / atlas.rows;
+    rect.v1 = 1.f - float(y) / atlas.rows;
+    rects_[icons[i].first] = rect;
+  }
+  cv::flip(atlas, atlas, 0);
+
+  auto qimg = QImage(atlas.data, atlas.cols, atlas.rows, atlas.step, QImage::Format_RGBA8888);
+  texture_.reset(new QOpenGLTexture(qimg, QOpenGLTexture::DontGenerateMipMaps));
+  texture_->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+  texture_->setWrapMode(QOpenGLTexture::ClampToEdge);
+
+  // shader
+  program_.reset(new QOpenGLShaderProgram());
+  program_->addShaderFromSourceCode(QOpenGLShader::Vertex, iconVertexShaderSource);
+  program_->addShaderFromSourceCode(QOpenGLShader::Fragment, iconFragmentShaderSource);
+  program_->bindAttributeLocation("corner", 0);
+  program_->bindAttributeLocation("center", 1);
+  program_->bindAttributeLocation("uv_rect", 2);
+  if (!program_->link()) {
+    LOG(ERROR) << "Failed to link icon shader: " << program_->log().toStdString();
+    return false;
+  }
+  loc_mvp_ = program_->uniformLocation("mvp");
+  loc_viewport_ = program_->uniformLocation("viewport");
+  loc_eye_distance_ = program_->uniformLocation("eye_distance");
+
+  // static quad corners and per-instance attributes
+  const float corners[] = {-.5f, -.5f, .5f, -.5f, -.5f, .5f, .5f, .5f};
+  vao_.create();
+  vao_.bind();
+  vbo_corner_.create();
+  vbo_corner_.bind();
+  vbo_corner_.allocate(corners, sizeof(corners));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+  vbo_corner_.release();
+
+  vbo_instance_.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+  vbo_instance_.create();
+  vbo_instance_.bind();
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), nullptr);
+  glVertexAttribDivisor(1, 1);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void *)(offsetof(Instance, u0)));
+  glVertexAttribDivisor(2, 1);
+  vbo_instance_.release();
+  vao_.release();
+
+  available_ = true;
+  return true;
+}
+
+bool IconAtlas::append(const std::string &key, const float x, const float y, const float z,
+                       std::vector<Instance> *instances) const {
+  auto it = rects_.find(key);
+  if (it == rects_.end()) {
+    return false;
+  }
+  instances->push_back({x, y, z, it->second.u0, it->second.v0, it->second.u1, it->second.v1});
+  return true;
+}
+
+void IconAtlas::draw(const std::vector<Instance> &instances, const float *mvp,
+                     const int viewport_w, const int viewport_h, const float eye_distance) {
+  if (!available_ || instances.empty()) {
+    return;
+  }
+
+  GLint program_prev = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program_prev);
+
+  vao_.bind();
+  vbo_instance_.bind();
+  const int count = instances.size();
+  if (count > capacity_) {
+    capacity_ = std::max(count, capacity_ * 2);
+    vbo_instance_.allocate(capacity_ * sizeof(Instance));
+  }
+  vbo_instance_.write(0, instances.data(), count * sizeof(Instance));
+
+  program_->bind();
+  glUniformMatrix4fv(loc_mvp_, 1, GL_FALSE, mvp);
+  glUniform2f(loc_viewport_, viewport_w, viewport_h);
+  glUniform1f(loc_eye_distance_, eye_distance);
+  texture_->bind(0);
+  program_->setUniformValue("atlas", 0);
+
+  // the screen space quads drawn before sat on the near plane, always on top of the scene
+  glDisable(GL_DEPTH_TEST);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+  glEnable(GL_DEPTH_TEST);
+
+  texture_->release();
+  vbo_instance_.release();
+  vao_.release();
+  glUseProgram(program_prev);
+}
+
+}  // namespace airi
+}  // namespace crdc
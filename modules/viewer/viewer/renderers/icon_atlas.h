@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace crdc {
+namespace airi {
+
+/**
+ * @brief All obstacle icons packed into a single texture, drawn as one
+ *        instanced pass of view facing billboards per frame.
+ */
+class IconAtlas : protected QOpenGLExtraFunctions {
+ public:
+  struct Instance {
+    float x, y, z;
+    float u0, v0, u1, v1;
+  };
+
+ public:
+  IconAtlas() = default;
+
+ public:
+  // needs a current GL context
+  bool load(const std::string &dir);
+
+  bool available() const { return available_; }
+
+  // appends an icon at a world position, false if the key is unknown
+  bool append(const std::string &key, const float x, const float y, const float z,
+              std::vector<Instance> *instances) const;
+
+  // one draw call for every icon, sized on screen by the eye distance
+  void draw(const std::vector<Instance> &instances, const float *mvp, const int viewport_w,
+            const int viewport_h, const float eye_distance);
+
+ protected:
+  struct Rect {
+    float u0, v0, u1, v1;
+  };
+
+  bool available_{false};
+  std::unordered_map<std::string, Rect> rects_;
+  std::shared_ptr<QOpenGLTexture> texture_;
+  std::shared_ptr<QOpenGLShaderProgram> program_;
+  QOpenGLVertexArrayObject vao_;
+  QOpenGLBuffer vbo_corner_{QOpenGLBuffer::VertexBuffer};
+  QOpenGLBuffer vbo_instance_{QOpenGLBuffer::VertexBuffer};
+  int capacity_{0};
+  int loc_mvp_{-1};
+  int loc_viewport_{-1};
+  int loc_eye_distance_{-1};
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,224 @@
+#include "viewer/renderers/image_overlay_renderer.h"
+#include <QOpenGLPixelTransferOptions>
+#include <glog/logging.h>
+#include <algorithm>
+#include <set>
+#include "viewer/frame_context.h"
+#include "viewer/global_data.h"
+#include "viewer/image_player.h"
+#include "viewer/image_service.h"
+
+namespace crdc {
+namespace airi {
+
+namespace {
+
+ImageShader::Mode shaderMode(const DecodedImage::Format format) {
+  switch (format) {
+    case DecodedImage::BGR:
+      return ImageShader::PACKED_BGR;
+    case DecodedImage::I420:
+      return ImageShader::YUV_I420;
+    case DecodedImage::NV12:
+      return ImageShader::YUV_NV12;
+    case DecodedImage::GBRP:
+      return ImageShader::PLANAR_GBR;
+    default:
+      // gray is a luminance texture, sampled as rgb it is gray again
+      return ImageShader::PACKED_RGB;
+  }
+}
+
+}  // namespace
+
+void ImageOverlayRenderer::render() {
+  if (!global_data_->image_service_) {
+    return;
+  }
+  if (!shader_tried_) {
+    shader_tried_ = true;
+    shader_.reset(new ImageShader());
+    if (!shader_->initialize()) {
+      LOG(WARNING) << "Image shader not available, converting camera images on the CPU";
+      shader_.reset();
+    }
+  }
+
+  std::set<std::string> shown;
+  const float w = global_data_->glwidget_->width();
+  const float h = global_data_->glwidget_->height();
+  bool state_saved = false;
+  GLboolean depth_test = GL_FALSE;
+  GLboolean blend = GL_FALSE;
+  for (const auto player : global_data_->image_players_) {
+    if (!player->isVisible()) {
+      continue;
+    }
+    const auto channel = player->channel();
+    if (channel == "OFF") {
+      continue;
+    }
+    const auto image = global_data_->image_service_->latest(channel);
+    if (!image || image->planes.empty()) {
+      continue;
+    }
+
+    auto &overlay = overlays_[channel];
+    if (shown.insert(channel).second && overlay.sequence != image->sequence) {
+      upload(&overlay, *image);
+    }
+    if (overlay.planes.empty()) {
+      continue;
+    }
+    touchGpu(overlay.lease);
+
+    const auto rect = player->geometry();
+    if (!shader_) {
+      drawFixedFunction(overlay, rect);
+      continue;
+    }
+
+    if (!state_saved) {
+      depth_test = glIsEnabled(GL_DEPTH_TEST);
+      blend = glIsEnabled(GL_BLEND);
+      glDisable(GL_DEPTH_TEST);
+      glDisable(GL_BLEND);
+      state_saved = true;
+    }
+
+    // players are laid out in logical pixels of the GL widget, y down
+    const float ndc[4] = {2.f * rect.x() / w - 1.f, 1.f - 2.f * (rect.y() + rect.height()) / h,
+                          2.f * (rect.x() + rect.width()) / w - 1.f, 1.f - 2.f * rect.y() / h};
+    QOpenGLTexture *planes[3] = {nullptr, nullptr, nullptr};
+    const int count = std::min<int>(3, overlay.planes.size());
+    for (int i = 0; i < count; ++i) {
+      planes[i] = overlay.planes[i].get();
+    }
+    shader_->draw(ndc, overlay.mode, overlay.full_range, planes, count, overlay.scales.data());
+  }
+
+  if (state_saved) {
+    if (depth_test) {
+      glEnable(GL_DEPTH_TEST);
+    }
+    if (blend) {
+      glEnable(GL_BLEND);
+    }
+  }
+
+  // textures of channels nobody shows any more
+  for (auto it = overlays_.begin(); it != overlays_.end();) {
+    if (shown.count(it->first)) {
+      ++it;
+    } else {
+      it = overlays_.erase(it);
+    }
+  }
+}
+
+void ImageOverlayRenderer::upload(Overlay *overlay, const DecodedImage &image) {
+  std::vector<cv::Mat> planes = image.planes;
+  overlay->mode = shaderMode(image.format);
+  overlay->full_range = image.full_range;
+  if (!shader_) {
+    planes = {image.rgb()};
+    overlay->mode = ImageShader::PACKED_RGB;
+  }
+
+  overlay->planes.resize(planes.size());
+  overlay->scales.resize(planes.size(), 1.f);
+  size_t bytes = 0;
+  bool reallocated = false;
+  for (size_t i = 0; i < planes.size(); ++i) {
+    // rows have to be whole pixels to upload them with their padding
+    if (planes[i].step[0] % planes[i].elemSize() != 0) {
+      planes[i] = planes[i].clone();
+    }
+    reallocated |= uploadPlane(&overlay->planes[i], planes[i], &overlay->scales[i]);
+    bytes += planes[i].step[0] * planes[i].rows;
+  }
+  if (reallocated || !overlay->lease) {
+    overlay->lease = trackGpu(bytes);
+  }
+  overlay->sequence = image.sequence;
+}
+
+bool ImageOverlayRenderer::uploadPlane(std::shared_ptr<QOpenGLTexture> *texture,
+                                       const cv::Mat &plane, float *scale) {
+  QOpenGLTexture::TextureFormat format = QOpenGLTexture::LuminanceFormat;
+  QOpenGLTexture::PixelFormat pixels = QOpenGLTexture::Luminance;
+  if (plane.channels() == 2) {
+    format = QOpenGLTexture::LuminanceAlphaFormat;
+    pixels = QOpenGLTexture::LuminanceAlpha;
+  } else if (plane.channels() == 3) {
+    // bgr is swapped by the shader
+    format = QOpenGLTexture::RGB8_UNorm;
+    pixels = QOpenGLTexture::RGB;
+  }
+  const int stride = plane.step[0] / plane.elemSize();
+  *scale = static_cast<float>(plane.cols) / stride;
+
+  // the texture is reused while the resolution and layout stay
+  bool reallocated = false;
+  auto &tex = *texture;
+  if (!tex || tex->width() != stride || tex->height() != plane.rows || tex->format() != format) {
+    tex.reset(new QOpenGLTexture(QOpenGLTexture::Target2D));
+    tex->setSize(stride, plane.rows);
+    tex->setFormat(format);
+    tex->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+    tex->setWrapMode(QOpenGLTexture::ClampToEdge);
+    tex->allocateStorage(pixels, QOpenGLTexture::UInt8);
+    reallocated = true;
+  }
+
+  // rows of 1, 2 or 3 byte pixels are not 4 byte aligned
+  QOpenGLPixelTransferOptions options;
+  options.setAlignment(1);
+  tex->setData(pixels, QOpenGLTexture::UInt8, plane.data, &options);
+  return reallocated;
+}
+
+void ImageOverlayRenderer::drawFixedFunction(const Overlay &overlay, const QRect &rect) {
+  const float w = global_data_->glwidget_->width();
+  const float h = global_data_->glwidget_->height();
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0.0, w, 0.0, h, -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glEnable(GL_TEXTURE_2D);
+  glColor4f(1, 1, 1, 1);
+
+  const float left = rect.x();
+  const float right = rect.x() + rect.width();
+  const float top = h - rect.y();
+  const float bottom = h - rect.y() - rect.height();
+  const float s = overlay.scales[0];
+  overlay.planes[0]->bind();
+  glBegin(GL_QUADS);
+    glTexCoord2f(0, 1);
+    glVertex2f(left, bottom);
+    glTexCoord2f(s, 1);
+    glVertex2f(right, bottom);
+    glTexCoord2f(s, 0);
+    glVertex2f(right, top);
+    glTexCoord2f(0, 0);
+    glVertex2f(left, top);
+  glEnd();
+  overlay.planes[0]->release();
+
+  glPopAttrib();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+}
+
+}  // namespace airi
+}  // namespace crdc
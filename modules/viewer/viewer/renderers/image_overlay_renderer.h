@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QOpenGLTexture>
+#include <QRect>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "viewer/renderers/image_shader.h"
+#include "viewer/renderers/renderer.h"
+
+namespace crdc {
+namespace airi {
+
+struct DecodedImage;
+
+// camera images of the shown image players, drawn as textured quads under the players,
+// the planes are uploaded as decoded and converted to rgb in a shader
+class ImageOverlayRenderer : public Renderer {
+ public:
+  std::string name() const override { return "ImageOverlayRenderer"; }
+
+  bool enabled() const override { return true; }
+
+  void render() override;
+
+ protected:
+  struct Overlay {
+    std::vector<std::shared_ptr<QOpenGLTexture>> planes;
+    // used fraction of each texture's width, the rest is row padding
+    std::vector<float> scales;
+    ImageShader::Mode mode{ImageShader::PACKED_RGB};
+    bool full_range{false};
+    std::shared_ptr<GpuLease> lease;
+    uint64_t sequence{0};
+  };
+
+  // only when the channel has a new image, the GPU scales it to the player
+  void upload(Overlay *overlay, const DecodedImage &image);
+
+  // false if the plane has to be repacked into a texture of its own
+  bool uploadPlane(std::shared_ptr<QOpenGLTexture> *texture, const cv::Mat &plane,
+                   float *scale);
+
+  // without shaders the image was converted on the CPU and is a single rgb plane
+  void drawFixedFunction(const Overlay &overlay, const QRect &rect);
+
+ protected:
+  std::unique_ptr<ImageShader> shader_;
+  bool shader_tried_{false};
+  // per channel, players showing the same channel share the texture
+  std::unordered_map<std::string, Overlay> overlays_;
+};
+
+}  // namespace airi
+}  // namespace crdc
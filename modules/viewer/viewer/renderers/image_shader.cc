@@ -0,0 +1,125 @@
+#include "viewer/renderers/image_shader.h"
+#include <glog/logging.h>
+
+namespace crdc {
+namespace airi {
+
+static const char *imageVertexShaderSource =
+    "attribute vec2 corner;\n"
+    "uniform vec4 rect;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "   uv = vec2(corner.x, 1.0 - corner.y);\n"
+    "   gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);\n"
+    "}\n";
+
+// bt.601, limited range is expanded first, chroma of I420 comes from two planes
+// and of NV12 from the luminance and alpha of one
+static const char *imageFragmentShaderSource =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D plane0;\n"
+    "uniform sampler2D plane1;\n"
+    "uniform sampler2D plane2;\n"
+    "uniform int mode;\n"
+    "uniform vec3 range;\n"
+    "uniform vec3 scale;\n"
+    "varying vec2 uv;\n"
+    "vec4 texel(sampler2D plane, float s) {\n"
+    "   return texture2D(plane, vec2(uv.x * s, uv.y));\n"
+    "}\n"
+    "void main() {\n"
+    "   vec3 rgb;\n"
+    "   if (mode == 0) {\n"
+    "     rgb = texel(plane0, scale.x).rgb;\n"
+    "   } else if (mode == 1) {\n"
+    "     rgb = texel(plane0, scale.x).bgr;\n"
+    "   } else if (mode == 4) {\n"
+    "     rgb = vec3(texel(plane2, scale.z).r, texel(plane0, scale.x).r,\n"
+    "                texel(plane1, scale.y).r);\n"
+    "   } else {\n"
+    "     float y = (texel(plane0, scale.x).r - range.x) * range.y;\n"
+    "     vec2 c = mode == 2 ? vec2(texel(plane1, scale.y).r, texel(plane2, scale.z).r)\n"
+    "                        : texel(plane1, scale.y).ra;\n"
+    "     c = (c - 0.5) * range.z;\n"
+    "     rgb = vec3(y + 1.402 * c.y, y - 0.344136 * c.x - 0.714136 * c.y, y + 1.772 * c.x);\n"
+    "   }\n"
+    "   gl_FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+    "}\n";
+
+bool ImageShader::initialize() {
+  initializeOpenGLFunctions();
+
+  program_.reset(new QOpenGLShaderProgram());
+  program_->addShaderFromSourceCode(QOpenGLShader::Vertex, imageVertexShaderSource);
+  program_->addShaderFromSourceCode(QOpenGLShader::Fragment, imageFragmentShaderSource);
+  program_->bindAttributeLocation("corner", 0);
+  if (!program_->link()) {
+    LOG(ERROR) << "Failed to link image shader: " << program_->log().toStdString();
+    return false;
+  }
+  loc_rect_ = program_->uniformLocation("rect");
+  loc_mode_ = program_->uniformLocation("mode");
+  loc_range_ = program_->uniformLocation("range");
+  loc_scale_ = program_->uniformLocation("scale");
+  program_->bind();
+  program_->setUniformValue("plane0", 0);
+  program_->setUniformValue("plane1", 1);
+  program_->setUniformValue("plane2", 2);
+  program_->release();
+
+  const float corners[] = {0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 1.f, 1.f};
+  vao_.reset(new QOpenGLVertexArrayObject());
+  vbo_.reset(new QOpenGLBuffer(QOpenGLBuffer::Type::VertexBuffer));
+  vao_->create();
+  vao_->bind();
+  vbo_->create();
+  vbo_->bind();
+  vbo_->allocate(corners, sizeof(corners));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, nullptr);
+  vbo_->release();
+  vao_->release();
+
+  available_ = true;
+  return true;
+}
+
+void ImageShader::draw(const float *rect, const Mode mode, const bool full_range,
+                       QOpenGLTexture *const *planes, const int count, const float *scales) {
+  if (!available_ || count <= 0) {
+    return;
+  }
+
+  GLint program_prev = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program_prev);
+
+  program_->bind();
+  glUniform4fv(loc_rect_, 1, rect);
+  glUniform1i(loc_mode_, mode);
+  if (full_range) {
+    glUniform3f(loc_range_, 0.f, 1.f, 1.f);
+  } else {
+    glUniform3f(loc_range_, 16.f / 255.f, 255.f / 219.f, 255.f / 224.f);
+  }
+  float scale[3] = {1.f, 1.f, 1.f};
+  for (int i = 0; i < count && i < 3; ++i) {
+    scale[i] = scales[i];
+    planes[i]->bind(i);
+  }
+  glUniform3fv(loc_scale_, 1, scale);
+
+  vao_->bind();
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  vao_->release();
+
+  for (int i = 0; i < count && i < 3; ++i) {
+    planes[i]->release(i);
+  }
+  glActiveTexture(GL_TEXTURE0);
+  glUseProgram(program_prev);
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include <memory>
+
+namespace crdc {
+namespace airi {
+
+/**
+ * @brief Draws a camera image from its planes as they were decoded, packed rgb,
+ *        planar or semi planar yuv, the color conversion runs per pixel on the GPU.
+ */
+class ImageShader : protected QOpenGLFunctions {
+ public:
+  // layout of the planes, bgr is uploaded as rgb and swizzled here
+  enum Mode { PACKED_RGB = 0, PACKED_BGR, YUV_I420, YUV_NV12, PLANAR_GBR };
+
+ public:
+  ImageShader() = default;
+
+ public:
+  // needs a current GL context
+  bool initialize();
+
+  bool available() const { return available_; }
+
+  // rect is left, bottom, right, top in normalized device coordinates, scales are the
+  // used fraction of each plane's width, which is padded to the row stride
+  void draw(const float *rect, const Mode mode, const bool full_range,
+            QOpenGLTexture *const *planes, const int count, const float *scales);
+
+ protected:
+  bool available_{false};
+  std::shared_ptr<QOpenGLShaderProgram> program_;
+  std::shared_ptr<QOpenGLVertexArrayObject> vao_;
+  std::shared_ptr<QOpenGLBuffer> vbo_;
+  int loc_rect_{-1};
+  int loc_mode_{-1};
+  int loc_range_{-1};
+  int loc_scale_{-1};
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -1,7 +1,11 @@
 #include "viewer/renderers/marker_renderer.h"
 
+#include "viewer/frame_context.h"
+#include "viewer/frame_profiler.h"
 #include "viewer/global_data.h"
 #include "viewer/renderer_manager.h"
+#include "viewer/renderers/render_queue.h"
+#include "viewer/renderers/triangulation_service.h"
 #include "viewer/widgets/renderer_item.h"
 
 namespace crdc {
@@ -12,8 +16,9 @@ class MarkerChannel : public Renderer {
   MarkerChannel(const std::string &channel, RendererItem *renderer_item) : channel_(channel) {
     item_ = new RendererItem(QString::fromStdString(channel), enabled(),
                                  [&](bool is_checked) {
-      auto channel_enable = global_data_->config_.mutable_marker_channel_enable();
-      (*channel_enable)[channel_] = is_checked;
+      global_data_->updateConfig([&](viewer::Config *config) {
+        (*config->mutable_marker_channel_enable())[channel_] = is_checked;
+      });
     });
     renderer_item->addWidget(item_);
   }
@@ -25,12 +30,42 @@ class MarkerChannel : public Renderer {
     return (it != global_data_->config_.marker_channel_enable().end() && (it->second));
   }
 
-  void render() override {
+  void prepare(const std::shared_ptr<const FrameContext> &frame) override {
+    Renderer::prepare(frame);
+    if (msg_ && needs_rebuild_) {
+      needs_rebuild_ = false;
+      rebuild();
+    }
+  }
+
+  void submit() override {
     if (!msg_) {
       return;
     }
 
-    for (const auto &marker : msg_->markers()) {
+    // vertices live in the frame arena, so they are uploaded in the frame they were built
+    if (needs_upload_ && built_sequence_ != frame_->sequence) {
+      needs_upload_ = false;
+      needs_rebuild_ = true;
+      vertexs_.clear();
+      requestRedraw();
+      return;
+    }
+    if (needs_upload_) {
+      needs_upload_ = false;
+      buffers_.clear();
+      buffers_.resize(vertexs_.size());
+      for (size_t i = 0; i < vertexs_.size(); ++i) {
+        const auto &vertex = vertexs_[i];
+        if (!vertex.points.empty()) {
+          buffers_[i] = generateGLBuffer(vertex.points, vertex.indices);
+        }
+      }
+      vertexs_.clear();
+    }
+
+    for (int marker_no = 0; marker_no < msg_->markers_size(); ++marker_no) {
+      const auto &marker = msg_->markers(marker_no);
       if (!marker.on_off()) {
         continue;
       }
@@ -67,65 +102,88 @@ class MarkerChannel : public Renderer {
         glLineWidth(marker.line_width());
       }
 
+      // all markers go through the queue, grouped by point size and line width and in
+      // list order within a group, so the order does not depend on the marker type
+      RenderState state;
+      state.point_size = marker.has_point_size() ? marker.point_size() : 0.f;
+      state.line_width = marker.has_line_width() ? marker.line_width() : 0.f;
+      auto *buffer = &buffers_[marker_no];
+
       // draw according to marker type
       if (marker.has_points()) {
-        if (marker.points().points_size() == 0) {
-          continue;
-        }
-        std::vector<Eigen::VectorXf> points;
-        points.reserve(marker.points().points_size());
-        for (const auto &pt : marker.points().points()) {
-          points.push_back(Eigen::Vector3f(pt.x(), pt.y(), pt.z()));
-        }
-        drawPoints(points);
+        enqueue(state, [this, buffer]() { drawArrays(GL_POINTS, *buffer); });
       } else if (marker.has_lines()) {
-        const int num_pairs = marker.lines().points_size() / 2;
-        if (num_pairs == 0) {
-          continue;
-        }
-        std::vector<Eigen::VectorXf> points;
-        points.reserve(marker.lines().points_size());
-        for (int i = 0; i < num_pairs * 2; ++i) {
-          const auto &pt = marker.lines().points(i);
-          points.push_back(Eigen::Vector3f(pt.x(), pt.y(), pt.z()));
-        }
-        drawLines(points);
+        enqueue(state, [this, buffer]() { drawArrays(GL_LINES, *buffer); });
       } else if (marker.has_line_strip()) {
-        if (marker.line_strip().points_size() < 2) {
-          continue;
-        }
-        std::vector<Eigen::VectorXf> points;
-        points.reserve(marker.line_strip().points_size());
-        for (const auto &pt : marker.line_strip().points()) {
-          points.push_back(Eigen::Vector3f(pt.x(), pt.y(), pt.z()));
-        }
-        drawLineStrip(points);
+        enqueue(state, [this, buffer]() { drawArrays(GL_LINE_STRIP, *buffer); });
       } else if (marker.has_arrow()) {
         const auto &from = marker.arrow().from();
         const auto &to = marker.arrow().to();
-        drawArrow(Eigen::Vector3f(from.x(), from.y(), from.z()),
-                  Eigen::Vector3f(to.x(), to.y(), to.z()), marker.arrow().scale());
+        const Eigen::Vector3f start(from.x(), from.y(), from.z());
+        const Eigen::Vector3f end(to.x(), to.y(), to.z());
+        const float scale = marker.arrow().scale();
+        enqueue(state, [this, start, end, scale]() { drawArrow(start, end, scale); });
       } else if (marker.has_triangles()) {
-        const int num_tripples = marker.triangles().points_size() / 3;
-        if (num_tripples == 0) {
-          continue;
-        }
-        std::vector<Eigen::VectorXf> points;
-        points.reserve(marker.triangles().points_size());
-        for (int i = 0; i < num_tripples * 3; ++i) {
-          const auto &pt = marker.triangles().points(i);
-          points.push_back(Eigen::Vector3f(pt.x(), pt.y(), pt.z()));
-        }
-        drawTriangles(points);
+        enqueue(state, [this, buffer]() { drawArrays(GL_TRIANGLES, *buffer); });
       } else if (marker.has_sphere()) {
         const auto &center = marker.sphere().center();
-        drawSphere(Eigen::Vector3f(center.x(), center.y(), center.z()), marker.sphere().radius());
+        const Eigen::Vector3f position(center.x(), center.y(), center.z());
+        const float radius = marker.sphere().radius();
+        enqueue(state, [this, position, radius]() { drawSphere(position, radius); });
       } else if (marker.has_cube()) {
         const auto &cube = marker.cube();
-        const auto &center = cube.center();
-        drawBoundingBox(Eigen::Vector3f(center.x(), center.y(), center.z()),
-                        Eigen::Vector3f(cube.length(), cube.width(), cube.height()), cube.heading(),
-                        true, false);
+        const Eigen::Vector3f center(cube.center().x(), cube.center().y(), cube.center().z());
+        const Eigen::Vector3f lwh(cube.length(), cube.width(), cube.height());
+        const float heading = cube.heading();
+        enqueue(state, [this, center, lwh, heading]() {
+          drawBoundingBox(center, lwh, heading, true, false);
+        });
+      } else if (marker.has_polygon()) {
+        enqueue(state, [this, buffer]() { drawElements(GL_TRIANGLES, *buffer); });
+      } else if (marker.has_text()) {
+        const auto &pos = marker.text().position();
+        const Eigen::Vector3f position(pos.x(), pos.y(), pos.z());
+        const auto text = marker.text().text();
+        const int font_size = marker.text().font_size();
+        const bool bold = marker.text().bold();
+        enqueue(state, [this, position, text, font_size, bold]() {
+          drawText(position, text, font_size, bold);
+        });
+      }
+    }
+  }
+
+  void loadConfigPost() override {
+    item_->setChecked(enabled());
+  }
+
+  void update(const std::shared_ptr<MarkerList> &msg) {
+    msg_ = msg;
+    needs_rebuild_ = true;
+  }
+
+ protected:
+  // builds the vertex data of every marker once per message into the frame arena,
+  // uploaded in submit()
+  void rebuild() {
+    vertexs_.clear();
+    vertexs_.resize(msg_->markers_size());
+    for (int marker_no = 0; marker_no < msg_->markers_size(); ++marker_no) {
+      const auto &marker = msg_->markers(marker_no);
+      auto &vertex = vertexs_[marker_no];
+      if (marker.has_points()) {
+        vertex = generatePointVertex(marker.points().points(), marker.points().points_size());
+      } else if (marker.has_lines()) {
+        const int num_pairs = marker.lines().points_size() / 2;
+        vertex = generatePointVertex(marker.lines().points(), num_pairs * 2);
+      } else if (marker.has_line_strip()) {
+        if (marker.line_strip().points_size() >= 2) {
+          vertex = generatePointVertex(marker.line_strip().points(),
+                                       marker.line_strip().points_size());
+        }
+      } else if (marker.has_triangles()) {
+        const int num_tripples = marker.triangles().points_size() / 3;
+        vertex = generatePointVertex(marker.triangles().points(), num_tripples * 3);
       } else if (marker.has_polygon()) {
         if (marker.polygon().point_size() < 3) {
           continue;
@@ -142,34 +200,59 @@ class MarkerChannel : public Renderer {
         //   glTranslatef(0, 0, marker.polygon().point().z());
         // }
         // drawPolygon(points);
-        std::vector<std::vector<Eigen::Vector2f>> polygons;
-        polygons.push_back(std::move(points));
-        auto buffer = generateGLBuffer(polygons);
-        drawElements(GL_TRIANGLES, buffer);
-      } else if (marker.has_text()) {
-        const auto &pos = marker.text().position();
-        drawText(Eigen::Vector3f(pos.x(), pos.y(), pos.z()), marker.text().text(),
-                 marker.text().font_size(), marker.text().bold());
+        vertex.indices =
+            crdc::airi::common::Singleton<TriangulationService>::get()->triangulate(points);
+        if (!vertex.indices.empty()) {
+          auto p = arena()->allocate<Eigen::Vector3f>(points.size());
+          for (size_t i = 0; i < points.size(); ++i) {
+            p[i] << points[i], 0.f;
+          }
+          vertex.points = VertexSpan<Eigen::Vector3f>(p, points.size());
+        }
       }
     }
+    built_sequence_ = frame_->sequence;
+    needs_upload_ = true;
   }
 
-  void loadConfigPost() override {
-    item_->setChecked(enabled());
-  }
+  struct MarkerVertex {
+    VertexSpan<Eigen::Vector3f> points;
+    std::vector<unsigned int> indices;
+  };
 
-  void update(const std::shared_ptr<MarkerList> &msg) { msg_ = msg; }
+  template <typename Points>
+  MarkerVertex generatePointVertex(const Points &points, const int count) const {
+    MarkerVertex vertex;
+    if (count <= 0) {
+      return vertex;
+    }
+    auto p = arena()->allocate<Eigen::Vector3f>(count);
+    for (int i = 0; i < count; ++i) {
+      const auto &pt = points.Get(i);
+      p[i] << pt.x(), pt.y(), pt.z();
+    }
+    vertex.points = VertexSpan<Eigen::Vector3f>(p, count);
+    return vertex;
+  }
 
  protected:
   RendererItem *item_;
   const std::string channel_;
   std::shared_ptr<MarkerList> msg_;
+  bool needs_rebuild_{false};
+  bool needs_upload_{false};
+  uint64_t built_sequence_{0};
+  std::vector<MarkerVertex> vertexs_;
+  std::vector<GLBuffer> buffers_;
 };
 
 MarkerRenderer::MarkerRenderer() {
   item_ = new RendererItem(
       "Marker", global_data_->config_.marker_renderer_enable(),
-      [&](bool is_checked) { global_data_->config_.set_marker_renderer_enable(is_checked); });
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_marker_renderer_enable(is_checked); });
+      });
   global_data_->renderer_manager_->addWidget(item_);
 }
 
@@ -186,10 +269,11 @@ void MarkerRenderer::initialize() {
         }
         msgs_[channel] = msg;
         needs_update_[channel] = true;
+        requestRedraw();
       });
 }
 
-void MarkerRenderer::render() {
+void MarkerRenderer::schedule(std::vector<Renderer *> *tasks) {
   std::unique_lock<std::mutex> lock(mutex_);
 
   // update widgets
@@ -215,10 +299,22 @@ void MarkerRenderer::render() {
 
   lock.unlock();
 
-  // render
   for (auto &channel : channels_) {
     if (channel.second->enabled()) {
-      channel.second->render();
+      tasks->push_back(channel.second.get());
+    }
+  }
+}
+
+void MarkerRenderer::submit() {
+  if (!enabled()) {
+    return;
+  }
+
+  for (auto &channel : channels_) {
+    if (channel.second->enabled()) {
+      FrameProfiler::Scope scope(global_data_->profiler_.get(), channel.second.get());
+      channel.second->submit();
     }
   }
 }
@@ -1,10 +1,16 @@
 #include "viewer/renderers/perception_renderer.h"
 #include <QLabel>
 #include <QLineEdit>
+#include <QVector4D>
+#include <algorithm>
+#include <atomic>
 #include "common/io/file.h"
 #include "viewer/global_data.h"
 #include "viewer/camera.h"
+#include "viewer/frame_context.h"
+#include "viewer/frame_profiler.h"
 #include "viewer/renderer_manager.h"
+#include "viewer/renderers/icon_atlas.h"
 #include "viewer/widgets/check_box.h"
 #include "viewer/widgets/push_button.h"
 #include "viewer/widgets/renderer_item.h"
@@ -20,8 +26,9 @@ class PerceptionChannel : public Renderer {
  public:
   PerceptionChannel(const std::string &channel, RendererItem *renderer_item) : channel_(channel) {
     item_ = new RendererItem(QString::fromStdString(channel), enabled(), [&](bool is_checked) {
-      auto channel_enable = global_data_->config_.mutable_perception_channel_enable();
-      (*channel_enable)[channel_] = is_checked;
+      global_data_->updateConfig([&](viewer::Config *config) {
+        (*config->mutable_perception_channel_enable())[channel_] = is_checked;
+      });
     });
     renderer_item->addWidget(item_);
 
@@ -30,7 +37,10 @@ class PerceptionChannel : public Renderer {
       auto hbox = new QHBoxLayout();
       auto label = new QLabel("IDs:");
       auto edit = new QLineEdit();
-      auto bt_edit = new PushButton("OK", [&, edit]() { filter_str_ = edit->text(); });
+      auto bt_edit = new PushButton("OK", [&, edit]() {
+        filter_str_ = edit->text();
+        needs_rebuild_ = true;
+      });
       item_->addWidget(label_exp);
       hbox->addWidget(label);
       hbox->addWidget(edit);
@@ -41,16 +51,16 @@ class PerceptionChannel : public Renderer {
     auto label_shape = new QLabel("Shape:");
     item_->addWidget(label_shape);
 
-    auto cb_bbox =
-        new CheckBox("Bounding Box", show_bbox_, [&](bool is_checked) { show_bbox_ = is_checked; });
+    auto cb_bbox = new CheckBox("Bounding Box", show_bbox_, toggle(&show_bbox_));
     item_->addWidget(cb_bbox);
 
     auto cb_convex_hull = new CheckBox("Convex Hull", show_convex_hull_,
-                                       [&](bool is_checked) { show_convex_hull_ = is_checked; });
+                                       toggle(&show_convex_hull_));
     item_->addWidget(cb_convex_hull);
 
     auto cb_auto = new CheckBox("Auto", false, [&, cb_bbox, cb_convex_hull](bool is_checked) {
       show_auto_ = is_checked;
+      needs_rebuild_ = true;
       cb_bbox->setEnabled(!is_checked);
       cb_convex_hull->setEnabled(!is_checked);
     });
@@ -60,58 +70,50 @@ class PerceptionChannel : public Renderer {
     auto label_info = new QLabel("Information:");
     item_->addWidget(label_info);
 
-    auto cb_icon =
-        new CheckBox("Icon", show_icon_, [&](bool is_checked) { show_icon_ = is_checked; });
+    auto cb_icon = new CheckBox("Icon", show_icon_, toggle(&show_icon_));
     item_->addWidget(cb_icon);
 
-    auto cb_id = new CheckBox("ID", show_id_, [&](bool is_checked) { show_id_ = is_checked; });
+    auto cb_id = new CheckBox("ID", show_id_, toggle(&show_id_));
     item_->addWidget(cb_id);
 
-    auto cb_distance = new CheckBox("Distance", show_distance_,
-                                    [&](bool is_checked) { show_distance_ = is_checked; });
+    auto cb_distance = new CheckBox("Distance", show_distance_, toggle(&show_distance_));
     item_->addWidget(cb_distance);
 
-    auto cb_velocity = new CheckBox("Velocity", show_velocity_,
-                                    [&](bool is_checked) { show_velocity_ = is_checked; });
+    auto cb_velocity = new CheckBox("Velocity", show_velocity_, toggle(&show_velocity_));
     item_->addWidget(cb_velocity);
 
     auto cb_acceleration = new CheckBox("Acceleration", show_acceleration_,
-                                        [&](bool is_checked) { show_acceleration_ = is_checked; });
+                                        toggle(&show_acceleration_));
     item_->addWidget(cb_acceleration);
 
-    auto cb_yaw_rate = new CheckBox("Yaw Rate", show_yaw_rate_,
-                                    [&](bool is_checked) { show_yaw_rate_ = is_checked; });
+    auto cb_yaw_rate = new CheckBox("Yaw Rate", show_yaw_rate_, toggle(&show_yaw_rate_));
     item_->addWidget(cb_yaw_rate);
 
     auto cb_track_status = new CheckBox("Track Status", show_track_status_,
-                                        [&](bool is_checked) { show_track_status_ = is_checked; });
+                                        toggle(&show_track_status_));
     item_->addWidget(cb_track_status);
 
     auto cb_light_status = new CheckBox("Light Status", show_light_status_,
-                                        [&](bool is_checked) { show_light_status_ = is_checked; });
+                                        toggle(&show_light_status_));
     item_->addWidget(cb_light_status);
 
-    auto cb_subtype = new CheckBox("Subtype", show_subtype_,
-                                   [&](bool is_checked) { show_subtype_ = is_checked; });
+    auto cb_subtype = new CheckBox("Subtype", show_subtype_, toggle(&show_subtype_));
     item_->addWidget(cb_subtype);
     auto cb_min_height = new CheckBox("MinHeight", show_cb_min_height_,
-                                   [&](bool is_checked) { show_cb_min_height_ = is_checked; });
+                                   toggle(&show_cb_min_height_));
     item_->addWidget(cb_min_height);
 
-    auto cb_t_init2now = new CheckBox("t_init2now", show_t_init2now_,
-                                   [&](bool is_checked) { show_t_init2now_ = is_checked; });
+    auto cb_t_init2now = new CheckBox("t_init2now", show_t_init2now_, toggle(&show_t_init2now_));
     item_->addWidget(cb_t_init2now);
 
     auto cb_t_update2now = new CheckBox("t_update2now", show_t_update2now_,
-                                      [&](bool is_checked) { show_t_update2now_ = is_checked; });
+                                      toggle(&show_t_update2now_));
     item_->addWidget(cb_t_update2now);
 
-    auto cb_height = new CheckBox("height", show_height_,
-                                  [&](bool is_checked) { show_height_ = is_checked; });
+    auto cb_height = new CheckBox("height", show_height_, toggle(&show_height_));
     item_->addWidget(cb_height);
 
-    auto cb_confidence = new CheckBox("confidence", show_confidence_,
-                                  [&](bool is_checked) { show_confidence_ = is_checked; });
+    auto cb_confidence = new CheckBox("confidence", show_confidence_, toggle(&show_confidence_));
     item_->addWidget(cb_confidence);
   }
 
@@ -123,15 +125,168 @@ class PerceptionChannel : public Renderer {
     return (it != global_data_->config_.perception_channel_enable().end() && (it->second));
   }
 
-  void render() override {
+  void prepare(const std::shared_ptr<const FrameContext> &frame) override {
+    Renderer::prepare(frame);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_msg_) {
+        msg_ = std::move(pending_msg_);
+        needs_rebuild_ = true;
+      }
+    }
     if (!msg_) {
       return;
     }
 
-    if (global_data_->config_.has_perception_line_width()) {
-      glLineWidth(global_data_->config_.perception_line_width());
+    const bool rebuilt = needs_rebuild_.exchange(false);
+    if (rebuilt) {
+      rebuild();
+    }
+
+    // distance labels follow the ego pose, everything else only the message
+    const auto &position = frame->pose->pose().position();
+    if (rebuilt || position.x() != pose_x_ || position.y() != pose_y_) {
+      pose_x_ = position.x();
+      pose_y_ = position.y();
+      updateDistances();
+    }
+  }
+
+  void submit() override {
+    if (!msg_) {
+      return;
+    }
+
+    if (frame_->config->has_perception_line_width()) {
+      glLineWidth(frame_->config->perception_line_width());
+    }
+
+    if (needs_upload_) {
+      needs_upload_ = false;
+      lines_.clear();
+      for (const auto &group : pending_lines_) {
+        const auto &points = group.second;
+        Eigen::Map<const Eigen::MatrixXf> vertex(points.data(), 3, points.size() / 3);
+        lines_.push_back({group.first, generateGLBuffer(vertex, 3, 0)});
+      }
+      pending_lines_.clear();
     }
 
+    const float offset_z = is_global_ ? frame_->poseZ() : 0.f;
+    GLPushGuard pg;
+    if (is_global_) {
+      glTranslatef(0, 0, offset_z);
+    }
+
+    for (auto &group : lines_) {
+#ifdef __aarch64__
+      global_data_->glwidget_->setColor(group.color);
+#else
+      glColor4f(group.color.x(), group.color.y(), group.color.z(), group.color.w());
+#endif
+      drawArrays(GL_LINES, group.buffer);
+    }
+
+    for (const auto &light : lights_) {
+      GLPushGuard pg;
+      glTranslatef(light.position.x(), light.position.y(), light.position.z());
+      glRotatef(light.theta * 180.f / M_PI, 0, 0, 1);
+      glPushAttrib(GL_CURRENT_BIT);
+#ifdef __aarch64__
+      global_data_->glwidget_->setColor(light.color);
+#else
+      glColor4f(light.color.x(), light.color.y(), light.color.z(), light.color.w());
+#endif
+      drawSphere(light.offset, 0.1f);
+      glPopAttrib();
+    }
+
+    // over budget only the labels closest to the eye are drawn
+    std::vector<const Label *> labels;
+    labels.reserve(labels_.size());
+    for (const auto &label : labels_) {
+      labels.push_back(&label);
+    }
+    if (labels.size() > quality().max_labels) {
+      const Eigen::Vector3f eye(frame_->eye.x, frame_->eye.y, frame_->eye.z - offset_z);
+      std::nth_element(labels.begin(), labels.begin() + quality().max_labels, labels.end(),
+                       [&eye](const Label *a, const Label *b) {
+                         return (a->position - eye).squaredNorm() <
+                                (b->position - eye).squaredNorm();
+                       });
+      labels.resize(quality().max_labels);
+    }
+    for (const auto label : labels) {
+#ifdef __aarch64__
+      global_data_->glwidget_->setColor(label->color);
+#else
+      glColor4f(label->color.x(), label->color.y(), label->color.z(), label->color.w());
+#endif
+      drawText(label->position, label->text, 20, true);
+    }
+
+    // icons are placed in world coordinates, not under the matrix stack
+    if (!icons_.empty()) {
+      const glm::mat4 mvp = glm::translate(frame_->mvp, glm::vec3(0.f, 0.f, offset_z));
+      global_data_->icon_atlas_->draw(icons_, glm::value_ptr(mvp), frame_->viewport_w,
+                                      frame_->viewport_h, frame_->eye_distance);
+      global_data_->profiler_->countDraw(icons_.size() * 4);
+    } else if (!icon_keys_.empty()) {
+      const auto &eye_dis = frame_->eye_distance;
+      int icon_size = eye_dis * (-0.8) + 48;
+      icon_size = (icon_size < 12 ? 12 : (icon_size > 48 ? 48 : icon_size));
+#ifdef __aarch64__
+      global_data_->glwidget_->setColor(QVector4D(1.0f, 1.0f, 1.0f, 1.0f));
+#else
+      glColor4f(1, 1, 1, 1);
+#endif
+      for (const auto &icon : icon_keys_) {
+        auto it = global_data_->textures_.find(icon.first);
+        if (it != global_data_->textures_.end()) {
+          renderTextureViewFacing(it->second, icon.second + Eigen::Vector3f(0.f, 0.f, offset_z),
+                                  icon_size);
+        }
+      }
+    }
+  }
+
+  void loadConfigPost() override {
+    item_->setChecked(enabled());
+    needs_rebuild_ = true;
+  }
+
+  void update(const std::shared_ptr<PerceptionObstacles> &msg) {
+    // taken over by the next prepare(), which reads msg_ on a worker thread
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_msg_ = msg;
+  }
+
+ protected:
+  std::function<void(bool)> toggle(bool *option) {
+    return [this, option](bool is_checked) {
+      *option = is_checked;
+      needs_rebuild_ = true;
+    };
+  }
+
+  // rewrites only the text of the distance labels for the current ego pose
+  void updateDistances() {
+    char distance_str[128];
+    for (const auto &distance : distances_) {
+      sprintf(distance_str, "%.2f", std::hypot(distance.x - pose_x_, distance.y - pose_y_));
+      labels_[distance.label].text = distance_str;
+    }
+  }
+
+  // builds the line vertices, labels and icons of msg_ for the current options
+  void rebuild() {
+    pending_lines_.clear();
+    lights_.clear();
+    labels_.clear();
+    distances_.clear();
+    icons_.clear();
+    icon_keys_.clear();
+
     std::set<int32_t> target_ids;
     auto items = filter_str_.split(",");
     for (const auto &item : items) {
@@ -147,25 +302,11 @@ class PerceptionChannel : public Renderer {
       }
     }
 
-    GLPushGuard pg;
+    const auto &config = *frame_->config;
 
-    bool is_global = !(msg_->header().has_frame_id() && msg_->header().frame_id() != "global");
-    Eigen::Affine3f affine2global;
-    if (is_global) {
-      glTranslatef(0, 0, global_data_->pose()->pose().position().z());
-
-      affine2global = Eigen::Translation3f::Identity() * Eigen::Quaternionf::Identity();
-    } else {
-      // transform(msg_->header().frame_id(), "global", msg_->header().timestamp_sec() * 1000000);
-
-      // auto trans = global_data_->tf_->lookupTransform("global", msg_->header().frame_id(),
-      //                                                 msg_->header().timestamp_sec() * 1000000);
-      // Eigen::Translation3f t(trans.transform.translation.x, trans.transform.translation.y,
-      //                        trans.transform.translation.z);
-      // Eigen::Quaternionf q(trans.transform.rotation.w, trans.transform.rotation.x,
-      //                      trans.transform.rotation.y, trans.transform.rotation.z);
-      // affine2global = t * q;
-    }
+    is_global_ = !(msg_->header().has_frame_id() && msg_->header().frame_id() != "global");
+    const bool use_atlas = show_icon_ && global_data_->icon_atlas_ &&
+                           global_data_->icon_atlas_->available();
 
     for (const auto &obstacle : msg_->perception_obstacle()) {
       if (!target_ids.empty() && target_ids.find(obstacle.id()) == target_ids.end()) {
@@ -178,77 +319,60 @@ class PerceptionChannel : public Renderer {
         case crdc::airi::PerceptionObstacle_Type_VEHICLE:
           if (obstacle.obstacle_sub_type() ==
             crdc::airi::PerceptionObstacle_ObstacleSubType_SUB_TYPE_TRUCK_BUS) {
-            color = global_data_->config_.perception_color_bus();
+            color = config.perception_color_bus();
           } else if (obstacle.obstacle_sub_type() ==
             crdc::airi::PerceptionObstacle_ObstacleSubType_SUB_TYPE_TRUCK_TRAILER_HEAD) {
-            color = global_data_->config_.perception_color_truck();
+            color = config.perception_color_truck();
           } else if (obstacle.obstacle_sub_type() ==
             crdc::airi::PerceptionObstacle_ObstacleSubType_SUB_TYPE_TRUCK_TRAILER_CONTAINER) {
-            color = global_data_->config_.perception_color_trailer();
+            color = config.perception_color_trailer();
           } else {
-            color = global_data_->config_.perception_color_vehicle();
+            color = config.perception_color_vehicle();
           }
           break;
         case crdc::airi::PerceptionObstacle_Type_BICYCLE:
           if (obstacle.obstacle_sub_type() ==
               crdc::airi::PerceptionObstacle_ObstacleSubType_SUB_TYPE_BICYCLE_MOTORBICYCLE) {
-            color = global_data_->config_.perception_color_motor_cycle();
+            color = config.perception_color_motor_cycle();
           } else if (obstacle.obstacle_sub_type() ==
             crdc::airi::PerceptionObstacle_ObstacleSubType_SUB_TYPE_BICYCLE_MOTORTRICYCLE) {
-            color = global_data_->config_.perception_color_tricycle();
+            color = config.perception_color_tricycle();
           } else {
-            color = global_data_->config_.perception_color_cyclist();
+            color = config.perception_color_cyclist();
           }
           break;
         case crdc::airi::PerceptionObstacle_Type_PEDESTRIAN:
           if (obstacle.obstacle_sub_type() ==
               crdc::airi::PerceptionObstacle_ObstacleSubType_SUB_TYPE_PEDESTRIAN_CHILD) {
-            color = global_data_->config_.perception_color_child();
+            color = config.perception_color_child();
           } else {
-            color = global_data_->config_.perception_color_pedestrian();
+            color = config.perception_color_pedestrian();
           }
           break;
         case crdc::airi::PerceptionObstacle_Type_UNKNOWN_MOVABLE:
-          color = global_data_->config_.perception_color_unknown_movable();
+          color = config.perception_color_unknown_movable();
           break;
         case crdc::airi::PerceptionObstacle_Type_UNKNOWN_UNMOVABLE:
-          color = global_data_->config_.perception_color_unknown_unmovable();
+          color = config.perception_color_unknown_unmovable();
           break;
         default:
-          global_data_->config_.default_color();
+          color = config.default_color();
           break;
       }
-#ifdef __aarch64__
-      global_data_->glwidget_->setColor(QVector4D(color.r(), color.g(), color.b(), color.a()));
-#else
-      glColor4f(color.r(), color.g(), color.b(), color.a());
-#endif
-      
 
       switch (obstacle.sub_type()) {
         case crdc::airi::PerceptionObstacle_SubType_ST_TRAFFICCONE:
-        case crdc::airi::PerceptionObstacle_SubType_st_UNKNOWN_UNMOVABLE_TRAFFIC_CONE: {
-          auto &color = global_data_->config_.perception_color_traffic_cone();
-#ifdef __aarch64__
-          global_data_->glwidget_->setColor(QVector4D(color.r(), color.g(), color.b(), color.a()));
-#else
-          glColor4f(color.r(), color.g(), color.b(), color.a());
-#endif
-          
+        case crdc::airi::PerceptionObstacle_SubType_st_UNKNOWN_UNMOVABLE_TRAFFIC_CONE:
+          color = config.perception_color_traffic_cone();
           break;
-        }
-        case crdc::airi::PerceptionObstacle_SubType_st_UNKNOWN_UNMOVABLE_FENCE: {
-          auto &color = global_data_->config_.perception_color_fence();
-#ifdef __aarch64__
-          global_data_->glwidget_->setColor(QVector4D(color.r(), color.g(), color.b(), color.a()));
-#else
-          glColor4f(color.r(), color.g(), color.b(), color.a());
-#endif
+        case crdc::airi::PerceptionObstacle_SubType_st_UNKNOWN_UNMOVABLE_FENCE:
+          color = config.perception_color_fence();
           break;
-        }
         default:
           break;
       }
+      const QVector4D rgba(color.r(), color.g(), color.b(), color.a());
+      auto &lines = lineGroup(rgba);
 
       // prepare shape selection
       bool show_bbox;
@@ -268,176 +392,132 @@ class PerceptionChannel : public Renderer {
 
       // draw shape
       if (show_bbox) {
-        drawBoundingBox(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                        obstacle.position().z()),
-                        Eigen::Vector3f(obstacle.length(), obstacle.width(), obstacle.height()),
-                        obstacle.theta());
+        addBoundingBox(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                       obstacle.position().z()),
+                       Eigen::Vector3f(obstacle.length(), obstacle.width(), obstacle.height()),
+                       obstacle.theta(), &lines);
       }
       if (show_convex_hull) {
-        std::vector<Eigen::Vector2f> points;
+        std::vector<Eigen::Vector2f> polygon;
         for (const auto &pt : obstacle.polygon_point()) {
-          points.emplace_back(pt.x(), pt.y());
+          polygon.emplace_back(pt.x(), pt.y());
         }
-        if (points.size() >= 3) {
-          drawConvexCylinder(points, obstacle.height());
+        if (polygon.size() >= 3) {
+          addConvexCylinder(polygon, obstacle.height(), &lines);
         }
       }
 
       // id
       if (show_id_) {
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 std::to_string(obstacle.id()), 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, std::to_string(obstacle.id())});
       }
 
       // distance
       if (show_distance_) {
-        const auto distance =
-            std::hypot(obstacle.position().x() - global_data_->pose()->pose().position().x(),
-                       obstacle.position().y() - global_data_->pose()->pose().position().y());
-        static char distance_str[128];
-        sprintf(distance_str, "%.2f", distance);
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 distance_str, 20, true);
+        distances_.push_back({labels_.size(), obstacle.position().x(), obstacle.position().y()});
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, ""});
       }
 
       // velocity
       if (show_velocity_) {
         const auto velocity = std::hypot(obstacle.velocity().x(), obstacle.velocity().y());
-        static char velocity_str[128];
+        char velocity_str[128];
         sprintf(velocity_str, "%.2f", velocity);
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 velocity_str, 20, true);
-        drawArrow(
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, velocity_str});
+        addArrow(
             Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(), obstacle.height()),
             Eigen::Vector3f(obstacle.position().x() + obstacle.velocity().x(),
-                            obstacle.position().y() + obstacle.velocity().y(), obstacle.height()));
+                            obstacle.position().y() + obstacle.velocity().y(), obstacle.height()),
+            &lines);
       }
 
       // acceleration
       if (show_acceleration_) {
         const auto acceleration =
             std::hypot(obstacle.acceleration().x(), obstacle.acceleration().y());
-        static char acceleration_str[128];
+        char acceleration_str[128];
         sprintf(acceleration_str, "%.2f", acceleration);
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 acceleration_str, 20, true);
-        drawArrow(
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, acceleration_str});
+        addArrow(
             Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(), obstacle.height()),
             Eigen::Vector3f(obstacle.position().x() + obstacle.acceleration().x(),
                             obstacle.position().y() + obstacle.acceleration().y(),
-                            obstacle.height()));
+                            obstacle.height()),
+            &lines);
       }
 
       // yaw rate
       if (show_yaw_rate_) {
-        static char yaw_rate_str[128];
+        char yaw_rate_str[128];
         sprintf(yaw_rate_str, "%.2f", obstacle.yaw_rate());
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 yaw_rate_str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, yaw_rate_str});
       }
 
       // show t_update2now, update2now
       if(show_t_init2now_) {
-        static char t_init2now_str[128];
+        char t_init2now_str[128];
         sprintf(t_init2now_str, "%.2f", obstacle.tracking_time());
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f), t_init2now_str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, t_init2now_str});
       }
 
       if(show_t_update2now_) {
-        static char t_update2now_str[128];
+        char t_update2now_str[128];
         sprintf(t_update2now_str, "%.2f", obstacle.track_status_reside_length());
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f), t_update2now_str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, t_update2now_str});
       }
 
       if(show_height_) {
-        static char height_str[128];
+        char height_str[128];
         sprintf(height_str, "%.2f", obstacle.height());
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f), height_str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, height_str});
       }
       // track confidence
       if(show_confidence_) {
         std::string str = "";
-        static char confidence_str[128];
+        char confidence_str[128];
         sprintf(confidence_str, "%.2f(%s)", obstacle.confidence(), str.c_str());
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f), confidence_str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, confidence_str});
       }
       // track status
       if (show_track_status_) {
         std::string str = "";
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, str});
       }
 
       // light status
       if (show_light_status_) {
-        GLPushGuard pg;
-        glTranslatef(obstacle.position().x(), obstacle.position().y(), obstacle.position().z());
-        glRotatef(obstacle.theta() * 180.f / M_PI, 0, 0, 1);
-        glPushAttrib(GL_CURRENT_BIT);
-
+        const Eigen::Vector3f position(obstacle.position().x(), obstacle.position().y(),
+                                       obstacle.position().z());
+        const QVector4D off(.8f, .8f, .8f, .8f);
         const auto status = obstacle.light_status();
         if (near(status.brake_visible(), 1.0)) {
           LOG(INFO) << "brake visiable";
-#ifdef __aarch64__
-          if (near(status.brake_switch_on(), 1.0)) {
-            global_data_->glwidget_->setColor(QVector4D(1, 0, 0, .8f));
-          } else {
-            global_data_->glwidget_->setColor(QVector4D(.8f, .8f, .8f, .8f));
-          }
-#else
-          if (near(status.brake_switch_on(), 1.0)) {
-            glColor4f(1, 0, 0, .8f);
-          } else {
-            glColor4f(.8f, .8f, .8f, .8f);
-          }
-#endif
-          drawSphere(Eigen::Vector3f(-obstacle.length() / 2, 0, 0), 0.1f);
+          lights_.push_back({position, static_cast<float>(obstacle.theta()),
+                             Eigen::Vector3f(-obstacle.length() / 2, 0, 0),
+                             near(status.brake_switch_on(), 1.0) ? QVector4D(1, 0, 0, .8f) : off});
         }
         if (near(status.left_turn_visible(), 1.0)) {
-          
-
-#ifdef __aarch64__
-          if (near(status.left_turn_switch_on(), 1.0)) {
-            global_data_->glwidget_->setColor(QVector4D(1, 1, 0, .8f));
-          } else {
-            global_data_->glwidget_->setColor(QVector4D(.8f, .8f, .8f, .8f));
-          }
-#else
-          if (near(status.left_turn_switch_on(), 1.0)) {
-            glColor4f(1, 1, 0, .8f);
-          } else {
-            glColor4f(.8f, .8f, .8f, .8f);
-          }
-#endif
-          drawSphere(Eigen::Vector3f(-obstacle.length() / 2, obstacle.width() / 2, 0), 0.1f);
+          lights_.push_back({position, static_cast<float>(obstacle.theta()),
+                             Eigen::Vector3f(-obstacle.length() / 2, obstacle.width() / 2, 0),
+                             near(status.left_turn_switch_on(), 1.0) ? QVector4D(1, 1, 0, .8f)
+                                                                      : off});
         }
         if (near(status.right_turn_visible(), 1.0)) {
-#ifdef __aarch64__
-          if (near(status.right_turn_switch_on(), 1.0)) {
-            global_data_->glwidget_->setColor(QVector4D(1, 1, 0, .8f));
-          } else {
-            global_data_->glwidget_->setColor(QVector4D(.8f, .8f, .8f, .8f));
-          }
-#else
-          if (near(status.right_turn_switch_on(), 1.0)) {
-            glColor4f(1, 1, 0, .8f);
-          } else {
-            glColor4f(.8f, .8f, .8f, .8f);
-          }
-#endif
-          drawSphere(Eigen::Vector3f(-obstacle.length() / 2, -obstacle.width() / 2, 0), 0.1f);
+          lights_.push_back({position, static_cast<float>(obstacle.theta()),
+                             Eigen::Vector3f(-obstacle.length() / 2, -obstacle.width() / 2, 0),
+                             near(status.right_turn_switch_on(), 1.0) ? QVector4D(1, 1, 0, .8f)
+                                                                       : off});
         }
-        glPopAttrib();
       }
 
       // subtype
@@ -615,17 +695,15 @@ class PerceptionChannel : public Renderer {
             break;
         }
 
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, str});
       }
 
       if(show_cb_min_height_) {
-        static char min_str[128];
+        char min_str[128];
         sprintf(min_str, "%.2f", obstacle.min_height_to_ground());
-        drawText(Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
-                                 obstacle.height() + .5f),
-                 min_str, 20, true);
+        labels_.push_back({Eigen::Vector3f(obstacle.position().x(), obstacle.position().y(),
+                                 obstacle.height() + .5f), rgba, min_str});
       }
 
       if (show_icon_) {
@@ -679,43 +757,125 @@ class PerceptionChannel : public Renderer {
           key = "unknown";
         }
 
-        const auto &eye_dis = global_data_->camera_->getEyeDistance();
-        int icon_size = eye_dis * (-0.8) + 48;
-        icon_size = (icon_size < 12 ? 12 : (icon_size > 48 ? 48 : icon_size));
+        // global icons get the ego height added when drawn
+        const Eigen::Vector3f p_icon(obstacle.position().x(), obstacle.position().y(),
+                                     (is_global_ ? 0.f : obstacle.position().z()) +
+                                     obstacle.height() + 0.35f);
+        if (!use_atlas ||
+            !global_data_->icon_atlas_->append(key, p_icon.x(), p_icon.y(), p_icon.z(), &icons_)) {
+          icon_keys_.emplace_back(key, p_icon);
+        }
+      }
+    }
 
-        auto it = global_data_->textures_.find(key);
-        if (it != global_data_->textures_.end()) {
-#ifdef __aarch64__
-          global_data_->glwidget_->setColor(QVector4D(1.0f, 1.0f, 1.0f, 1.0f));
-#else
-          glColor4f(1, 1, 1, 1);
-#endif
-          if (is_global) {
-            renderTextureViewFacing(it->second, {
-              static_cast<float>(obstacle.position().x()),
-              static_cast<float>(obstacle.position().y()),
-              static_cast<float>(global_data_->pose()->pose().position().z() +
-              obstacle.height()) + 0.35f}, icon_size);
-          } else {
-            Eigen::Vector3f p(obstacle.position().x(), obstacle.position().y(),
-                              obstacle.position().z() + obstacle.height() + 0.35f);
-            auto p_glb = affine2global * p;
-            renderTextureViewFacing(it->second, {static_cast<float>(p_glb.x()), 
-              static_cast<float>(p_glb.y()), static_cast<float>(p_glb.z())}, icon_size);
-          }
+    needs_upload_ = true;
+  }
+
+  // one GL_LINES buffer per color, works with both the fixed and the shader pipeline
+  std::vector<float> &lineGroup(const QVector4D &color) {
+    for (auto &group : pending_lines_) {
+      if (group.first == color) {
+        return group.second;
+      }
+    }
+    pending_lines_.emplace_back(color, std::vector<float>());
+    return pending_lines_.back().second;
+  }
+
+  static void addLine(const Eigen::Vector3f &from, const Eigen::Vector3f &to,
+                      std::vector<float> *points) {
+    points->insert(points->end(), {from.x(), from.y(), from.z(), to.x(), to.y(), to.z()});
+  }
+
+  static void addBoundingBox(const Eigen::Vector3f &center, const Eigen::Vector3f &lwh,
+                             const float heading, std::vector<float> *points) {
+    const Eigen::Affine3f trans = Eigen::Translation3f(center) *
+                                  Eigen::AngleAxisf(heading, Eigen::Vector3f::UnitZ()) *
+                                  Eigen::Scaling(lwh);
+    Eigen::Vector3f corners[8];
+    for (int i = 0; i < 8; ++i) {
+      corners[i] = trans * Eigen::Vector3f((i & 1) ? .5f : -.5f, (i & 2) ? .5f : -.5f,
+                                           (i & 4) ? .5f : -.5f);
+    }
+    for (int i = 0; i < 8; ++i) {
+      for (int bit = 1; bit < 8; bit <<= 1) {
+        if (!(i & bit)) {
+          addLine(corners[i], corners[i | bit], points);
         }
       }
     }
+    // heading
+    addLine(trans * Eigen::Vector3f(0.f, 0.f, .5f), trans * Eigen::Vector3f(.5f, 0.f, .5f), points);
   }
 
-  void loadConfigPost() override { item_->setChecked(enabled()); }
+  static void addConvexCylinder(const std::vector<Eigen::Vector2f> &polygon, const float height,
+                                std::vector<float> *points) {
+    for (size_t i = 0; i < polygon.size(); ++i) {
+      const auto &p0 = polygon[i];
+      const auto &p1 = polygon[(i + 1) % polygon.size()];
+      addLine({p0.x(), p0.y(), 0.f}, {p1.x(), p1.y(), 0.f}, points);
+      addLine({p0.x(), p0.y(), height}, {p1.x(), p1.y(), height}, points);
+      addLine({p0.x(), p0.y(), 0.f}, {p0.x(), p0.y(), height}, points);
+    }
+  }
 
-  void update(const std::shared_ptr<PerceptionObstacles> &msg) { msg_ = msg; }
+  static void addArrow(const Eigen::Vector3f &from, const Eigen::Vector3f &to,
+                       std::vector<float> *points, const float scale = 0.3f) {
+    const Eigen::Vector3f dir = from - to;
+    const float length = dir.norm();
+    if (length <= 0.f) {
+      return;
+    }
+    const auto yaw = std::atan2(dir.y(), dir.x());
+    const Eigen::Vector3f axis_x = dir / length;
+    const Eigen::Vector3f axis_y(-std::sin(yaw), std::cos(yaw), 0.f);
+    const float c = std::cos(M_PI / 4) * length * scale;
+    addLine(to, from, points);
+    addLine(to, to + c * axis_x + c * axis_y, points);
+    addLine(to, to + c * axis_x - c * axis_y, points);
+  }
 
- protected:
   RendererItem *item_;
   const std::string channel_;
   std::shared_ptr<PerceptionObstacles> msg_;
+  std::shared_ptr<PerceptionObstacles> pending_msg_;
+  std::mutex mutex_;
+
+  struct LineGroup {
+    QVector4D color;
+    GLBuffer buffer;
+  };
+  struct Light {
+    Eigen::Vector3f position;
+    float theta;
+    Eigen::Vector3f offset;
+    QVector4D color;
+  };
+  struct Label {
+    Eigen::Vector3f position;
+    QVector4D color;
+    std::string text;
+  };
+  struct Distance {
+    size_t label;
+    double x;
+    double y;
+  };
+
+  // cached geometry of msg_, rebuilt on new message or option change
+  // set by the widgets on the GUI thread
+  std::atomic<bool> needs_rebuild_{true};
+  bool needs_upload_{false};
+  bool is_global_{true};
+  double pose_x_{0.0};
+  double pose_y_{0.0};
+  std::vector<std::pair<QVector4D, std::vector<float>>> pending_lines_;
+  std::vector<LineGroup> lines_;
+  std::vector<Light> lights_;
+  std::vector<Label> labels_;
+  std::vector<Distance> distances_;
+  std::vector<IconAtlas::Instance> icons_;
+  std::vector<std::pair<std::string, Eigen::Vector3f>> icon_keys_;
 
   QString filter_str_;
   bool show_auto_{false};
@@ -740,7 +900,10 @@ class PerceptionChannel : public Renderer {
 PerceptionRenderer::PerceptionRenderer() {
   item_ = new RendererItem(
       "Perception", global_data_->config_.perception_renderer_enable(),
-      [&](bool is_checked) { global_data_->config_.set_perception_renderer_enable(is_checked); });
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_perception_renderer_enable(is_checked); });
+      });
   global_data_->renderer_manager_->addWidget(item_);
 }
 
@@ -761,6 +924,10 @@ void PerceptionRenderer::initialize() {
     auto pos = icon_name.rfind('.');
     global_data_->textures_[icon_name.substr(0, pos)] = generateTexture(texture_desc)[0];
   }
+  global_data_->icon_atlas_.reset(new IconAtlas());
+  if (!global_data_->icon_atlas_->load(icon_base_dir)) {
+    LOG(WARNING) << "Icon atlas unavailable, fall back to per icon textures";
+  }
 
   // subscribe message
   global_data_->message_hub_->subscribe<PerceptionObstacles>(
@@ -771,15 +938,13 @@ void PerceptionRenderer::initialize() {
         }
         msgs_[channel] = msg;
         needs_update_[channel] = true;
+        requestRedraw();
       });
 }
 
-void PerceptionRenderer::render() {
+void PerceptionRenderer::schedule(std::vector<Renderer *> *tasks) {
   std::unique_lock<std::mutex> lock(mutex_);
 
-  // glColor4f(1, 1, 1, 1);
-  // renderTextureViewFacing(global_data_->textures_["kid"], {5, 10, 3}, 35);
-
   // update widgets
   for (auto it = to_be_added_.begin(); it != to_be_added_.end();) {
     channels_[*it].reset(new PerceptionChannel(*it, item_));
@@ -803,10 +968,22 @@ void PerceptionRenderer::render() {
 
   lock.unlock();
 
-  // render
   for (auto &channel : channels_) {
     if (channel.second->enabled()) {
-      channel.second->render();
+      tasks->push_back(channel.second.get());
+    }
+  }
+}
+
+void PerceptionRenderer::submit() {
+  if (!enabled()) {
+    return;
+  }
+
+  for (auto &channel : channels_) {
+    if (channel.second->enabled()) {
+      FrameProfiler::Scope scope(global_data_->profiler_.get(), channel.second.get());
+      channel.second->submit();
     }
   }
 }
@@ -1,11 +1,15 @@
 #include "viewer/renderers/pointcloud_renderer.h"
+#include "viewer/frame_context.h"
+#include "viewer/frame_profiler.h"
 #include <QComboBox>
 #include <QLayout>
 #include <QLineEdit>
 #include <QRadioButton>
 #include "viewer/camera.h"
 #include "viewer/global_data.h"
+#include "viewer/gpu_resource_manager.h"
 #include "viewer/renderer_manager.h"
+#include "viewer/renderers/render_queue.h"
 #include "viewer/widgets/check_box.h"
 #include "viewer/widgets/color_button.h"
 #include "viewer/widgets/renderer_item.h"
@@ -21,8 +25,9 @@ class PointCloudChannel : public Renderer {
   channel_(channel) {
     item_ = new RendererItem(QString::fromStdString(channel), enabled(),
                                  [&](bool is_checked) {
-      auto channel_enable = global_data_->config_.mutable_pointcloud_channel_enable();
-      (*channel_enable)[channel_] = is_checked;
+      global_data_->updateConfig([&](viewer::Config *config) {
+        (*config->mutable_pointcloud_channel_enable())[channel_] = is_checked;
+      });
     });
     renderer_item->addWidget(item_);
 
@@ -139,7 +144,7 @@ class PointCloudChannel : public Renderer {
           //Eigen::Quaterniond quat(rot.w, rot.x, rot.y, rot.z);
           //auto eulers = quat.toRotationMatrix().eulerAngles(1, 0, 2);
 
-          const auto pose = global_data_->pose()->pose();
+          const auto &pose = frame_->pose->pose();
           double rpy[3];
           double ori[4];
           ori[0] = pose.orientation().qw();
@@ -170,13 +175,17 @@ class PointCloudChannel : public Renderer {
               }
 	  }
 #endif
-          if (it->vertex.rows() == 3) {
-            bwt.buffer = generateGLBuffer(it->vertex, 3, 0);
-          } else {
-            bwt.buffer = generateGLBuffer(it->vertex, 3, 4);
-          }
-
-          buffers_.push_back(bwt);
+          // uploaded in the background, the cloud shows up once the GPU has it
+          auto vertex = decimateVertex(&it->vertex, quality().point_stride);
+          const uint8_t dim_colors = vertex->rows() == 3 ? 0 : 4;
+          generateGLBufferAsync(vertex, 3, dim_colors, [this, bwt](GLBuffer buffer) {
+            auto uploaded = bwt;
+            uploaded.buffer = buffer;
+            const auto utime = uploaded.utime;
+            global_data_->gpu_resources_->setEvictor(uploaded.buffer.lease,
+                                                     [this, utime]() { return evict(utime); });
+            buffers_.push_back(uploaded);
+          });
         }
 
         needs_update_ = false;
@@ -191,20 +200,37 @@ class PointCloudChannel : public Renderer {
       glColor4f(color_.redF(), color_.greenF(), color_.blueF(), alpha_);
 #endif
     }
-    glPointSize(point_size_ * 10.f / global_data_->camera_->getEyeDistance());
-
-    for (auto &bwt : buffers_) {
-      GLPushGuard pg;
-#ifdef __aarch64__
-//      transform(bwt.frame_id, "global", bwt.utime);
-#else
+    // drawn over the static layers without depth test, all frames in one bucket
+    RenderState state;
+    state.depth_test = false;
+    state.point_size = point_size_ * 10.f / frame_->eye_distance;
+
+    // the newest clouds are at the back
+    const size_t history_depth = quality().history_depth;
+    const size_t first = buffers_.size() > history_depth ? buffers_.size() - history_depth : 0;
+    for (size_t i = first; i < buffers_.size(); ++i) {
+      auto *buffer = &buffers_[i].buffer;
       // transform(bwt.frame_id, "global", bwt.utime);
-#endif
+      enqueue(state, [this, buffer]() { drawArrays(GL_POINTS, *buffer); });
+    }
+  }
 
-      glDisable(GL_DEPTH_TEST);
-      drawArrays(GL_POINTS, bwt.buffer);
-      glEnable(GL_DEPTH_TEST);
+  // older clouds give way when GPU memory runs out, the newest one stays
+  bool evict(const uint64_t utime) {
+    uint64_t newest = 0;
+    for (const auto &bwt : buffers_) {
+      newest = std::max(newest, bwt.utime);
+    }
+    if (utime >= newest) {
+      return false;
+    }
+    for (auto &bwt : buffers_) {
+      if (bwt.utime == utime && bwt.buffer.vbo) {
+        bwt.buffer = GLBuffer();
+        return true;
+      }
     }
+    return false;
   }
 
   void update(const std::shared_ptr<crdc::airi::PointCloud2> &msg) {
@@ -354,7 +380,10 @@ class PointCloudChannel : public Renderer {
 PointCloudRenderer::PointCloudRenderer() {
   item_ = new RendererItem(
       "PointCloud", global_data_->config_.pointcloud_renderer_enable(),
-      [&](bool is_checked) { global_data_->config_.set_pointcloud_renderer_enable(is_checked); });
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_pointcloud_renderer_enable(is_checked); });
+      });
   global_data_->renderer_manager_->addWidget(item_);
 }
 
@@ -374,10 +403,11 @@ void PointCloudRenderer::initialize() {
         } else {
           to_be_added_[channel] = msg;
         }
+        requestRedraw();
       });
 }
 
-void PointCloudRenderer::render() {
+void PointCloudRenderer::schedule(std::vector<Renderer *> *tasks) {
   // update widgets
   {
     std::unique_lock<std::mutex> lock(mutex_);
@@ -394,11 +424,24 @@ void PointCloudRenderer::render() {
     return;
   }
 
+  for (auto &channel : channels_) {
+    if (channel.second->enabled()) {
+      tasks->push_back(channel.second.get());
+    }
+  }
+}
+
+void PointCloudRenderer::submit() {
+  if (!enabled()) {
+    return;
+  }
+
   // render
   for (auto &channel : channels_) {
     if (channel.second->enabled()) {
       GLPushGuard pg;
-      channel.second->render();
+      FrameProfiler::Scope scope(global_data_->profiler_.get(), channel.second.get());
+      channel.second->submit();
     }
   }
 }
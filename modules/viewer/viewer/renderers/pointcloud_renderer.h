@@ -25,7 +25,9 @@ class PointCloudRenderer : public Renderer {
 
   void initialize() override;
 
-  void render() override;
+  void schedule(std::vector<Renderer *> *tasks) override;
+
+  void submit() override;
 
   void loadConfigPost() override;
 
@@ -24,7 +24,9 @@ class PointCloudsRenderer : public Renderer {
 
   void initialize() override;
 
-  void render() override;
+  void schedule(std::vector<Renderer *> *tasks) override;
+
+  void submit() override;
 
   void loadConfigPost() override;
 
@@ -0,0 +1,153 @@
+#include "viewer/renderers/polyline_shader.h"
+#include <glog/logging.h>
+#include <cmath>
+
+namespace crdc {
+namespace airi {
+
+static const char *polylineVertexShaderSource =
+    "attribute vec2 position;\n"
+    "attribute vec2 prev;\n"
+    "attribute vec2 next;\n"
+    "attribute vec2 side_distance;\n"
+    "uniform mat4 mvp;\n"
+    "uniform float half_width;\n"
+    "varying float distance;\n"
+    "void main() {\n"
+    "   vec2 dir_in = normalize(position - prev);\n"
+    "   vec2 dir_out = normalize(next - position);\n"
+    "   vec2 sum = dir_in + dir_out;\n"
+    "   vec2 tangent = length(sum) > 1e-4 ? normalize(sum) : dir_in;\n"
+    "   vec2 normal = vec2(-tangent.y, tangent.x);\n"
+    "   float miter = half_width / max(dot(normal, vec2(-dir_in.y, dir_in.x)), 0.25);\n"
+    "   vec2 pt = position + normal * side_distance.x * miter;\n"
+    "   gl_Position = mvp * vec4(pt, 0.0, 1.0);\n"
+    "   distance = side_distance.y;\n"
+    "}\n";
+
+static const char *polylineFragmentShaderSource =
+    "uniform highp vec4 color;\n"
+    "uniform highp float dash_length;\n"
+    "uniform highp float dash_ratio;\n"
+    "varying highp float distance;\n"
+    "void main() {\n"
+    "   if (dash_length > 0.0 && mod(distance, dash_length) > dash_length * dash_ratio) {\n"
+    "     discard;\n"
+    "   }\n"
+    "   gl_FragColor = color;\n"
+    "}\n";
+
+bool PolylineShader::initialize() {
+  initializeOpenGLFunctions();
+
+  program_.reset(new QOpenGLShaderProgram());
+  program_->addShaderFromSourceCode(QOpenGLShader::Vertex, polylineVertexShaderSource);
+  program_->addShaderFromSourceCode(QOpenGLShader::Fragment, polylineFragmentShaderSource);
+  program_->bindAttributeLocation("position", 0);
+  program_->bindAttributeLocation("prev", 1);
+  program_->bindAttributeLocation("next", 2);
+  program_->bindAttributeLocation("side_distance", 4);
+  if (!program_->link()) {
+    LOG(ERROR) << "Failed to link polyline shader: " << program_->log().toStdString();
+    return false;
+  }
+  loc_mvp_ = program_->uniformLocation("mvp");
+  loc_color_ = program_->uniformLocation("color");
+  loc_half_width_ = program_->uniformLocation("half_width");
+  loc_dash_length_ = program_->uniformLocation("dash_length");
+  loc_dash_ratio_ = program_->uniformLocation("dash_ratio");
+
+  available_ = true;
+  return true;
+}
+
+GLBuffer PolylineShader::generateBuffer(const std::vector<Eigen::Vector2f> &points) {
+  // drop repeated points, they have no direction
+  std::vector<Eigen::Vector2f> centerline;
+  centerline.reserve(points.size());
+  for (const auto &pt : points) {
+    if (centerline.empty() || (pt - centerline.back()).squaredNorm() > 1e-12f) {
+      centerline.push_back(pt);
+    }
+  }
+  if (centerline.size() < 2) {
+    return GLBuffer();
+  }
+
+  // position, prev, next, side, distance
+  const int dim = 8;
+  const size_t size = centerline.size();
+  std::vector<float> vertex(size * 2 * dim);
+  auto p = vertex.data();
+  float distance = 0.f;
+  for (size_t i = 0; i < size; ++i) {
+    const auto &pt = centerline[i];
+    if (i > 0) {
+      distance += (pt - centerline[i - 1]).norm();
+    }
+    // end points mirror their neighbour to get a straight cap
+    const Eigen::Vector2f prev = (i == 0 ? 2 * pt - centerline[1] : centerline[i - 1]);
+    const Eigen::Vector2f next =
+        (i == size - 1 ? 2 * pt - centerline[size - 2] : centerline[i + 1]);
+    for (const float side : {1.f, -1.f}) {
+      *p++ = pt.x();
+      *p++ = pt.y();
+      *p++ = prev.x();
+      *p++ = prev.y();
+      *p++ = next.x();
+      *p++ = next.y();
+      *p++ = side;
+      *p++ = distance;
+    }
+  }
+
+  GLBuffer buffer;
+  buffer.count_vertex = size * 2;
+  buffer.count_index = 0;
+  buffer.vao.reset(new QOpenGLVertexArrayObject());
+  buffer.vbo.reset(new QOpenGLBuffer(QOpenGLBuffer::Type::VertexBuffer));
+  buffer.vao->create();
+  buffer.vao->bind();
+  buffer.vbo->create();
+  buffer.vbo->bind();
+  buffer.vbo->allocate(vertex.data(), sizeof(float) * vertex.size());
+  const int stride = sizeof(float) * dim;
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, nullptr);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(sizeof(float) * 2));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(sizeof(float) * 4));
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, stride, (void *)(sizeof(float) * 6));
+  buffer.vbo->release();
+  buffer.vao->release();
+
+  return buffer;
+}
+
+void PolylineShader::draw(GLBuffer &buffer, const float *mvp, const float *color,
+                          const float width, const float dash_length, const float dash_ratio) {
+  if (!available_ || !buffer.vao || !buffer.vbo) {
+    return;
+  }
+
+  GLint program_prev = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program_prev);
+
+  program_->bind();
+  glUniformMatrix4fv(loc_mvp_, 1, GL_FALSE, mvp);
+  glUniform4fv(loc_color_, 1, color);
+  glUniform1f(loc_half_width_, width * .5f);
+  glUniform1f(loc_dash_length_, dash_length);
+  glUniform1f(loc_dash_ratio_, dash_ratio);
+
+  buffer.vao->bind();
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, buffer.count_vertex);
+  buffer.vao->release();
+
+  glUseProgram(program_prev);
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <memory>
+#include <vector>
+#include "viewer/renderers/renderer.h"
+
+namespace crdc {
+namespace airi {
+
+/**
+ * @brief Draws wide and dashed line strips from their centerline, the width
+ *        extrusion, miter joins and dash pattern are done in the shader.
+ */
+class PolylineShader : protected QOpenGLFunctions {
+ public:
+  PolylineShader() = default;
+
+ public:
+  // needs a current GL context
+  bool initialize();
+
+  bool available() const { return available_; }
+
+  // two vertices per centerline point, drawn as a triangle strip
+  GLBuffer generateBuffer(const std::vector<Eigen::Vector2f> &points);
+
+  // dash_length <= 0 draws a solid line, dash_ratio is the visible part of a dash
+  void draw(GLBuffer &buffer, const float *mvp, const float *color, const float width,
+            const float dash_length = 0.f, const float dash_ratio = .5f);
+
+ protected:
+  bool available_{false};
+  std::shared_ptr<QOpenGLShaderProgram> program_;
+  int loc_mvp_{-1};
+  int loc_color_{-1};
+  int loc_half_width_{-1};
+  int loc_dash_length_{-1};
+  int loc_dash_ratio_{-1};
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,133 @@
+#include "viewer/renderers/render_queue.h"
+#include <QVector4D>
+#include <algorithm>
+#include <tuple>
+#include "viewer/global_data.h"
+#include "viewer/glwidget.h"
+
+namespace crdc {
+namespace airi {
+
+namespace {
+
+// programs and textures are the most expensive to switch, so they sort first
+std::tuple<GLuint, GLuint, bool, bool, float, float> stateKey(const RenderState &state) {
+  return std::make_tuple(state.program, state.texture, state.depth_test, state.blend,
+                         state.line_width, state.point_size);
+}
+
+}  // namespace
+
+bool RenderState::operator<(const RenderState &other) const {
+  return stateKey(*this) < stateKey(other);
+}
+
+bool RenderState::operator==(const RenderState &other) const {
+  return stateKey(*this) == stateKey(other);
+}
+
+void RenderQueue::push(const RenderState &state, const std::function<void()> &draw) {
+  items_.emplace_back();
+  auto &item = items_.back();
+  item.state = state;
+  item.draw = draw;
+  if (item.state.line_width <= 0.f) {
+    glGetFloatv(GL_LINE_WIDTH, &item.state.line_width);
+  }
+  if (item.state.point_size <= 0.f) {
+    glGetFloatv(GL_POINT_SIZE, &item.state.point_size);
+  }
+  GLint program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  if (!item.state.program) {
+    item.state.program = program;
+  }
+#ifdef __aarch64__
+  glGetUniformfv(program, glGetUniformLocation(program, "color"), item.color);
+#else
+  glGetFloatv(GL_CURRENT_COLOR, item.color);
+  glGetFloatv(GL_MODELVIEW_MATRIX, item.modelview);
+#endif
+}
+
+void RenderQueue::flush() {
+  if (items_.empty()) {
+    return;
+  }
+
+  order_.resize(items_.size());
+  for (size_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  std::sort(order_.begin(), order_.end(), [this](const size_t a, const size_t b) {
+    const auto &state_a = items_[a].state;
+    const auto &state_b = items_[b].state;
+    return state_a < state_b || (state_a == state_b && a < b);
+  });
+
+  // what the renderers expect after their submit()
+  RenderState found;
+  GLint program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  found.program = program;
+  found.depth_test = glIsEnabled(GL_DEPTH_TEST);
+  found.blend = glIsEnabled(GL_BLEND);
+  glGetFloatv(GL_LINE_WIDTH, &found.line_width);
+  glGetFloatv(GL_POINT_SIZE, &found.point_size);
+#ifndef __aarch64__
+  GLfloat color[4];
+  glGetFloatv(GL_CURRENT_COLOR, color);
+  glPushMatrix();
+#endif
+
+  const RenderState *current = nullptr;
+  for (const auto index : order_) {
+    const auto &item = items_[index];
+    apply(item.state, current);
+    current = &item.state;
+#ifdef __aarch64__
+    // the color uniform of the program just restored, i.e. the widget's
+    global_data_->glwidget_->setColor(
+        QVector4D(item.color[0], item.color[1], item.color[2], item.color[3]));
+#else
+    glColor4fv(item.color);
+    glLoadMatrixf(item.modelview);
+#endif
+    item.draw();
+  }
+
+  apply(found, current);
+#ifndef __aarch64__
+  glPopMatrix();
+  glColor4fv(color);
+#endif
+  items_.clear();
+}
+
+void RenderQueue::apply(const RenderState &state, const RenderState *current) {
+  if (!current || current->program != state.program) {
+    glUseProgram(state.program);
+  }
+  if (!current || current->texture != state.texture) {
+    glBindTexture(GL_TEXTURE_2D, state.texture);
+#ifndef __aarch64__
+    // fixed function texturing, GLES samples in the shaders only
+    state.texture ? glEnable(GL_TEXTURE_2D) : glDisable(GL_TEXTURE_2D);
+#endif
+  }
+  if (!current || current->depth_test != state.depth_test) {
+    state.depth_test ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+  }
+  if (!current || current->blend != state.blend) {
+    state.blend ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+  }
+  if (!current || current->line_width != state.line_width) {
+    glLineWidth(state.line_width);
+  }
+  if (!current || current->point_size != state.point_size) {
+    glPointSize(state.point_size);
+  }
+}
+
+}  // namespace airi
+}  // namespace crdc
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "viewer/renderers/renderer.h"
+
+namespace crdc {
+namespace airi {
+
+// GL state of a queued draw, draws with equal state run back to back
+struct RenderState {
+  // 0 takes the program bound when the draw is pushed, e.g. the widget's on aarch64
+  GLuint program{0};
+  GLuint texture{0};
+  bool depth_test{true};
+  bool blend{true};
+  // 0 takes what is current when the draw is pushed
+  float line_width{0.f};
+  float point_size{0.f};
+
+  bool operator<(const RenderState &other) const;
+  bool operator==(const RenderState &other) const;
+};
+
+/**
+ * @brief Collects the draws of a renderer, sorts them by state and executes
+ *        them with every state change done once per bucket. It is flushed
+ *        after each renderer, so the layering between renderers is kept.
+ */
+class RenderQueue : public Renderer {
+ public:
+  std::string name() const override { return "RenderQueue"; }
+
+  // GUI thread in submit(), the current program, color and modelview matrix are kept
+  // for the draw
+  void push(const RenderState &state, const std::function<void()> &draw);
+
+  // restores the state found before the first draw afterwards
+  void flush();
+
+  // drops the draws of a renderer that failed halfway
+  void discard() { items_.clear(); }
+
+ protected:
+  void apply(const RenderState &state, const RenderState *current);
+
+ protected:
+  struct Item {
+    RenderState state;
+    std::function<void()> draw;
+    GLfloat color[4];
+#ifndef __aarch64__
+    GLfloat modelview[16];
+#endif
+  };
+
+  std::vector<Item> items_;
+  std::vector<size_t> order_;
+};
+
+}  // namespace airi
+}  // namespace crdc
@@ -2,9 +2,17 @@
 #include <FTGL/ftgl.h>
 #include <GL/freeglut.h>
 #include <GL/glut.h>
+#include <cstring>
 #include "viewer/global_data.h"
 #include "viewer/camera.h"
-#include "viewer/renderers/ear_cut.h"
+#include "viewer/frame_context.h"
+#include "viewer/frame_profiler.h"
+#include "viewer/gl_upload_worker.h"
+#include "viewer/gpu_resource_manager.h"
+#include "viewer/redraw_scheduler.h"
+#include "viewer/renderers/polyline_shader.h"
+#include "viewer/renderers/render_queue.h"
+#include "viewer/renderers/triangulation_service.h"
 
 namespace crdc {
 namespace airi {
@@ -23,6 +31,46 @@ void Renderer::setColor(const viewer::Color &color) {
   glColor4f(color.r(), color.g(), color.b(), color.a());
 }
 
+void Renderer::requestRedraw() {
+  if (global_data_->redraw_scheduler_) {
+    global_data_->redraw_scheduler_->request();
+  }
+}
+
+const QualitySettings &Renderer::quality() const {
+  static const QualitySettings kFull;
+  if (!frame_) {
+    return kFull;
+  }
+  auto it = frame_->renderer_quality.find(this);
+  return it == frame_->renderer_quality.end() ? frame_->quality : it->second;
+}
+
+float Renderer::tessellation() const { return quality().tessellation; }
+
+FrameArena *Renderer::arena() const { return global_data_->frame_arena_.get(); }
+
+std::shared_ptr<GpuLease> Renderer::trackGpu(const size_t bytes) const {
+  if (!global_data_->gpu_resources_) {
+    return nullptr;
+  }
+  return global_data_->gpu_resources_->track(name(), bytes);
+}
+
+void Renderer::enqueue(const RenderState &state, const std::function<void()> &draw) {
+  if (!global_data_->render_queue_) {
+    draw();
+    return;
+  }
+  global_data_->render_queue_->push(state, draw);
+}
+
+void Renderer::touchGpu(const std::shared_ptr<GpuLease> &lease) const {
+  if (global_data_->gpu_resources_) {
+    global_data_->gpu_resources_->touch(lease);
+  }
+}
+
 // void Renderer::transform(const std::string &target_frame_id, const std::string &source_frame_id, const uint64_t utime) {
 
 //   if (!global_data_->tf_->canTransform(source_frame_id, target_frame_id, utime)) {
@@ -42,23 +90,23 @@ void Renderer::setColor(const viewer::Color &color) {
 //   glRotatef(eulers[2] / M_PI * 180, 0, 0, 1);
 // }
 
-void Renderer::drawPoints(const std::vector<Eigen::VectorXf> &points,
-                          const std::vector<Eigen::VectorXf> &colors) {
+void Renderer::drawPoints(const VertexSpan<Eigen::Vector3f> &points,
+                          const VertexSpan<Eigen::Vector4f> &colors) {
   drawArrays(GL_POINTS, points, colors);
 }
 
-void Renderer::drawLines(const std::vector<Eigen::VectorXf> &points,
-                         const std::vector<Eigen::VectorXf> &colors) {
+void Renderer::drawLines(const VertexSpan<Eigen::Vector3f> &points,
+                         const VertexSpan<Eigen::Vector4f> &colors) {
   drawArrays(GL_LINES, points, colors);
 }
 
-void Renderer::drawLineStrip(const std::vector<Eigen::VectorXf> &points,
-                             const std::vector<Eigen::VectorXf> &colors) {
+void Renderer::drawLineStrip(const VertexSpan<Eigen::Vector3f> &points,
+                             const VertexSpan<Eigen::Vector4f> &colors) {
   drawArrays(GL_LINE_STRIP, points, colors);
 }
 
-void Renderer::drawLineLoop(const std::vector<Eigen::VectorXf> &points,
-                            const std::vector<Eigen::VectorXf> &colors) {
+void Renderer::drawLineLoop(const VertexSpan<Eigen::Vector3f> &points,
+                            const VertexSpan<Eigen::Vector4f> &colors) {
   drawArrays(GL_LINE_LOOP, points, colors);
 }
 
@@ -100,14 +148,15 @@ void Renderer::drawArrow(const Eigen::Vector3f &from, const Eigen::Vector3f &to,
   }
 }
 
-void Renderer::drawTriangles(const std::vector<Eigen::VectorXf> &points,
-                             const std::vector<Eigen::VectorXf> &colors) {
+void Renderer::drawTriangles(const VertexSpan<Eigen::Vector3f> &points,
+                             const VertexSpan<Eigen::Vector4f> &colors) {
   drawArrays(GL_TRIANGLES, points, colors);
 }
 
 void Renderer::drawEllipse(const Eigen::Vector2f &center, const float radius_x,
                            const float radius_y, const float heading, const bool fill,
-                           const float step) {
+                           const float step_full) {
+  const float step = step_full * tessellation();
   GLPushGuard pg;
   glRotatef(heading * 180.f / M_PI, 0, 0, 1);
   if (fill) {
@@ -149,7 +198,8 @@ void Renderer::drawCircle(const Eigen::Vector2f &center, const float radius, con
 }
 
 void Renderer::drawArch(const Eigen::Vector2f &center, const float radius, const float beg,
-                        const float end, const bool fill, const float step) {
+                        const float end, const bool fill, const float step_full) {
+  const float step = step_full * tessellation();
   if (fill) {
     std::vector<Eigen::Vector2f> points;
     points.push_back(center);
@@ -272,6 +322,9 @@ void Renderer::drawPolygon(const std::vector<Eigen::Vector2f> &polygon) {
 
 #ifdef __aarch64__
 void Renderer::drawLineAsQuad(const Eigen::Vector2f &start, const Eigen::Vector2f &end, const float width) {
+    if (drawPolyline({start, end}, width)) {
+        return;
+    }
     const auto half_width = width/2;
     const auto angle = std::atan2(end[1] - start[1], end[0] - start[0]);
     const auto sin_angle = half_width*std::sin(angle);
@@ -300,6 +353,9 @@ void Renderer::drawLineAsQuad(const Eigen::Vector2f &start, const Eigen::Vector2
 #else
 void Renderer::drawLineAsQuad(const Eigen::Vector2f &start, const Eigen::Vector2f &end,
                               const float width) {
+  if (drawPolyline({start, end}, width)) {
+    return;
+  }
   const auto half_width = width / 2;
   const auto angle = std::atan2(end[1] - start[1], end[0] - start[0]);
   const auto sin_angle = half_width * std::sin(angle);
@@ -314,10 +370,24 @@ void Renderer::drawLineAsQuad(const Eigen::Vector2f &start, const Eigen::Vector2
 #endif
 
 void Renderer::drawLineStripPolygon(const std::vector<Eigen::Vector2f> &points, const float width) {
+  if (drawPolyline(points, width)) {
+    return;
+  }
   auto polygon = generateLineStripPolygon(points, width);
   drawPolygon(polygon);
 }
 
+void Renderer::drawDashedLineStrip(const std::vector<Eigen::Vector2f> &points, const float width,
+                                   const float length_segment, const float ratio) {
+  if (drawPolyline(points, width, length_segment, ratio)) {
+    return;
+  }
+  auto polygons = generateDashedLineStripPolygons(points, width, length_segment, ratio);
+  for (const auto &polygon : polygons) {
+    drawPolygon(polygon);
+  }
+}
+
 #ifdef __aarch64__
 void Renderer::drawLineStripQuads(const std::vector<Eigen::Vector2f> &points, const float width) {
     //auto points_quads = generateLineStripQuads(points, width);
@@ -333,6 +403,9 @@ void Renderer::drawLineStripQuads(const std::vector<Eigen::Vector2f> &points, co
   if (points.size() < 2) {
     return;
   }
+  if (drawPolyline(points, width)) {
+    return;
+  }
   auto points_quads = generateLineStripQuads(points, width);
   auto vertex = generateVertex(points_quads);
   auto buffer = generateGLBuffer(vertex, 2, 0);
@@ -343,7 +416,8 @@ void Renderer::drawLineStripQuads(const std::vector<Eigen::Vector2f> &points, co
 void Renderer::drawSphere(const Eigen::Vector3f &center, const float radius) {
   GLPushGuard pg;
   glTranslatef(center.x(), center.y(), center.z());
-  glutSolidSphere(radius, radius * 128, radius * 128);
+  const int slices = std::max(6.f, radius * 128 / tessellation());
+  glutSolidSphere(radius, slices, slices);
 }
 
 
@@ -521,28 +595,22 @@ void Renderer::drawConvexCylinder(const std::vector<Eigen::Vector2f> &polygon, c
   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
-float Renderer::drawText(const Eigen::VectorXf &pos, const std::string &text, const int font_size,
+float Renderer::drawText(const Eigen::Vector2f &pos, const std::string &text, const int font_size,
                          const bool bold) {
-  if (pos.rows() < 2 || pos.rows() > 3) {
-    return std::numeric_limits<float>::max();
-  }
+  return drawText(Eigen::Vector3f(pos.x(), pos.y(), 0.f), text, font_size, bold);
+}
 
+float Renderer::drawText(const Eigen::Vector3f &pos, const std::string &text, const int font_size,
+                         const bool bold) {
   auto &pen = (bold ? global_data_->font_bold_ : global_data_->font_normal_);
   if (pen) {
     pen->FaceSize(font_size);
-    if (pos.rows() == 2) {
-      glPushAttrib(GL_ALL_ATTRIB_BITS);
-      glRasterPos2f(pos.x(), pos.y());
-      auto new_pos = pen->Render(text.c_str(), -1);
-      glPopAttrib();
-      return new_pos.Xf() + pos.x();
-    } else {
-      glPushAttrib(GL_ALL_ATTRIB_BITS);
-      glRasterPos3f(pos.x(), pos.y(), pos.z());
-      auto new_pos = pen->Render(text.c_str(), -1);
-      glPopAttrib();
-      return new_pos.Xf() + pos.x();
-    }
+    // only the raster position and color are touched
+    glPushAttrib(GL_CURRENT_BIT);
+    glRasterPos3f(pos.x(), pos.y(), pos.z());
+    auto new_pos = pen->Render(text.c_str(), -1);
+    glPopAttrib();
+    return new_pos.Xf() + pos.x();
   } else {
     void *font = nullptr;
     if (font_size >= 24) {
@@ -555,12 +623,8 @@ float Renderer::drawText(const Eigen::VectorXf &pos, const std::string &text, co
       font = GLUT_BITMAP_HELVETICA_12;
     }
 
-    glPushAttrib(GL_ALL_ATTRIB_BITS);
-    if (pos.rows() == 2) {
-      glRasterPos2f(pos.x(), pos.y());
-    } else {
-      glRasterPos3f(pos.x(), pos.y(), pos.z());
-    }
+    glPushAttrib(GL_CURRENT_BIT);
+    glRasterPos3f(pos.x(), pos.y(), pos.z());
     glutBitmapString(font, (const unsigned char *)(text.c_str()));
     glPopAttrib();
 
@@ -685,6 +749,7 @@ std::vector<GLTexture> Renderer::generateTexture(
     GLTexture texture;
     texture.texture_.reset(new QOpenGLTexture(qimg));
     texture.roi_ = desc.roi_;
+    texture.lease_ = trackGpu(qimg.width() * qimg.height() * 4);
     textures.push_back(texture);
   }
   return textures;
@@ -692,6 +757,10 @@ std::vector<GLTexture> Renderer::generateTexture(
 
 void Renderer::renderTexture(const GLTexture &texture, const QPointF &offset,
                              const float resolution) {
+  if (!texture.texture_) {
+    return;
+  }
+  touchGpu(texture.lease_);
   glEnable(GL_TEXTURE_2D);
   texture.texture_->bind();
   glBegin(GL_QUADS);
@@ -728,6 +797,7 @@ void Renderer::renderTextureViewFacing(const GLTexture &texture, const Eigen::Ve
   const auto p = global_data_->camera_->getScreenPoint({pos.x(), pos.y(), pos.z()});
   const float half_size = size*0.5;
 
+  touchGpu(texture.lease_);
   glEnable(GL_TEXTURE_2D);
   texture.texture_->bind();
   glBegin(GL_QUADS);
@@ -750,55 +820,13 @@ void Renderer::renderTextureViewFacing(const GLTexture &texture, const Eigen::Ve
   glPopMatrix();
 }
 
-Eigen::MatrixXf Renderer::generateVertex(const std::vector<Eigen::VectorXf> &points,
-                                         const std::vector<Eigen::VectorXf> &colors) const {
-  const auto dim_points = checkDimension(points);
-  const auto dim_colors = checkDimension(colors);
-  if (dim_points <= 0) {
-    return Eigen::MatrixXf();
-  }
-
-  Eigen::MatrixXf vertex(dim_points + dim_colors, points.size());
-  for (size_t i = 0; i < points.size(); ++i) {
-    const auto &p = points[i];
-    for (int d = 0; d < dim_points; ++d) {
-      vertex(d, i) = p[d];
-    }
-    if (dim_colors > 0) {
-      const auto &c = colors[i];
-      for (int d = 0; d < dim_colors; ++d) {
-        vertex(d + dim_points, i) = c[d];
-      }
-    }
-  }
-
-  return vertex;
-}
-
-Eigen::MatrixXf Renderer::generateVertex(const std::vector<Eigen::Vector2f> &points,
-                                         const std::vector<Eigen::VectorXf> &colors) const {
+Eigen::MatrixXf Renderer::generateVertex(const std::vector<Eigen::Vector2f> &points) const {
   if (points.empty()) {
     return Eigen::MatrixXf();
   }
 
-  const int dim_pos = 2;
-  const auto dim_color = checkDimension(colors);
-
-  Eigen::MatrixXf vertex(dim_pos + dim_color, points.size());
-  for (size_t i = 0; i < points.size(); ++i) {
-    const auto &p = points[i];
-    for (int d = 0; d < dim_pos; ++d) {
-      vertex(d, i) = p[d];
-    }
-    if (dim_color > 0) {
-      const auto &c = colors[i];
-      for (int d = 0; d < dim_color; ++d) {
-        vertex(d + dim_pos, i) = c[d];
-      }
-    }
-  }
-
-  return vertex;
+  // Vector2f is packed, so this is a single copy
+  return Eigen::Map<const Eigen::MatrixXf>(points.front().data(), 2, points.size());
 }
 
 GLBuffer Renderer::generateGLBuffer(const Eigen::MatrixXf &vertex, const uint8_t dim_points,
@@ -807,9 +835,22 @@ GLBuffer Renderer::generateGLBuffer(const Eigen::MatrixXf &vertex, const uint8_t
   if (vertex.rows() <= 0 || vertex.cols() <= 0 || vertex.size() <= 0 || dim_points == 0) {
     return GLBuffer();
   }
+  return generateGLBuffer(vertex.data(), vertex.cols(), dim_points, dim_colors, indices);
+}
 
+GLBuffer Renderer::generateGLBuffer(const VertexSpan<Eigen::Vector3f> &points,
+                                    const std::vector<unsigned int> &indices) {
+  if (points.empty()) {
+    return GLBuffer();
+  }
+  return generateGLBuffer(points.data->data(), points.size, 3, 0, indices);
+}
+
+GLBuffer Renderer::generateGLBuffer(const float *vertex, const size_t count,
+                                    const uint8_t dim_points, const uint8_t dim_colors,
+                                    const std::vector<unsigned int> &indices) {
   GLBuffer buffer;
-  buffer.count_vertex = vertex.cols();
+  buffer.count_vertex = count;
   buffer.count_index = indices.size();
   buffer.vao.reset(new QOpenGLVertexArrayObject());
   buffer.vbo.reset(new QOpenGLBuffer(QOpenGLBuffer::Type::VertexBuffer));
@@ -817,7 +858,7 @@ GLBuffer Renderer::generateGLBuffer(const Eigen::MatrixXf &vertex, const uint8_t
   buffer.vao->bind();
   buffer.vbo->create();
   buffer.vbo->bind();
-  buffer.vbo->allocate(vertex.data(), sizeof(float) * vertex.size());
+  buffer.vbo->allocate(vertex, sizeof(float) * (dim_points + dim_colors) * count);
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, dim_points, GL_FLOAT, GL_FALSE,
                         sizeof(float) * (dim_points + dim_colors), nullptr);
@@ -836,22 +877,94 @@ GLBuffer Renderer::generateGLBuffer(const Eigen::MatrixXf &vertex, const uint8_t
   }
   buffer.vbo->release();
   buffer.vao->release();
+  buffer.lease = trackGpu(sizeof(float) * (dim_points + dim_colors) * count +
+                          sizeof(unsigned int) * indices.size());
+
+  return buffer;
+}
+
+void Renderer::generateGLBufferAsync(const std::shared_ptr<const Eigen::MatrixXf> &vertex,
+                                     const uint8_t dim_points, const uint8_t dim_colors,
+                                     const std::function<void(GLBuffer)> &done) {
+  if (!vertex || vertex->size() <= 0 || dim_points == 0) {
+    done(GLBuffer());
+    return;
+  }
+  if (!global_data_->upload_worker_) {
+    done(generateGLBuffer(*vertex, dim_points, dim_colors));
+    return;
+  }
+
+  auto vbo = std::make_shared<QOpenGLBuffer>(QOpenGLBuffer::Type::VertexBuffer);
+  const size_t count = vertex->cols();
+  global_data_->upload_worker_->post(
+      [vbo, vertex]() {
+        vbo->create();
+        vbo->bind();
+        vbo->allocate(vertex->data(), sizeof(float) * vertex->size());
+        vbo->release();
+      },
+      [this, vbo, count, dim_points, dim_colors, done]() {
+        done(wrapGLBuffer(vbo, count, dim_points, dim_colors));
+      });
+}
 
+GLBuffer Renderer::wrapGLBuffer(const std::shared_ptr<QOpenGLBuffer> &vbo, const size_t count,
+                                const uint8_t dim_points, const uint8_t dim_colors) {
+  if (!vbo || !vbo->isCreated()) {
+    return GLBuffer();
+  }
+  GLBuffer buffer;
+  buffer.count_vertex = count;
+  buffer.count_index = 0;
+  buffer.vbo = vbo;
+  buffer.vao.reset(new QOpenGLVertexArrayObject());
+  buffer.vao->create();
+  buffer.vao->bind();
+  buffer.vbo->bind();
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, dim_points, GL_FLOAT, GL_FALSE,
+                        sizeof(float) * (dim_points + dim_colors), nullptr);
+  if (dim_colors > 0) {
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, dim_colors, GL_FLOAT, GL_FALSE,
+                          sizeof(float) * (dim_points + dim_colors),
+                          (void *)(sizeof(float) * dim_points));
+  }
+  buffer.vbo->release();
+  buffer.vao->release();
+  buffer.lease = trackGpu(sizeof(float) * (dim_points + dim_colors) * count);
   return buffer;
 }
 
+std::shared_ptr<const Eigen::MatrixXf> Renderer::decimateVertex(Eigen::MatrixXf *vertex,
+                                                                const int stride) const {
+  auto decimated = std::make_shared<Eigen::MatrixXf>();
+  if (stride <= 1) {
+    decimated->swap(*vertex);
+    return decimated;
+  }
+  decimated->resize(vertex->rows(), (vertex->cols() + stride - 1) / stride);
+  for (int i = 0; i < decimated->cols(); ++i) {
+    decimated->col(i) = vertex->col(i * stride);
+  }
+  return decimated;
+}
+
 GLBuffer Renderer::generateGLBuffer(const std::vector<std::vector<Eigen::Vector2f>> &polygons,
-                                    const std::vector<Eigen::VectorXf> &colors) {
-  const auto dim_colors = checkDimension(colors);
+                                    const VertexSpan<Eigen::Vector4f> &colors) {
+  const int dim_colors = colors.size == polygons.size() ? 4 : 0;
   int size_vertex = 0;
   int size_indices = 0;
   std::vector<unsigned int> triangulated_indices;
-  for (const auto &polygon : polygons) {
-    auto indices = triangulate(polygon);
+  auto triangulation = crdc::airi::common::Singleton<TriangulationService>::get();
+  const auto batch = triangulation->triangulate(polygons);
+  for (size_t polygon_no = 0; polygon_no < polygons.size(); ++polygon_no) {
+    const auto &indices = batch[polygon_no];
     for (const auto index : indices) {
       triangulated_indices.push_back(index + size_vertex);
     }
-    size_vertex += polygon.size();
+    size_vertex += polygons[polygon_no].size();
     size_indices += indices.size();
   }
 
@@ -863,12 +976,11 @@ GLBuffer Renderer::generateGLBuffer(const std::vector<std::vector<Eigen::Vector2
   auto p = vertex.data();
   for (size_t polygon_no = 0; polygon_no < polygons.size(); ++polygon_no) {
     const auto &polygon = polygons[polygon_no];
-    const auto &color = colors[polygon_no];
     for (const auto &pt : polygon) {
       *p++ = pt.x();
       *p++ = pt.y();
       for (int i = 0; i < dim_colors; ++i) {
-        *p++ = color[i];
+        *p++ = colors[polygon_no][i];
       }
     }
   }
@@ -896,29 +1008,68 @@ GLBuffer Renderer::generateGLBuffer(const std::vector<std::vector<Eigen::Vector2
                           (void *)(sizeof(float) * 2));
   }
   buffer.vao->release();
+  buffer.lease = trackGpu(sizeof(float) * vertex.size() +
+                          sizeof(unsigned int) * triangulated_indices.size());
 
   return buffer;
 }
 
-void Renderer::drawArrays(const GLenum mode, const std::vector<Eigen::VectorXf> &points,
-                          const std::vector<Eigen::VectorXf> &colors) {
-  const auto dim_points = checkDimension(points);
-  const auto dim_colors = checkDimension(colors);
-  if (dim_points <= 0) {
+void Renderer::drawArrays(const GLenum mode, const VertexSpan<Eigen::Vector3f> &points,
+                          const VertexSpan<Eigen::Vector4f> &colors) {
+  if (points.empty()) {
     return;
   }
 
-  auto vertex = generateVertex(points, colors);
-#ifdef __aarch64__
-  auto indice = triangulate(points);
-  auto buffer = generateGLBuffer(vertex, dim_points, dim_colors, indice);
-  drawArrays(mode, buffer);
-}
+  // Vector3f is packed, uncolored points are uploaded as they are
+  const float *vertex = points.data->data();
+  const int dim_colors = colors.size == points.size ? 4 : 0;
+  const int dim = 3 + dim_colors;
+  if (dim_colors > 0) {
+    auto interleaved = arena()->allocate<float>(points.size * dim);
+    auto p = interleaved;
+    for (size_t i = 0; i < points.size; ++i) {
+      memcpy(p, points[i].data(), sizeof(float) * 3);
+      memcpy(p + 3, colors[i].data(), sizeof(float) * 4);
+      p += dim;
+    }
+    vertex = interleaved;
+  }
 
-#else
-  auto buffer = generateGLBuffer(vertex, dim_points, dim_colors);
-  drawArrays(mode, buffer);
+  if (!stream_buffer_.vao) {
+    stream_buffer_.vao.reset(new QOpenGLVertexArrayObject());
+    stream_buffer_.vbo.reset(new QOpenGLBuffer(QOpenGLBuffer::Type::VertexBuffer));
+    stream_buffer_.vao->create();
+    stream_buffer_.vbo->create();
+    stream_buffer_.vbo->setUsagePattern(QOpenGLBuffer::StreamDraw);
+  }
+  stream_buffer_.count_vertex = points.size;
+  stream_buffer_.count_index = 0;
+
+  stream_buffer_.vao->bind();
+  stream_buffer_.vbo->bind();
+  const size_t bytes = sizeof(float) * dim * points.size;
+  stream_buffer_.vbo->allocate(vertex, bytes);
+  // accounted only, it is filled again on every draw and cannot be evicted
+  if (!stream_buffer_.lease || bytes != stream_bytes_) {
+    stream_buffer_.lease = trackGpu(bytes);
+    stream_bytes_ = bytes;
+  }
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * dim, nullptr);
+  if (dim_colors > 0) {
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, dim_colors, GL_FLOAT, GL_FALSE, sizeof(float) * dim,
+                          (void *)(sizeof(float) * 3));
+  } else {
+    glDisableVertexAttribArray(3);
+  }
+  stream_buffer_.vbo->release();
+  stream_buffer_.vao->release();
+
+  drawArrays(mode, stream_buffer_);
 }
+
+#ifndef __aarch64__
 void Renderer::drawArrays(const GLenum mode, const Eigen::MatrixXf &vertex,
                           const uint8_t dim_points, const uint8_t dim_colors) {
   auto buffer = generateGLBuffer(vertex, dim_points, dim_colors);
@@ -926,15 +1077,16 @@ void Renderer::drawArrays(const GLenum mode, const Eigen::MatrixXf &vertex,
 }
 #endif
 
-
 void Renderer::drawArrays(const GLenum mode, GLBuffer &buffer) {
   if (!buffer.vao || !buffer.vbo) {
     return;
   }
 
+  touchGpu(buffer.lease);
   buffer.vao->bind();
   buffer.vbo->bind();
   glDrawArrays(mode, 0, buffer.count_vertex);
+  global_data_->profiler_->countDraw(buffer.count_vertex);
   buffer.vbo->release();
   buffer.vao->release();
 }
@@ -944,15 +1096,106 @@ void Renderer::drawElements(const GLenum mode, GLBuffer &buffer) {
     return;
   }
 
+  touchGpu(buffer.lease);
   buffer.vao->bind();
   buffer.vbo->bind();
   buffer.ibo->bind();
   glDrawElements(mode, buffer.count_index, GL_UNSIGNED_INT, nullptr);
+  global_data_->profiler_->countDraw(buffer.count_index);
   buffer.ibo->release();
   buffer.vbo->release();
   buffer.vao->release();
 }
 
+GLBuffer Renderer::generatePolyline(const std::vector<Eigen::Vector2f> &points) {
+  if (!global_data_->polyline_shader_) {
+    global_data_->polyline_shader_.reset(new PolylineShader());
+    if (!global_data_->polyline_shader_->initialize()) {
+      LOG(WARNING) << "Polyline shader unavailable, fall back to CPU extrusion";
+    }
+  }
+  if (!global_data_->polyline_shader_->available()) {
+    return GLBuffer();
+  }
+  auto buffer = global_data_->polyline_shader_->generateBuffer(points);
+  if (buffer.vbo) {
+    // position, prev, next, side and distance per vertex
+    buffer.lease = trackGpu(sizeof(float) * 8 * buffer.count_vertex);
+  }
+  return buffer;
+}
+
+bool Renderer::drawPolyline(GLBuffer &buffer, const float width, const float dash_length,
+                            const float dash_ratio) {
+  if (!global_data_->polyline_shader_ || !global_data_->polyline_shader_->available()) {
+    return false;
+  }
+
+  GLfloat color[4];
+  glm::mat4 mvp;
+#ifdef __aarch64__
+  GLint program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  glGetUniformfv(program, glGetUniformLocation(program, "color"), color);
+  mvp = frame_ ? frame_->mvp
+               : glm::mat4(global_data_->camera_->getProjectionMatrix() *
+                           global_data_->camera_->getModelMatrix());
+#else
+  glGetFloatv(GL_CURRENT_COLOR, color);
+  GLfloat projection[16], modelview[16];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  mvp = glm::make_mat4(projection) * glm::make_mat4(modelview);
+#endif
+  touchGpu(buffer.lease);
+  global_data_->polyline_shader_->draw(buffer, glm::value_ptr(mvp), color, width, dash_length,
+                                       dash_ratio);
+  global_data_->profiler_->countDraw(buffer.count_vertex);
+  return true;
+}
+
+bool Renderer::drawPolyline(const std::vector<Eigen::Vector2f> &points, const float width,
+                            const float dash_length, const float dash_ratio) {
+  if (points.size() < 2) {
+    return false;
+  }
+  if (global_data_->polyline_shader_ && !global_data_->polyline_shader_->available()) {
+    return false;
+  }
+
+  const uint64_t sequence = frame_ ? frame_->sequence : 0;
+  if (sequence != polyline_sequence_) {
+    polyline_sequence_ = sequence;
+    previous_polylines_ = std::move(polylines_);
+    polylines_.clear();
+  }
+
+  // FNV-1a over the raw coordinates
+  uint64_t key = 14695981039346656037ull;
+  const auto data = reinterpret_cast<const uint8_t *>(points.data());
+  for (size_t i = 0; i < points.size() * sizeof(Eigen::Vector2f); ++i) {
+    key = (key ^ data[i]) * 1099511628211ull;
+  }
+
+  auto it = polylines_.find(key);
+  if (it == polylines_.end() || it->second.points != points) {
+    auto previous = previous_polylines_.find(key);
+    // a colliding key replaces the entry, the other polyline is uploaded again when drawn
+    if (previous != previous_polylines_.end() && previous->second.points == points) {
+      polylines_[key] = std::move(previous->second);
+      previous_polylines_.erase(previous);
+    } else {
+      auto buffer = generatePolyline(points);
+      if (!buffer.vbo) {
+        return false;
+      }
+      polylines_[key] = {points, buffer};
+    }
+    it = polylines_.find(key);
+  }
+  return drawPolyline(it->second.buffer, width, dash_length, dash_ratio);
+}
+
 std::vector<Eigen::Vector2f> Renderer::generateLineStripPolygon(
     const std::vector<Eigen::Vector2f> &points, const float width) {
   if (points.size() < 2) {
@@ -1042,47 +1285,9 @@ std::vector<std::vector<Eigen::Vector2f>> Renderer::generateDashedLineStripPolyg
   return segments;
 }
 
-int Renderer::checkDimension(const std::vector<Eigen::VectorXf> &vertex) const {
-  if (vertex.empty()) {
-    return 0;
-  }
-
-  const auto &front = vertex.front();
-  const int dim = front.rows();
-
-  for (const auto &v : vertex) {
-    if (v.rows() != dim) {
-      return 0;
-    }
-  }
-
-  return dim;
-}
-
 std::vector<unsigned int> Renderer::triangulate(const std::vector<Eigen::Vector2f> &polygon) const {
-  std::vector<std::vector<Eigen::Vector2f>> polygon_with_hole;
-  polygon_with_hole.push_back(polygon);
-  return mapbox::earcut<unsigned int>(polygon_with_hole);
-}
-
-#ifdef __aarch64__
-std::vector<unsigned int> Renderer::triangulate(const std::vector<Eigen::VectorXf> &points) const {
-    //std::cout<<" triangulate points "<<points.size()<<std::endl;
-    std::vector<std::vector<Eigen::Vector2f>> tmp;
-    std::vector<Eigen::Vector2f> tmp_;
-    for(int i = 0; i < points.size(); i++) {
-        const auto &p = points[i];
-        Eigen::Vector2f t;
-        t[0] = p[0];
-        t[1] = p[1];
-	tmp_.push_back(t);
-    }
-
-    tmp.push_back(tmp_);
-    return mapbox::earcut<unsigned int>(tmp);
-
+  return crdc::airi::common::Singleton<TriangulationService>::get()->triangulate(polygon);
 }
-#endif
 
 }  // namespace airi
 }  // namespace crdc
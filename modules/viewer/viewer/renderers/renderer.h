@@ -6,14 +6,18 @@
 #include <QOpenGLFunctions>
 #include <QOpenGLTexture>
 #include <QOpenGLVertexArrayObject>
+#include <functional>
 #include <memory>
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgcodecs/legacy/constants_c.h>
 #include <opencv2/imgproc/types_c.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <GL/gl.h>
 #include <math.h>
 #include <glog/logging.h>
+#include "viewer/frame_arena.h"
 
 namespace geometry_msgs {
 class TransformStamped;
@@ -50,6 +54,9 @@ namespace viewer {
 class Color;
 }
 class GlobalData;
+class GpuLease;
+struct FrameContext;
+struct RenderState;
 
 struct GLPushGuard {
   GLPushGuard() { glPushMatrix(); }
@@ -61,6 +68,7 @@ struct GLBuffer {
   std::shared_ptr<QOpenGLBuffer> vbo, ibo;
   size_t count_vertex;
   size_t count_index;
+  std::shared_ptr<GpuLease> lease;
 };
 
 struct GLBufferWithTrans {
@@ -77,6 +85,7 @@ struct GLTextureDesc {
 struct GLTexture {
   std::shared_ptr<QOpenGLTexture> texture_;
   QRect roi_;
+  std::shared_ptr<GpuLease> lease_;
 };
 
 class Renderer : protected QOpenGLFunctions {
@@ -93,6 +102,25 @@ class Renderer : protected QOpenGLFunctions {
 
   virtual void render() {}
 
+  // GUI thread, adds what should be prepared this frame, i.e. itself or its channels
+  virtual void schedule(std::vector<Renderer *> *tasks) { tasks->push_back(this); }
+
+  // worker thread, CPU side work only, no GL calls
+  virtual void prepare(const std::shared_ptr<const FrameContext> &frame) { frame_ = frame; }
+
+  // GUI thread, issues the GL calls of what was prepared
+  virtual void submit() { render(); }
+
+  // static layers are drawn first into a cached framebuffer, which is only redrawn
+  // when the camera or the layer version changed, so a layer bumps its version on
+  // every change of what it draws, its config included
+  virtual bool isStaticLayer() const { return false; }
+  virtual uint64_t layerVersion() const { return 0; }
+
+  // GUI thread, instead of submit() while the layer is drawn from the cache, marks what
+  // it would have drawn as used so the GPU budget does not evict it
+  virtual void touchCached() {}
+
 #ifdef __aarch64__
 
   void bot_quat_to_roll_pitch_yaw (const double q[4], double rpy[3]) 
@@ -115,26 +143,36 @@ class Renderer : protected QOpenGLFunctions {
  protected:
   void setColor(const viewer::Color &color);
 
+  // thread safe, asks for a repaint after new data arrived
+  void requestRedraw();
+
+  // knobs the quality controller chose for this renderer in the current frame
+  const QualitySettings &quality() const;
+
+  // multiplier of angular steps chosen by the quality controller
+  float tessellation() const;
+
   // void transform(const std::string &target_frame_id, const std::string &source_frame_id = "global", const uint64_t utime = 0);
 
   // higher level APIs
  protected:
-  void drawPoints(const std::vector<Eigen::VectorXf> &points,
-                  const std::vector<Eigen::VectorXf> &colors = {});
+  // points are contiguous, e.g. a std::vector or arena memory, colors are optional
+  void drawPoints(const VertexSpan<Eigen::Vector3f> &points,
+                  const VertexSpan<Eigen::Vector4f> &colors = {});
 
-  void drawLines(const std::vector<Eigen::VectorXf> &points,
-                 const std::vector<Eigen::VectorXf> &colors = {});
+  void drawLines(const VertexSpan<Eigen::Vector3f> &points,
+                 const VertexSpan<Eigen::Vector4f> &colors = {});
 
-  void drawLineStrip(const std::vector<Eigen::VectorXf> &points,
-                     const std::vector<Eigen::VectorXf> &colors = {});
+  void drawLineStrip(const VertexSpan<Eigen::Vector3f> &points,
+                     const VertexSpan<Eigen::Vector4f> &colors = {});
 
-  void drawLineLoop(const std::vector<Eigen::VectorXf> &points,
-                    const std::vector<Eigen::VectorXf> &colors = {});
+  void drawLineLoop(const VertexSpan<Eigen::Vector3f> &points,
+                    const VertexSpan<Eigen::Vector4f> &colors = {});
 
   void drawArrow(const Eigen::Vector3f &from, const Eigen::Vector3f &to, const float scale = 0.3f);
 
-  void drawTriangles(const std::vector<Eigen::VectorXf> &points,
-                     const std::vector<Eigen::VectorXf> &colors = {});
+  void drawTriangles(const VertexSpan<Eigen::Vector3f> &points,
+                     const VertexSpan<Eigen::Vector4f> &colors = {});
 
   void drawEllipse(const Eigen::Vector2f &center, const float radius_x, const float radius_y,
                    const float heading, const bool fill = true, const float step = M_PI / 180.f);
@@ -161,6 +199,9 @@ class Renderer : protected QOpenGLFunctions {
 
   void drawLineStripQuads(const std::vector<Eigen::Vector2f> &points, const float width);
 
+  void drawDashedLineStrip(const std::vector<Eigen::Vector2f> &points, const float width,
+                           const float length_segment, const float ratio = 0.5f);
+
   void drawSphere(const Eigen::Vector3f &center, const float radius);
 
   void drawBoundingBox(const Eigen::Vector3f &center, const Eigen::Vector3f &lwh,
@@ -169,7 +210,10 @@ class Renderer : protected QOpenGLFunctions {
 
   void drawConvexCylinder(const std::vector<Eigen::Vector2f> &polygon, const float height);
 
-  float drawText(const Eigen::VectorXf &pos, const std::string &text, const int font_size,
+  float drawText(const Eigen::Vector3f &pos, const std::string &text, const int font_size,
+                 const bool bold = false);
+
+  float drawText(const Eigen::Vector2f &pos, const std::string &text, const int font_size,
                  const bool bold = false);
 
   void drawIcon(const Eigen::Vector3f &pos, const QIcon &icon, const int size);
@@ -184,21 +228,41 @@ class Renderer : protected QOpenGLFunctions {
 
   // lower level APIs
  protected:
-  Eigen::MatrixXf generateVertex(const std::vector<Eigen::VectorXf> &points,
-                                 const std::vector<Eigen::VectorXf> &colors = {}) const;
-
-  Eigen::MatrixXf generateVertex(const std::vector<Eigen::Vector2f> &points,
-                                 const std::vector<Eigen::VectorXf> &colors = {}) const;
+  Eigen::MatrixXf generateVertex(const std::vector<Eigen::Vector2f> &points) const;
 
   GLBuffer generateGLBuffer(const Eigen::MatrixXf &vertex, const uint8_t dim_points,
                             const uint8_t dim_colors,
                             const std::vector<unsigned int> &indices = {});
 
+  // one copy of the points, no per vertex work
+  GLBuffer generateGLBuffer(const VertexSpan<Eigen::Vector3f> &points,
+                            const std::vector<unsigned int> &indices = {});
+
+  // interleaved vertices, count of them
+  GLBuffer generateGLBuffer(const float *vertex, const size_t count, const uint8_t dim_points,
+                            const uint8_t dim_colors,
+                            const std::vector<unsigned int> &indices = {});
+
+  // uploaded on the GL upload worker, done gets the buffer on the GUI thread in a later frame
+  void generateGLBufferAsync(const std::shared_ptr<const Eigen::MatrixXf> &vertex,
+                             const uint8_t dim_points, const uint8_t dim_colors,
+                             const std::function<void(GLBuffer)> &done);
+
+  // vertex array of a buffer uploaded on another context, VAOs are not shared
+  GLBuffer wrapGLBuffer(const std::shared_ptr<QOpenGLBuffer> &vbo, const size_t count,
+                        const uint8_t dim_points, const uint8_t dim_colors);
+
+  // keeps every stride-th column in a matrix shared with the upload worker, for stride 1
+  // the columns of vertex are swapped in without a copy and vertex is left empty
+  std::shared_ptr<const Eigen::MatrixXf> decimateVertex(Eigen::MatrixXf *vertex,
+                                                        const int stride) const;
+
   GLBuffer generateGLBuffer(const std::vector<std::vector<Eigen::Vector2f>> &polygons,
-                            const std::vector<Eigen::VectorXf> &colors = {});
+                            const VertexSpan<Eigen::Vector4f> &colors = {});
 
-  void drawArrays(const GLenum mode, const std::vector<Eigen::VectorXf> &points,
-                  const std::vector<Eigen::VectorXf> &colors = {});
+  // streamed through one reused buffer, interleaved in the frame arena if colored
+  void drawArrays(const GLenum mode, const VertexSpan<Eigen::Vector3f> &points,
+                  const VertexSpan<Eigen::Vector4f> &colors = {});
 
   void drawArrays(const GLenum mode, const Eigen::MatrixXf &vertex, const uint8_t dim_points,
                   const uint8_t dim_colors);
@@ -207,6 +271,17 @@ class Renderer : protected QOpenGLFunctions {
 
   void drawElements(const GLenum mode, GLBuffer &buffer);
 
+  // centerline only, width and dashes are applied by the polyline shader
+  GLBuffer generatePolyline(const std::vector<Eigen::Vector2f> &points);
+
+  // false if the polyline shader is not available
+  bool drawPolyline(GLBuffer &buffer, const float width, const float dash_length = 0.f,
+                    const float dash_ratio = 0.5f);
+
+  // the centerline is uploaded once and reused across frames while the points do not change
+  bool drawPolyline(const std::vector<Eigen::Vector2f> &points, const float width,
+                    const float dash_length = 0.f, const float dash_ratio = 0.5f);
+
   std::vector<Eigen::Vector2f> generateLineStripPolygon(const std::vector<Eigen::Vector2f> &points,
                                                         const float width);
 
@@ -217,17 +292,36 @@ class Renderer : protected QOpenGLFunctions {
       const std::vector<Eigen::Vector2f> &points, const float width, const float length_segment,
       const float ratio = 0.5f);
 
+  // per frame scratch memory, thread safe, reset after paintGL
+  FrameArena *arena() const;
+
+  // accounts GL memory of this renderer in the GPU resource manager
+  std::shared_ptr<GpuLease> trackGpu(const size_t bytes) const;
+
+  // marks a resource as drawn, least recently drawn ones are evicted first
+  void touchGpu(const std::shared_ptr<GpuLease> &lease) const;
+
+  // draws later in this submit, sorted by state with the other draws of the renderer
+  void enqueue(const RenderState &state, const std::function<void()> &draw);
+
   // inner functions
  private:
-  int checkDimension(const std::vector<Eigen::VectorXf> &vertex) const;
-
   std::vector<unsigned int> triangulate(const std::vector<Eigen::Vector2f> &polygon) const;
-#ifdef __aarch64__
-  std::vector<unsigned int> triangulate(const std::vector<Eigen::VectorXf> &points) const;
-#endif
 
  protected:
   GlobalData *global_data_;
+  std::shared_ptr<const FrameContext> frame_;
+  GLBuffer stream_buffer_;
+  size_t stream_bytes_{0};
+
+  struct CachedPolyline {
+    std::vector<Eigen::Vector2f> points;
+    GLBuffer buffer;
+  };
+  // centerlines drawn in this and the previous frame, older ones are released
+  std::unordered_map<uint64_t, CachedPolyline> polylines_;
+  std::unordered_map<uint64_t, CachedPolyline> previous_polylines_;
+  uint64_t polyline_sequence_{0};
 };
 
 }  // namespace airi
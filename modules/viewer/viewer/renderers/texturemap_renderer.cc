@@ -1,8 +1,12 @@
 #include "viewer/renderers/texturemap_renderer.h"
+#include <algorithm>
 #include <functional>
 #include <thread>
 #include "common/io/file.h"
+#include "viewer/frame_context.h"
+#include "viewer/gl_upload_worker.h"
 #include "viewer/global_data.h"
+#include "viewer/gpu_resource_manager.h"
 #include "viewer/renderer_manager.h"
 #include "viewer/widgets/check_box.h"
 #include "viewer/widgets/renderer_item.h"
@@ -12,10 +16,14 @@ namespace crdc {
 namespace airi {
 
 TexturemapRenderer::TexturemapRenderer() {
-  auto item = new RendererItem(
+  item_ = new RendererItem(
       "Texture Map", global_data_->config_.texturemap_renderer_enable(),
-      [&](bool is_checked) { global_data_->config_.set_texturemap_renderer_enable(is_checked); });
-  global_data_->renderer_manager_->addWidget(item);
+      [&](bool is_checked) {
+        global_data_->updateConfig(
+            [&](viewer::Config *config) { config->set_texturemap_renderer_enable(is_checked); });
+        ++version_;
+      });
+  global_data_->renderer_manager_->addWidget(item_);
 
   for (const auto &info : global_data_->config_.texturemaps()) {
     const auto &name = info.name();
@@ -29,6 +37,7 @@ TexturemapRenderer::TexturemapRenderer() {
     auto cb_enable =
         new CheckBox(QString::fromStdString(name), enables_[name], [=](bool is_checked) {
           enables_[name].store(is_checked);
+          ++version_;
 
           if (is_checked && !loaded_[name].load() && !loading_[name].load()) {
             std::thread handle_thread_load(
@@ -36,11 +45,14 @@ TexturemapRenderer::TexturemapRenderer() {
             handle_thread_load.detach();
           }
         });
-    item->addWidget(cb_enable);
+    item_->addWidget(cb_enable);
 
     auto slider_alpha =
-        new Slider("Alpha", 2, 0, 1, alpha_[name], [&](double val) { alpha_[name] = val; });
-    item->addWidget(slider_alpha);
+        new Slider("Alpha", 2, 0, 1, alpha_[name], [=](double val) {
+          alpha_[name] = val;
+          ++version_;
+        });
+    item_->addWidget(slider_alpha);
   }
 }
 
@@ -48,6 +60,11 @@ bool TexturemapRenderer::enabled() const {
   return global_data_->config_.texturemap_renderer_enable();
 }
 
+void TexturemapRenderer::loadConfigPost() {
+  item_->setChecked(enabled());
+  ++version_;
+}
+
 void TexturemapRenderer::render() {
   if (!enabled()) {
     return;
@@ -58,28 +75,103 @@ void TexturemapRenderer::render() {
       continue;
     }
 
+    // tiles are uploaded once they are on screen, off-screen ones can be evicted and
+    // uploaded again from their image later
     if (!prepared_[name].load()) {
-      LOG(INFO) << "Preparing texturemap for " << name;
-      for (const auto &desc : texture_descs_[name]) {
-        auto qimg = QImage(desc.image_.data, desc.image_.cols, desc.image_.rows, desc.image_.step,
-                           QImage::Format_RGB888);
-        GLTexture texture;
-        texture.texture_.reset(new QOpenGLTexture(qimg));
-        texture.roi_ = desc.roi_;
-        textures_[name].push_back(texture);
+      textures_[name].resize(texture_descs_[name].size());
+      uploading_[name].assign(texture_descs_[name].size(), false);
+      for (size_t i = 0; i < texture_descs_[name].size(); ++i) {
+        textures_[name][i].roi_ = texture_descs_[name][i].roi_;
       }
-      LOG(INFO) << "Prepared texturemap for " << name;
-      texture_descs_[name].clear();
       prepared_[name].store(true);
     }
 
     glColor4f(1, 1, 1, alpha_[name]);
+    const auto &offset = offset_[name];
+    const auto resolution = resolution_[name];
+    auto &textures = textures_[name];
+    for (size_t i = 0; i < textures.size(); ++i) {
+      auto &texture = textures[i];
+      if (!isOnScreen(tileRect(name, texture))) {
+        continue;
+      }
+      if (!texture.texture_) {
+        uploadTile(name, i);
+        continue;
+      }
+      renderTexture(texture, {offset.x(), offset.y()}, resolution);
+    }
+  }
+}
+
+void TexturemapRenderer::touchCached() {
+  for (const auto &name : names_) {
+    if (!enables_[name].load() || !prepared_[name].load()) {
+      continue;
+    }
     for (const auto &texture : textures_[name]) {
-      renderTexture(texture, {offset_[name].x(), offset_[name].y()}, resolution_[name]);
+      if (texture.texture_ && isOnScreen(tileRect(name, texture))) {
+        touchGpu(texture.lease_);
+      }
     }
   }
 }
 
+QRectF TexturemapRenderer::tileRect(const std::string &name, const GLTexture &texture) const {
+  const auto &offset = offset_.at(name);
+  const auto resolution = resolution_.at(name);
+  return QRectF(texture.roi_.x() * resolution + offset.x(),
+                texture.roi_.y() * resolution + offset.y(), texture.roi_.width() * resolution,
+                texture.roi_.height() * resolution);
+}
+
+bool TexturemapRenderer::isOnScreen(const QRectF &rect) const {
+  // outside if all corners are beyond the same clip plane
+  int outside[4] = {0, 0, 0, 0};
+  for (const auto &corner : {rect.topLeft(), rect.topRight(), rect.bottomLeft(),
+                             rect.bottomRight()}) {
+    const auto clip = frame_->mvp * glm::vec4(corner.x(), corner.y(), 0.f, 1.f);
+    outside[0] += clip.x < -clip.w;
+    outside[1] += clip.x > clip.w;
+    outside[2] += clip.y < -clip.w;
+    outside[3] += clip.y > clip.w;
+  }
+  return std::none_of(outside, outside + 4, [](const int count) { return count == 4; });
+}
+
+void TexturemapRenderer::uploadTile(const std::string &name, const size_t index) {
+  if (uploading_[name][index]) {
+    return;
+  }
+  uploading_[name][index] = true;
+
+  // shares the pixels with the desc, which outlives the upload
+  const cv::Mat image = texture_descs_[name][index].image_;
+  auto uploaded = std::make_shared<std::shared_ptr<QOpenGLTexture>>();
+  global_data_->upload_worker_->post(
+      [image, uploaded]() {
+        auto qimg = QImage(image.data, image.cols, image.rows, image.step, QImage::Format_RGB888);
+        uploaded->reset(new QOpenGLTexture(qimg));
+      },
+      [this, name, index, uploaded]() {
+        uploading_[name][index] = false;
+        auto &texture = textures_[name][index];
+        texture.texture_ = *uploaded;
+        if (!texture.texture_) {
+          return;
+        }
+        texture.lease_ = trackGpu(texture.texture_->width() * texture.texture_->height() * 4);
+        // the cached layer has to be redrawn without the tile
+        global_data_->gpu_resources_->setEvictor(texture.lease_, [this, &texture]() {
+          texture.texture_.reset();
+          texture.lease_.reset();
+          ++version_;
+          return true;
+        });
+        ++version_;
+      });
+}
+
 void TexturemapRenderer::threadLoadTextureDesc(const viewer::TexturemapInfo &info) {
   loading_[info.name()].store(true);
   LOG(INFO) << "Loading texturemap for " << info.name();
@@ -92,6 +184,8 @@ void TexturemapRenderer::threadLoadTextureDesc(const viewer::TexturemapInfo &inf
   LOG(INFO) << "Loaded texturemap for " << info.name();
   loaded_[info.name()].store(true);
   loading_[info.name()].store(false);
+  ++version_;
+  requestRedraw();
 }
 
 }  // namespace airi
@@ -9,6 +9,8 @@
 namespace crdc {
 namespace airi {
 
+class RendererItem;
+
 class TexturemapRenderer : public Renderer {
  public:
   TexturemapRenderer();
@@ -20,11 +22,30 @@ class TexturemapRenderer : public Renderer {
 
   void render() override;
 
+  bool isStaticLayer() const override { return true; }
+
+  uint64_t layerVersion() const override { return version_; }
+
+  void touchCached() override;
+
+  void loadConfigPost() override;
+
  protected:
   void threadLoadTextureDesc(const viewer::TexturemapInfo &info);
 
+  // ground plane rect of a tile
+  QRectF tileRect(const std::string &name, const GLTexture &texture) const;
+
+  // rect on the ground plane against the frame's view frustum
+  bool isOnScreen(const QRectF &rect) const;
+
+  // on the GL upload worker, the tile is drawn from the frame after it is done
+  void uploadTile(const std::string &name, const size_t index);
+
  protected:
+  RendererItem *item_;
   std::set<std::string> names_;
+  std::atomic<uint64_t> version_{0};
   std::unordered_map<std::string, std::atomic<bool>> loading_;
   std::unordered_map<std::string, std::atomic<bool>> loaded_;
   std::unordered_map<std::string, std::atomic<bool>> prepared_;
@@ -34,6 +55,8 @@ class TexturemapRenderer : public Renderer {
   std::unordered_map<std::string, float> resolution_;
   std::unordered_map<std::string, std::vector<GLTextureDesc>> texture_descs_;
   std::unordered_map<std::string, std::vector<GLTexture>> textures_;
+  // GUI thread only, tiles posted to the upload worker
+  std::unordered_map<std::string, std::vector<bool>> uploading_;
 };
 
 }  // namespace airi
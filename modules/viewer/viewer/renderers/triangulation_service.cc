@@ -0,0 +1,105 @@
+#include "viewer/renderers/triangulation_service.h"
+#include "viewer/renderers/ear_cut.h"
+
+namespace crdc {
+namespace airi {
+
+TriangulationService::Indices TriangulationService::triangulate(const Polygon &polygon) {
+  if (polygon.size() < 3) {
+    return {};
+  }
+
+  const auto key = hash(polygon);
+  auto indices = find(key, polygon);
+  if (!indices) {
+    indices = std::make_shared<const Indices>(earcut(polygon));
+    insert(key, polygon, indices);
+  }
+  return *indices;
+}
+
+std::vector<TriangulationService::Indices> TriangulationService::triangulate(
+    const std::vector<Polygon> &polygons) {
+  std::vector<Indices> results(polygons.size());
+  std::vector<uint64_t> keys(polygons.size());
+  std::vector<size_t> misses;
+  size_t miss_vertices = 0;
+  for (size_t i = 0; i < polygons.size(); ++i) {
+    if (polygons[i].size() < 3) {
+      continue;
+    }
+    keys[i] = hash(polygons[i]);
+    auto indices = find(keys[i], polygons[i]);
+    if (indices) {
+      results[i] = *indices;
+    } else {
+      misses.push_back(i);
+      miss_vertices += polygons[i].size();
+    }
+  }
+
+  // small batches are not worth the hand over
+  auto run = [&](size_t n) { results[misses[n]] = earcut(polygons[misses[n]]); };
+  if (misses.size() > 1 && miss_vertices > 256) {
+    pool_.parallel_for(misses.size(), run);
+  } else {
+    for (size_t n = 0; n < misses.size(); ++n) {
+      run(n);
+    }
+  }
+
+  for (const auto i : misses) {
+    insert(keys[i], polygons[i], std::make_shared<const Indices>(results[i]));
+  }
+  return results;
+}
+
+uint64_t TriangulationService::hash(const Polygon &polygon) {
+  // FNV-1a over the raw coordinates
+  uint64_t h = 14695981039346656037ull;
+  const auto data = reinterpret_cast<const uint8_t *>(polygon.data());
+  const size_t size = polygon.size() * sizeof(Eigen::Vector2f);
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ data[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
+TriangulationService::Indices TriangulationService::earcut(const Polygon &polygon) {
+  // node pools of each worker are reused from polygon to polygon
+  thread_local mapbox::detail::Earcut<unsigned int> cutter;
+  thread_local std::vector<Polygon> rings(1);
+  rings[0].assign(polygon.begin(), polygon.end());
+  cutter(rings);
+  return cutter.indices;
+}
+
+std::shared_ptr<const TriangulationService::Indices> TriangulationService::find(
+    const uint64_t key, const Polygon &polygon) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = current_.find(key);
+  if (it != current_.end()) {
+    return it->second.polygon == polygon ? it->second.indices : nullptr;
+  }
+  it = previous_.find(key);
+  if (it == previous_.end() || it->second.polygon != polygon) {
+    return nullptr;
+  }
+  auto indices = it->second.indices;
+  current_[key] = std::move(it->second);
+  previous_.erase(it);
+  return indices;
+}
+
+void TriangulationService::insert(const uint64_t key, const Polygon &polygon,
+                                  const std::shared_ptr<const Indices> &indices) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_.size() >= capacity_) {
+    previous_ = std::move(current_);
+    current_.clear();
+  }
+  current_[key] = {polygon, indices};
+}
+
+}  // namespace airi
+}  // namespace crdc
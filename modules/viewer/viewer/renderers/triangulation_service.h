@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "common/singleton.h"
+#include "common/thread_pool.h"
+
+namespace crdc {
+namespace airi {
+
+/**
+ * @brief Earcut triangulation on worker threads, memoized by polygon content.
+ */
+class TriangulationService {
+ public:
+  using Polygon = std::vector<Eigen::Vector2f>;
+  using Indices = std::vector<unsigned int>;
+
+ public:
+  Indices triangulate(const Polygon &polygon);
+
+  // one index list per polygon, relative to the polygon's own vertices
+  std::vector<Indices> triangulate(const std::vector<Polygon> &polygons);
+
+  // joins the workers before static destruction, triangulation runs on the caller afterwards
+  void shutdown() { pool_.stop(); }
+
+ protected:
+  struct Entry {
+    Polygon polygon;
+    std::shared_ptr<const Indices> indices;
+  };
+
+  static uint64_t hash(const Polygon &polygon);
+
+  static Indices earcut(const Polygon &polygon);
+
+  std::shared_ptr<const Indices> find(const uint64_t key, const Polygon &polygon);
+
+  void insert(const uint64_t key, const Polygon &polygon,
+              const std::shared_ptr<const Indices> &indices);
+
+ protected:
+  // two generations, the older one is dropped when the current one is full
+  const size_t capacity_{4096};
+  std::unordered_map<uint64_t, Entry> current_;
+  std::unordered_map<uint64_t, Entry> previous_;
+  std::mutex mutex_;
+  common::ThreadPool pool_{std::max(1u, std::thread::hardware_concurrency() / 2)};
+
+ private:
+  MAKE_SINGLETON(TriangulationService);
+};
+
+}  // namespace airi
+}  // namespace crdc
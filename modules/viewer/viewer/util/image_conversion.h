@@ -3,18 +3,16 @@
  * @ingroup TYPE
  * @ingroup PB
  *
- * @brief Image conversion between protobuf message and OpenCV
- *
- * @note protobuf messages are jpeg compressed
+ * @brief Helpers for image messages, decoding is done by the image service
  */
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
+#include <glog/logging.h>
 #include <opencv2/opencv.hpp>
-#include <opencv2/imgcodecs/legacy/constants_c.h>
-#include <opencv2/imgproc/types_c.h>
 #include "cyber/sensor_proto/image.pb.h"
 #include "h264_rgb_encoder_decoder/decoder.h"
 
@@ -22,34 +20,34 @@ namespace crdc {
 namespace airi {
 namespace util {
 
-crdc::airi::H264DecoderData* decoder_data;
-
-static inline void init_h264_decoder() {
-  if(crdc::airi::decoder_init(&decoder_data) < 0){
-    printf("Fail to init decoder\n");
-  }
-}
-
-static inline void deinit_h264_decoder() {
-  crdc::airi::decoder_parse(decoder_data, NULL, 0);
-  crdc::airi::decoder_flush(decoder_data);
-  crdc::airi::decoder_dispose(decoder_data);
+/**
+ * @brief whether the image is a packet of a h264 or hevc stream, the proto has no hevc
+ *        compression, such streams come as h264 or with the type "H265" or "HEVC"
+ */
+static inline bool is_video_stream(const crdc::airi::Image2 &proto_image) {
+  return proto_image.compression() == crdc::airi::Image2_Compression_H264 ||
+         proto_image.type() == "H265" || proto_image.type() == "HEVC";
 }
 
-static inline bool cv_decoder(const crdc::airi::Image2 &proto_image, cv::Mat *image) {
-  if (proto_image.compression() == crdc::airi::Image2_Compression_H264) {
-    crdc::airi::decoder_parse(decoder_data, reinterpret_cast<uint8_t*>(const_cast<char*>(proto_image.data().c_str())),
-      proto_image.data().size());
-    *image = cv::Mat(decoder_data->height, decoder_data->width, CV_8UC3, decoder_data->out_buffer).clone();
-  } else {
-    std::vector<uint8_t> compressed_buffer(proto_image.data().begin(), proto_image.data().end());
-    *image = cv::imdecode(compressed_buffer, CV_LOAD_IMAGE_UNCHANGED);
-    // decoded 3 channel image is in order bgr
-    if (proto_image.type() == std::to_string(crdc::airi::RGB8)) {
-      cv::cvtColor(*image, *image, CV_BGR2RGB);
-    }
+/**
+ * @brief create a h264 or hevc decoder, the codec is detected from the stream, every
+ *        stream needs its own as P-frames refer to the frames before them
+ * @param thread_count slice threads, frame threads would hold frames back
+ * @return the decoder, disposed when the last copy goes, or nullptr on failure
+ */
+static inline std::shared_ptr<crdc::airi::H264DecoderData> create_video_decoder(
+    const int thread_count = 1) {
+  crdc::airi::H264DecoderData *decoder_data = nullptr;
+  if (crdc::airi::decoder_init_codec(&decoder_data, AV_CODEC_ID_NONE, thread_count, 0) < 0) {
+    LOG(ERROR) << "Fail to init decoder";
+    return nullptr;
   }
-  return true;
+  return std::shared_ptr<crdc::airi::H264DecoderData>(
+      decoder_data, [](crdc::airi::H264DecoderData *decoder_data) {
+        crdc::airi::decoder_parse(decoder_data, NULL, 0);
+        crdc::airi::decoder_flush(decoder_data);
+        crdc::airi::decoder_dispose(decoder_data);
+      });
 }
 
 /**
@@ -113,61 +111,6 @@ static inline bool cv_decoder(const crdc::airi::Image2 &proto_image, cv::Mat *im
 //   }
 // }
 
-/**
- * @brief convert Image from pb message to cv::Mat
- * @param proto_image
- * @param image
- * @param decoder
- */
-static bool convert_from_proto(const crdc::airi::Image2 &proto_image, cv::Mat *image,
-                      const std::function<bool(const crdc::airi::Image2 &, cv::Mat *)> &decoder) {
-  if (proto_image.compression() == crdc::airi::Image2_Compression_RAW) {
-    int type;
-    if (proto_image.type() == std::to_string(crdc::airi::MONO8)) {
-      type = CV_8UC1;
-      *image = cv::Mat(proto_image.height(), proto_image.width(), type,
-                     const_cast<char *>(proto_image.data().data()), proto_image.step())
-                 .clone();
-    } else if (proto_image.type() == std::to_string(crdc::airi::RGB8) ||
-               proto_image.type() == std::to_string(crdc::airi::BGR8)) {
-      type = CV_8UC3;
-      *image = cv::Mat(proto_image.height(), proto_image.width(), type,
-                     const_cast<char *>(proto_image.data().data()), proto_image.step())
-                 .clone();
-    } else if (proto_image.type() == std::string("NV12")) {
-      cv::Mat nv12(proto_image.height() * 3 / 2, proto_image.width(), CV_8UC1, (void*)proto_image.data().data());
-      cv::Mat rgb(proto_image.height(), proto_image.width(), CV_8UC3);
-      cv::cvtColor(nv12, rgb, cv::COLOR_YUV2RGB_NV12);
-      *image = rgb.clone();
-    } else if (proto_image.type() == std::string("Y")) {
-      cv::Mat y(proto_image.height(), proto_image.width(), CV_8UC1, (void*)proto_image.data().data());
-      cv::Mat rgb(proto_image.height(), proto_image.width(), CV_8UC3);
-      cv::cvtColor(y, rgb, cv::COLOR_GRAY2RGB);
-      *image = rgb.clone();
-    } else if (proto_image.type() == std::string("JPG")) {
-      std::vector<uint8_t> compressed_buffer(proto_image.data().begin(), proto_image.data().end());
-      cv::Mat image_jpeg = cv::imdecode(compressed_buffer, CV_LOAD_IMAGE_UNCHANGED);
-      cv::Mat rgb(proto_image.height(), proto_image.width(), CV_8UC3);
-      cv::cvtColor(image_jpeg, rgb, CV_BGR2RGB);
-      *image = rgb.clone();
-    } else {
-      LOG(ERROR) << "Unexpected image type: " << proto_image.type();
-      return false;
-    }
-    return true;
-  }
-  return decoder(proto_image, image);
-}
-
-/**
- * @brief convert Image from pb message to cv::Mat, cv_decoder(default) wrapper
- * @param proto_image
- * @param image
- */
-static bool convert_from_proto(const crdc::airi::Image2 &proto_image, cv::Mat *image) {
-  return convert_from_proto(proto_image, image, cv_decoder);
-}
-
 }  // namespace util
 }  // namespace airi
 }  // namespace crdc